@@ -0,0 +1,192 @@
+#pragma once
+#include "MeshData.h"
+#include "PresentPolicy.h"
+
+#include <cctype>
+#include <cerrno>
+#include <cstdint>
+#include <cstdlib>
+#include <limits>
+#include <stdexcept>
+#include <string>
+
+
+constexpr uint32_t minFramesInFlight{ 2 };
+constexpr uint32_t maxFramesInFlight{ 4 };
+
+constexpr uint32_t defaultHeadlessFrames{ 100 };
+
+constexpr uint32_t maxRecordThreads{ 64 };
+
+struct AppConfig
+{
+	uint32_t framesInFlight{ 2 };
+	bool headless{ false };
+	// 0 runs until the window is closed; headless runs always stop after a fixed number of frames.
+	uint32_t frameCount{ 0 };
+	std::string readbackPath{};
+	// 1 records inline on the main thread; more splits the draws over secondary command buffers.
+	uint32_t recordThreads{ 1 };
+	// Copies of the scene drawn each frame, tiled over the framebuffer; used to load the CPU recording path.
+	uint32_t drawCount{ 1 };
+	// 0 draws the scene with one draw call per copy; otherwise the scene is N instances of one instanced draw.
+	uint32_t instanceCount{ 0 };
+	// The instances become static objects that a compute pass culls and indirect draws render.
+	bool gpuDriven{ false };
+	// 0 draws a single triangle; otherwise each draw is a UV sphere with about N * N triangles.
+	uint32_t sphereSegments{ 0 };
+	// A .mesh file written by MeshConverter; takes precedence over --sphere.
+	std::string meshPath{};
+	// Format generated meshes are uploaded in; mesh files keep the format they were converted to.
+	MeshVertexFormat vertexFormat{ MeshVertexFormat::Quantized };
+	// Can be switched at runtime with the 1, 2 and 3 keys.
+	PresentProfile presentProfile{ PresentProfile::Smooth };
+	// 0 uses the profile's default, which is the monitor refresh rate for low-latency and no limit otherwise.
+	uint32_t fpsLimit{ 0 };
+	// Chrome trace JSON with the CPU and GPU timelines, written on exit.
+	std::string tracePath{};
+	// Device UUID or part of the device name; empty picks the best-scoring device.
+	std::string deviceSelection{};
+	// Non-zero runs the CPU frustum culling benchmark over N boxes and exits without creating a window or device.
+	uint32_t cullBenchmarkBoxes{ 0 };
+	// Non-zero runs the BVH build and ray query benchmark on a mesh of about N triangles and exits the same way.
+	uint32_t bvhBenchmarkTriangles{ 0 };
+	// Non-zero runs the transform hierarchy update benchmark on N nodes and exits the same way.
+	uint32_t hierarchyBenchmarkNodes{ 0 };
+};
+
+// strtoul alone would accept "-1" as ULONG_MAX and leave larger values to the narrowing cast, so the value must start
+// with a digit and fit in 32 bits.
+inline uint32_t parseUnsignedArgument(const std::string& name, const char* value)
+{
+	if (!std::isdigit(static_cast<unsigned char>(value[0])))
+		throw std::runtime_error("Invalid value for " + name + ": " + value);
+
+	char* end{ nullptr };
+	errno = 0;
+	unsigned long parsed{ std::strtoul(value, &end, 10) };
+
+	if (*end != '\0')
+		throw std::runtime_error("Invalid value for " + name + ": " + value);
+
+	if (errno == ERANGE || parsed > std::numeric_limits<uint32_t>::max())
+		throw std::runtime_error("Value out of range for " + name + ": " + value);
+
+	return static_cast<uint32_t>(parsed);
+}
+
+inline AppConfig parseCommandLine(int argc, char* argv[])
+{
+	AppConfig config{};
+
+	for (int i{ 1 }; i < argc; ++i)
+	{
+		const std::string arg{ argv[i] };
+
+		auto nextValue = [&]() -> const char*
+		{
+			if (i + 1 >= argc)
+				throw std::runtime_error("Missing value for " + arg);
+
+			return argv[++i];
+		};
+
+		if (arg == "--frames-in-flight")
+		{
+			config.framesInFlight = parseUnsignedArgument(arg, nextValue());
+
+			if (config.framesInFlight < minFramesInFlight || config.framesInFlight > maxFramesInFlight)
+				throw std::runtime_error("--frames-in-flight must be between "
+					+ std::to_string(minFramesInFlight) + " and " + std::to_string(maxFramesInFlight));
+		}
+		else if (arg == "--headless")
+			config.headless = true;
+		else if (arg == "--frames")
+			config.frameCount = parseUnsignedArgument(arg, nextValue());
+		else if (arg == "--readback")
+			config.readbackPath = nextValue();
+		else if (arg == "--record-threads")
+		{
+			config.recordThreads = parseUnsignedArgument(arg, nextValue());
+
+			if (config.recordThreads < 1 || config.recordThreads > maxRecordThreads)
+				throw std::runtime_error("--record-threads must be between 1 and " + std::to_string(maxRecordThreads));
+		}
+		else if (arg == "--draws")
+		{
+			config.drawCount = parseUnsignedArgument(arg, nextValue());
+
+			if (config.drawCount == 0)
+				throw std::runtime_error("--draws must be at least 1");
+		}
+		else if (arg == "--instances")
+			config.instanceCount = parseUnsignedArgument(arg, nextValue());
+		else if (arg == "--gpu-driven")
+			config.gpuDriven = true;
+		else if (arg == "--sphere")
+		{
+			config.sphereSegments = parseUnsignedArgument(arg, nextValue());
+
+			if (config.sphereSegments > 0 && config.sphereSegments < 3)
+				throw std::runtime_error("--sphere needs at least 3 segments");
+		}
+		else if (arg == "--mesh")
+			config.meshPath = nextValue();
+		else if (arg == "--vertex-format")
+		{
+			const std::string format{ nextValue() };
+
+			if (format == "float")
+				config.vertexFormat = MeshVertexFormat::Float;
+			else if (format == "quantized")
+				config.vertexFormat = MeshVertexFormat::Quantized;
+			else
+				throw std::runtime_error("--vertex-format must be float or quantized");
+		}
+		else if (arg == "--present-profile")
+			config.presentProfile = parsePresentProfile(nextValue());
+		else if (arg == "--fps-limit")
+			config.fpsLimit = parseUnsignedArgument(arg, nextValue());
+		else if (arg == "--trace")
+			config.tracePath = nextValue();
+		else if (arg == "--device")
+			config.deviceSelection = nextValue();
+		else if (arg == "--cull-benchmark")
+		{
+			config.cullBenchmarkBoxes = parseUnsignedArgument(arg, nextValue());
+
+			if (config.cullBenchmarkBoxes == 0)
+				throw std::runtime_error("--cull-benchmark needs at least 1 box");
+		}
+		else if (arg == "--bvh-benchmark")
+		{
+			config.bvhBenchmarkTriangles = parseUnsignedArgument(arg, nextValue());
+
+			if (config.bvhBenchmarkTriangles == 0)
+				throw std::runtime_error("--bvh-benchmark needs at least 1 triangle");
+		}
+		else if (arg == "--hierarchy-benchmark")
+		{
+			config.hierarchyBenchmarkNodes = parseUnsignedArgument(arg, nextValue());
+
+			if (config.hierarchyBenchmarkNodes == 0)
+				throw std::runtime_error("--hierarchy-benchmark needs at least 1 node");
+		}
+		else
+			throw std::runtime_error("Unknown argument: " + arg);
+	}
+
+	if (!config.readbackPath.empty() && !config.headless)
+		throw std::runtime_error("--readback requires --headless");
+
+	if (config.instanceCount > 0 && config.drawCount > 1)
+		throw std::runtime_error("--instances and --draws cannot be combined");
+
+	if (config.gpuDriven && config.instanceCount == 0)
+		throw std::runtime_error("--gpu-driven needs --instances");
+
+	if (config.headless && config.frameCount == 0)
+		config.frameCount = defaultHeadlessFrames;
+
+	return config;
+}
@@ -0,0 +1,628 @@
+#pragma once
+#include "CpuProfiler.h"
+#include "Frustum.h"
+#include "MeshData.h"
+#include "ThreadPool.h"
+
+#ifndef GLM_ENABLE_EXPERIMENTAL
+#define GLM_ENABLE_EXPERIMENTAL
+#endif
+#include <glm/glm.hpp>
+#include <glm/gtx/intersect.hpp>
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <future>
+#include <limits>
+#include <optional>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+
+// Candidate split planes per axis. More bins find slightly better splits at a linear cost per node.
+constexpr uint32_t bvhBinCount{ 16 };
+
+// Nodes with more primitives than this are always split, whatever the SAH says.
+constexpr uint32_t bvhMaxLeafSize{ 8 };
+
+// Nodes this deep become leaves, which also bounds the traversal stack.
+constexpr uint32_t bvhMaxDepth{ 64 };
+
+// Subtrees below this are built on one thread; splitting them costs more than it saves.
+constexpr uint32_t minBvhPrimitivesPerTask{ 16384 };
+
+constexpr uint32_t minRaysPerTask{ 1024 };
+
+// Positions along the ray are origin + t * direction for t in [0, maxDistance]. The direction need not be
+// normalized; distances are then in units of its length.
+struct Ray
+{
+	glm::vec3 origin{ 0.0f };
+	glm::vec3 direction{ 0.0f, 0.0f, 1.0f };
+	float maxDistance{ std::numeric_limits<float>::infinity() };
+};
+
+struct RayHit
+{
+	float distance{ 0.0f };
+	// Weights of the triangle's second and third vertices.
+	glm::vec2 barycentric{ 0.0f };
+	// Index of the triangle in its mesh's LOD 0.
+	uint32_t triangle{ 0 };
+	uint32_t instance{ 0 };
+};
+
+// 32 bytes. A leaf holds primitives [first, first + count) of the builder's order; an inner node has count 0 and its
+// children at first and first + 1. Node 1 is left unused, so every sibling pair starts at an even index and shares
+// a 64-byte cache line.
+struct alignas(32) BvhNode
+{
+	glm::vec3 min{ 0.0f };
+	uint32_t first{ 0 };
+	glm::vec3 max{ 0.0f };
+	uint32_t count{ 0 };
+};
+
+inline MeshBounds emptyBounds()
+{
+	return { .min{ glm::vec3{ std::numeric_limits<float>::max() } }, .max{ glm::vec3{ std::numeric_limits<float>::lowest() } } };
+}
+
+inline void growBounds(MeshBounds& bounds, const glm::vec3& point)
+{
+	bounds.min = glm::min(bounds.min, point);
+	bounds.max = glm::max(bounds.max, point);
+}
+
+inline void growBounds(MeshBounds& bounds, const MeshBounds& other)
+{
+	bounds.min = glm::min(bounds.min, other.min);
+	bounds.max = glm::max(bounds.max, other.max);
+}
+
+// Half the surface area, which is all the SAH needs since only ratios are compared.
+inline float surfaceArea(const MeshBounds& bounds)
+{
+	glm::vec3 extent{ glm::max(bounds.extent(), glm::vec3{ 0.0f }) };
+	return extent.x * extent.y + extent.y * extent.z + extent.z * extent.x;
+}
+
+// Slab test. Returns where the ray enters the node, or infinity when it misses it within maxDistance.
+// A direction component of 0 has an infinite inverse, and a ray that also starts on one of the box's planes on that
+// axis gets 0 * infinity = NaN there. Such a ray runs along the face, inside the closed slab, so the axis is skipped
+// rather than letting the NaN decide the comparisons.
+inline float intersectNode(const BvhNode& node, const glm::vec3& origin, const glm::vec3& inverseDirection, float maxDistance)
+{
+	float enter{ 0.0f };
+	float exit{ maxDistance };
+
+	for (glm::length_t axis{ 0 }; axis < 3; ++axis)
+	{
+		float t0{ (node.min[axis] - origin[axis]) * inverseDirection[axis] };
+		float t1{ (node.max[axis] - origin[axis]) * inverseDirection[axis] };
+		if (std::isnan(t0) || std::isnan(t1))
+			continue;
+
+		enter = std::max(enter, std::min(t0, t1));
+		exit = std::min(exit, std::max(t0, t1));
+	}
+
+	return enter <= exit ? enter : std::numeric_limits<float>::infinity();
+}
+
+// Binned SAH builder over primitive bounds: each node's primitives are sorted into bvhBinCount bins along every axis
+// by centroid, and the node is split at the bin boundary with the lowest area-weighted cost.
+// With a thread pool, the top of the tree is split on the calling thread until there are a few subtrees per core;
+// those are then built as independent tasks, each into its own node array, and appended to the tree.
+class BvhBuilder
+{
+public:
+	static void build(ThreadPool* threadPool, const std::vector<MeshBounds>& primitiveBounds, std::vector<BvhNode>& nodes, std::vector<uint32_t>& order)
+	{
+		PROFILE_FUNCTION();
+
+		uint32_t primitiveCount{ static_cast<uint32_t>(primitiveBounds.size()) };
+		if (primitiveCount == 0)
+			throw std::runtime_error("Cannot build a BVH without primitives!");
+
+		BvhBuilder builder{ primitiveBounds, order };
+
+		nodes.clear();
+		nodes.reserve(static_cast<size_t>(primitiveCount) * 2);
+		// The root and the unused slot that keeps sibling pairs aligned.
+		nodes.resize(2);
+
+		if (threadPool == nullptr || primitiveCount < 2 * minBvhPrimitivesPerTask)
+		{
+			builder.subdivide(nodes, 0, 0, primitiveCount, 0, 0, nullptr);
+			return;
+		}
+
+		uint32_t deferBelow{ std::max(minBvhPrimitivesPerTask, primitiveCount / (4 * (threadPool->threadCount() + 1))) };
+		std::vector<Subtree> subtrees{};
+		builder.subdivide(nodes, 0, 0, primitiveCount, 0, deferBelow, &subtrees);
+
+		// Largest first, so the caller takes the longest one and the tail is short.
+		std::sort(subtrees.begin(), subtrees.end(), [](const Subtree& a, const Subtree& b) { return a.count > b.count; });
+
+		auto buildSubtree = [&builder](const Subtree& subtree)
+		{
+			std::vector<BvhNode> subtreeNodes(2);
+			builder.subdivide(subtreeNodes, 0, subtree.first, subtree.count, subtree.depth, 0, nullptr);
+			return subtreeNodes;
+		};
+
+		std::vector<std::future<std::vector<BvhNode>>> tasks{};
+		for (size_t i{ 1 }; i < subtrees.size(); ++i)
+			tasks.push_back(threadPool->submit([&buildSubtree, &subtree = subtrees[i]] { return buildSubtree(subtree); }));
+
+		// The caller takes the first subtree instead of idling until the workers are done.
+		if (!subtrees.empty())
+			append(nodes, subtrees[0].node, buildSubtree(subtrees[0]));
+
+		for (size_t i{ 1 }; i < subtrees.size(); ++i)
+			append(nodes, subtrees[i].node, tasks[i - 1].get());
+	}
+
+private:
+	struct Subtree
+	{
+		uint32_t node{ 0 };
+		uint32_t first{ 0 };
+		uint32_t count{ 0 };
+		uint32_t depth{ 0 };
+	};
+
+	struct Bin
+	{
+		MeshBounds bounds{ emptyBounds() };
+		uint32_t count{ 0 };
+	};
+
+	struct Split
+	{
+		float cost{ std::numeric_limits<float>::infinity() };
+		uint32_t axis{ 0 };
+		uint32_t bin{ 0 };
+
+		// Only a split with primitives on both sides has a finite cost.
+		bool found() const { return cost != std::numeric_limits<float>::infinity(); }
+	};
+
+	const std::vector<MeshBounds>& bounds;
+	std::vector<uint32_t>& order;
+	std::vector<glm::vec3> centroids{};
+
+	BvhBuilder(const std::vector<MeshBounds>& primitiveBounds, std::vector<uint32_t>& primitiveOrder)
+		: bounds{ primitiveBounds }, order{ primitiveOrder }
+	{
+		order.resize(bounds.size());
+		centroids.resize(bounds.size());
+		for (uint32_t i{ 0 }; i < bounds.size(); ++i)
+		{
+			order[i] = i;
+			centroids[i] = bounds[i].center();
+		}
+	}
+
+	// Moves a subtree built with its root at 0 into the tree, with its root replacing the placeholder leaf.
+	static void append(std::vector<BvhNode>& nodes, uint32_t placeholder, const std::vector<BvhNode>& subtreeNodes)
+	{
+		uint32_t base{ static_cast<uint32_t>(nodes.size()) };
+		auto relocate = [base](const BvhNode& node)
+		{
+			BvhNode relocated{ node };
+			if (relocated.count == 0)
+				relocated.first = relocated.first - 2 + base;
+			return relocated;
+		};
+
+		nodes[placeholder] = relocate(subtreeNodes[0]);
+		for (size_t i{ 2 }; i < subtreeNodes.size(); ++i)
+			nodes.push_back(relocate(subtreeNodes[i]));
+	}
+
+	// Primitives [first, first + count) of the order; subtrees below deferBelow go to `deferred` instead.
+	// Concurrent calls must work on disjoint ranges and their own node arrays.
+	void subdivide(std::vector<BvhNode>& nodes, uint32_t nodeIndex, uint32_t first, uint32_t count, uint32_t depth,
+		uint32_t deferBelow, std::vector<Subtree>* deferred) const
+	{
+		MeshBounds nodeBounds{ emptyBounds() };
+		MeshBounds centroidBounds{ emptyBounds() };
+		for (uint32_t i{ first }; i < first + count; ++i)
+		{
+			growBounds(nodeBounds, bounds[order[i]]);
+			growBounds(centroidBounds, centroids[order[i]]);
+		}
+
+		// A leaf until it is split.
+		nodes[nodeIndex] = { .min{ nodeBounds.min }, .first{ first }, .max{ nodeBounds.max }, .count{ count } };
+
+		if (count == 1 || depth + 1 >= bvhMaxDepth)
+			return;
+
+		if (deferred != nullptr && count < deferBelow)
+		{
+			deferred->push_back({ .node{ nodeIndex }, .first{ first }, .count{ count }, .depth{ depth } });
+			return;
+		}
+
+		glm::vec3 binScale{ 0.0f };
+		for (glm::length_t axis{ 0 }; axis < 3; ++axis)
+		{
+			float extent{ centroidBounds.max[axis] - centroidBounds.min[axis] };
+			binScale[axis] = extent > 0.0f ? bvhBinCount / extent : 0.0f;
+		}
+
+		auto binIndex = [&](const glm::vec3& centroid, uint32_t axis)
+		{
+			glm::length_t component{ static_cast<glm::length_t>(axis) };
+			return std::min(bvhBinCount - 1, static_cast<uint32_t>((centroid[component] - centroidBounds.min[component]) * binScale[component]));
+		};
+
+		Split split{ findSplit(first, count, binScale, binIndex) };
+
+		uint32_t leftCount{ count / 2 };
+		if (split.found())
+		{
+			// Splitting costs one extra box test plus the children's primitives weighted by the odds of reaching them.
+			float splitCost{ 1.0f + split.cost / surfaceArea(nodeBounds) };
+			if (count <= bvhMaxLeafSize && splitCost >= static_cast<float>(count))
+				return;
+
+			auto middle{ std::partition(order.begin() + first, order.begin() + first + count,
+				[&](uint32_t primitive) { return binIndex(centroids[primitive], split.axis) <= split.bin; }) };
+			leftCount = static_cast<uint32_t>(middle - (order.begin() + first));
+		}
+		// Every centroid is in the same place, so no plane separates them; halve the range to keep leaves small.
+		else if (count <= bvhMaxLeafSize)
+			return;
+
+		uint32_t child{ static_cast<uint32_t>(nodes.size()) };
+		nodes.resize(nodes.size() + 2);
+		nodes[nodeIndex].first = child;
+		nodes[nodeIndex].count = 0;
+
+		subdivide(nodes, child, first, leftCount, depth + 1, deferBelow, deferred);
+		subdivide(nodes, child + 1, first + leftCount, count - leftCount, depth + 1, deferBelow, deferred);
+	}
+
+	template <typename BinIndex>
+	Split findSplit(uint32_t first, uint32_t count, const glm::vec3& binScale, BinIndex&& binIndex) const
+	{
+		std::array<std::array<Bin, bvhBinCount>, 3> bins{};
+		for (uint32_t i{ first }; i < first + count; ++i)
+		{
+			uint32_t primitive{ order[i] };
+			for (uint32_t axis{ 0 }; axis < 3; ++axis)
+			{
+				Bin& bin{ bins[axis][binIndex(centroids[primitive], axis)] };
+				growBounds(bin.bounds, bounds[primitive]);
+				++bin.count;
+			}
+		}
+
+		Split best{};
+		for (uint32_t axis{ 0 }; axis < 3; ++axis)
+		{
+			if (binScale[static_cast<glm::length_t>(axis)] == 0.0f)
+				continue;
+
+			// Sweep from the right, then from the left; a split after bin i puts bins 0 to i on the left.
+			std::array<float, bvhBinCount> rightCosts{};
+			MeshBounds rightBounds{ emptyBounds() };
+			uint32_t rightCount{ 0 };
+			for (uint32_t i{ bvhBinCount - 1 }; i > 0; --i)
+			{
+				growBounds(rightBounds, bins[axis][i].bounds);
+				rightCount += bins[axis][i].count;
+				rightCosts[i - 1] = rightCount > 0 ? surfaceArea(rightBounds) * rightCount : std::numeric_limits<float>::infinity();
+			}
+
+			MeshBounds leftBounds{ emptyBounds() };
+			uint32_t leftCount{ 0 };
+			for (uint32_t i{ 0 }; i + 1 < bvhBinCount; ++i)
+			{
+				growBounds(leftBounds, bins[axis][i].bounds);
+				leftCount += bins[axis][i].count;
+				if (leftCount == 0)
+					continue;
+
+				float cost{ surfaceArea(leftBounds) * leftCount + rightCosts[i] };
+				if (cost < best.cost)
+					best = { .cost{ cost }, .axis{ axis }, .bin{ i } };
+			}
+		}
+
+		return best;
+	}
+};
+
+// Walks the nodes front to back: the nearer child is visited first and the farther one is stacked with its entry
+// distance, so it is skipped once a closer hit has been found. testLeaf(first, count, maxDistance) tests a leaf's
+// primitives, shortens maxDistance to any closer hit and returns whether it found one. An any-hit walk returns on
+// the first hit.
+template <bool anyHit, typename LeafTest>
+inline bool traverseBvh(const std::vector<BvhNode>& nodes, const glm::vec3& origin, const glm::vec3& direction, float& maxDistance, LeafTest&& testLeaf)
+{
+	glm::vec3 inverseDirection{ 1.0f / direction };
+
+	if (intersectNode(nodes[0], origin, inverseDirection, maxDistance) == std::numeric_limits<float>::infinity())
+		return false;
+
+	std::array<std::pair<uint32_t, float>, bvhMaxDepth> stack{};
+	uint32_t stackSize{ 0 };
+	uint32_t nodeIndex{ 0 };
+	bool hit{ false };
+
+	for (;;)
+	{
+		const BvhNode& node{ nodes[nodeIndex] };
+
+		if (node.count > 0)
+		{
+			if (testLeaf(node.first, node.count, maxDistance))
+			{
+				hit = true;
+				if constexpr (anyHit)
+					return true;
+			}
+		}
+		else
+		{
+			uint32_t nearChild{ node.first };
+			uint32_t farChild{ node.first + 1 };
+			float nearDistance{ intersectNode(nodes[nearChild], origin, inverseDirection, maxDistance) };
+			float farDistance{ intersectNode(nodes[farChild], origin, inverseDirection, maxDistance) };
+
+			if (farDistance < nearDistance)
+			{
+				std::swap(nearChild, farChild);
+				std::swap(nearDistance, farDistance);
+			}
+
+			if (nearDistance != std::numeric_limits<float>::infinity())
+			{
+				if (farDistance != std::numeric_limits<float>::infinity())
+					stack[stackSize++] = { farChild, farDistance };
+
+				nodeIndex = nearChild;
+				continue;
+			}
+		}
+
+		// Pop the next node the ray can still reach before the closest hit so far.
+		do
+		{
+			if (stackSize == 0)
+				return hit;
+
+			--stackSize;
+		} while (stack[stackSize].second > maxDistance);
+
+		nodeIndex = stack[stackSize].first;
+	}
+}
+
+// BVH over one mesh's LOD 0 triangles, in mesh space. The triangles are copied into leaf order, so a leaf's vertices
+// are contiguous rather than scattered through the vertex buffer.
+class TriangleBvh
+{
+public:
+	// `threadPool` may be null to build on the calling thread.
+	void build(ThreadPool* threadPool, const MeshData& mesh)
+	{
+		PROFILE_FUNCTION();
+
+		const MeshLod& lod{ mesh.lods.at(0) };
+		uint32_t triangleCount{ lod.indexCount / 3 };
+
+		std::vector<MeshBounds> triangleBounds(triangleCount);
+		for (uint32_t i{ 0 }; i < triangleCount; ++i)
+		{
+			const uint32_t* corners{ &mesh.indices[lod.firstIndex + i * 3] };
+			MeshBounds bounds{ emptyBounds() };
+			for (uint32_t corner{ 0 }; corner < 3; ++corner)
+				growBounds(bounds, mesh.vertices[corners[corner]].position);
+			triangleBounds[i] = bounds;
+		}
+
+		BvhBuilder::build(threadPool, triangleBounds, nodes, triangleIds);
+
+		triangles.resize(triangleCount);
+		for (uint32_t i{ 0 }; i < triangleCount; ++i)
+		{
+			const uint32_t* corners{ &mesh.indices[lod.firstIndex + triangleIds[i] * 3] };
+			for (uint32_t corner{ 0 }; corner < 3; ++corner)
+				triangles[i][corner] = mesh.vertices[corners[corner]].position;
+		}
+	}
+
+	MeshBounds bounds() const { return { .min{ nodes[0].min }, .max{ nodes[0].max } }; }
+	uint32_t triangleCount() const { return static_cast<uint32_t>(triangles.size()); }
+	uint32_t nodeCount() const { return static_cast<uint32_t>(nodes.size()); }
+
+	// Shortens `hit.distance`, which must start at the ray's maximum, when the ray hits a closer triangle.
+	// Triangles count from both sides.
+	bool closestHit(const glm::vec3& origin, const glm::vec3& direction, RayHit& hit) const
+	{
+		return traverseBvh<false>(nodes, origin, direction, hit.distance, [&](uint32_t first, uint32_t count, float& maxDistance)
+		{
+			return testTriangles(origin, direction, first, count, maxDistance, &hit);
+		});
+	}
+
+	bool anyHit(const glm::vec3& origin, const glm::vec3& direction, float maxDistance) const
+	{
+		return traverseBvh<true>(nodes, origin, direction, maxDistance, [&](uint32_t first, uint32_t count, float& distance)
+		{
+			return testTriangles(origin, direction, first, count, distance, nullptr);
+		});
+	}
+
+private:
+	std::vector<BvhNode> nodes{};
+	std::vector<std::array<glm::vec3, 3>> triangles{};
+	// Original index of each triangle in leaf order.
+	std::vector<uint32_t> triangleIds{};
+
+	bool testTriangles(const glm::vec3& origin, const glm::vec3& direction, uint32_t first, uint32_t count, float& maxDistance, RayHit* hit) const
+	{
+		bool found{ false };
+
+		for (uint32_t i{ first }; i < first + count; ++i)
+		{
+			const auto& triangle{ triangles[i] };
+			glm::vec2 barycentric{};
+			float distance{};
+
+			if (!glm::intersectRayTriangle(origin, direction, triangle[0], triangle[1], triangle[2], barycentric, distance)
+				|| distance < 0.0f || distance >= maxDistance)
+				continue;
+
+			found = true;
+			maxDistance = distance;
+
+			if (hit == nullptr)
+				return true;
+
+			hit->barycentric = barycentric;
+			hit->triangle = triangleIds[i];
+		}
+
+		return found;
+	}
+};
+
+// A placed mesh. The mesh BVH must outlive the scene BVH.
+struct BvhInstance
+{
+	const TriangleBvh* mesh{ nullptr };
+	glm::mat4 transform{ 1.0f };
+};
+
+// Two levels: a BVH over the instances' world bounds whose leaves hand the ray, moved into mesh space, to the mesh
+// BVHs. Instances of one mesh share its triangle BVH, and moving an instance only rebuilds the small top level.
+// The ray direction is transformed without normalizing, so hit distances mean the same in both spaces.
+class SceneBvh
+{
+public:
+	void build(ThreadPool* threadPool, const std::vector<BvhInstance>& sceneInstances)
+	{
+		PROFILE_FUNCTION();
+
+		instances.clear();
+		instances.reserve(sceneInstances.size());
+
+		std::vector<MeshBounds> instanceBounds{};
+		instanceBounds.reserve(sceneInstances.size());
+
+		for (const auto& instance : sceneInstances)
+		{
+			BoundingBox box{ transformBounds(instance.mesh->bounds(), instance.transform) };
+			instanceBounds.push_back({ .min{ box.center - box.halfExtent }, .max{ box.center + box.halfExtent } });
+			instances.push_back({ .mesh{ instance.mesh }, .worldToMesh{ glm::inverse(instance.transform) } });
+		}
+
+		std::vector<uint32_t> order{};
+		BvhBuilder::build(threadPool, instanceBounds, nodes, order);
+
+		// Leaf order, like the triangles, with the caller's index kept for the hits.
+		std::vector<PlacedMesh> sorted(instances.size());
+		for (uint32_t i{ 0 }; i < order.size(); ++i)
+		{
+			sorted[i] = instances[order[i]];
+			sorted[i].instance = order[i];
+		}
+		instances = std::move(sorted);
+	}
+
+	uint32_t instanceCount() const { return static_cast<uint32_t>(instances.size()); }
+
+	std::optional<RayHit> closestHit(const Ray& ray) const
+	{
+		RayHit hit{ .distance{ ray.maxDistance } };
+
+		// The leaves shorten hit.distance themselves, which is also the walk's maximum distance.
+		bool found{ traverseBvh<false>(nodes, ray.origin, ray.direction, hit.distance, [&](uint32_t first, uint32_t count, float&)
+		{
+			bool foundInLeaf{ false };
+			for (uint32_t i{ first }; i < first + count; ++i)
+			{
+				const PlacedMesh& instance{ instances[i] };
+				if (instance.mesh->closestHit(glm::vec3{ instance.worldToMesh * glm::vec4{ ray.origin, 1.0f } },
+					glm::mat3{ instance.worldToMesh } * ray.direction, hit))
+				{
+					hit.instance = instance.instance;
+					foundInLeaf = true;
+				}
+			}
+			return foundInLeaf;
+		}) };
+
+		return found ? std::optional<RayHit>{ hit } : std::nullopt;
+	}
+
+	// Whether anything blocks the ray before its maximum distance: line of sight and shadow rays.
+	bool anyHit(const Ray& ray) const
+	{
+		float maxDistance{ ray.maxDistance };
+
+		return traverseBvh<true>(nodes, ray.origin, ray.direction, maxDistance, [&](uint32_t first, uint32_t count, float& distance)
+		{
+			for (uint32_t i{ first }; i < first + count; ++i)
+			{
+				const PlacedMesh& instance{ instances[i] };
+				if (instance.mesh->anyHit(glm::vec3{ instance.worldToMesh * glm::vec4{ ray.origin, 1.0f } },
+					glm::mat3{ instance.worldToMesh } * ray.direction, distance))
+					return true;
+			}
+			return false;
+		});
+	}
+
+	// Splits the rays over the thread pool and the caller; hits[i] answers rays[i].
+	void closestHits(ThreadPool& threadPool, const std::vector<Ray>& rays, std::vector<std::optional<RayHit>>& hits) const
+	{
+		PROFILE_FUNCTION();
+
+		uint32_t rayCount{ static_cast<uint32_t>(rays.size()) };
+		hits.resize(rayCount);
+
+		auto trace = [this, &rays, &hits](uint32_t begin, uint32_t end)
+		{
+			for (uint32_t i{ begin }; i < end; ++i)
+				hits[i] = closestHit(rays[i]);
+		};
+
+		uint32_t taskCount{ std::clamp(rayCount / minRaysPerTask, 1u, threadPool.threadCount() + 1) };
+		uint32_t perTask{ (rayCount + taskCount - 1) / taskCount };
+
+		// The caller takes the first range instead of idling until the workers are done.
+		std::vector<std::future<void>> tasks{};
+		for (uint32_t begin{ perTask }; begin < rayCount; begin += perTask)
+		{
+			uint32_t end{ std::min(begin + perTask, rayCount) };
+			tasks.push_back(threadPool.submit([&trace, begin, end] { trace(begin, end); }));
+		}
+
+		trace(0, std::min(perTask, rayCount));
+
+		for (auto& task : tasks)
+			task.get();
+	}
+
+private:
+	struct PlacedMesh
+	{
+		const TriangleBvh* mesh{ nullptr };
+		glm::mat4 worldToMesh{ 1.0f };
+		uint32_t instance{ 0 };
+	};
+
+	std::vector<BvhNode> nodes{};
+	std::vector<PlacedMesh> instances{};
+};
@@ -0,0 +1,158 @@
+#pragma once
+#include "Bvh.h"
+#include "MeshData.h"
+#include "ThreadPool.h"
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <iomanip>
+#include <iostream>
+#include <optional>
+#include <random>
+#include <stdexcept>
+#include <vector>
+
+
+constexpr uint32_t bvhBenchmarkGrid{ 4 };
+constexpr uint32_t bvhBenchmarkRays{ 100000 };
+
+// Rays of each kind also traced against every triangle of every instance; the cost grows with the triangle count.
+constexpr uint32_t bvhBenchmarkCheckedRays{ 64 };
+
+// --bvh-benchmark N: builds a BVH over a sphere of about N triangles, single-threaded and on every core, then places
+// a grid of rotated and scaled copies of it and times picking rays (closest hit) and line-of-sight rays (any hit)
+// one query at a time, and the picking rays again as one batch over the thread pool. A spread of the rays is checked
+// against a brute-force test of every triangle, which must find the same closest distance and the same blocked rays.
+inline void runBvhBenchmark(uint32_t triangleCount)
+{
+	auto millisecondsSince = [](std::chrono::steady_clock::time_point start)
+	{
+		return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	};
+
+	ThreadPool threadPool{};
+	threadPool.create(ThreadPool::defaultThreadCount());
+
+	MeshData mesh{ makeSphere(std::max(3u, static_cast<uint32_t>(std::sqrt(static_cast<double>(triangleCount))))) };
+
+	TriangleBvh serialBvh{};
+	auto start{ std::chrono::steady_clock::now() };
+	serialBvh.build(nullptr, mesh);
+	double serialBuildMs{ millisecondsSince(start) };
+
+	TriangleBvh meshBvh{};
+	start = std::chrono::steady_clock::now();
+	meshBvh.build(&threadPool, mesh);
+	double parallelBuildMs{ millisecondsSince(start) };
+
+	std::vector<BvhInstance> instances{};
+	for (uint32_t i{ 0 }; i < bvhBenchmarkGrid * bvhBenchmarkGrid; ++i)
+	{
+		glm::vec3 cellCenter{ -1.5f + (i % bvhBenchmarkGrid), -1.5f + (i / bvhBenchmarkGrid), 0.25f * (i % 3) };
+		glm::mat4 transform{ glm::rotate(glm::translate(glm::mat4{ 1.0f }, cellCenter), 0.4f * i, glm::vec3{ 0.3f, 1.0f, 0.2f }) };
+		instances.push_back({ .mesh{ &meshBvh }, .transform{ glm::scale(transform, glm::vec3{ 0.8f + 0.05f * (i % 5) }) } });
+	}
+
+	SceneBvh scene{};
+	start = std::chrono::steady_clock::now();
+	scene.build(&threadPool, instances);
+	double sceneBuildMs{ millisecondsSince(start) };
+
+	// Picking rays fan out from a camera in front of the grid; line-of-sight rays join two random points in it.
+	std::mt19937 random{ 1 };
+	std::uniform_real_distribution<float> spread{ -2.2f, 2.2f };
+	std::uniform_real_distribution<float> depth{ -0.5f, 1.0f };
+
+	std::vector<Ray> pickRays(bvhBenchmarkRays);
+	std::vector<Ray> sightRays(bvhBenchmarkRays);
+	for (uint32_t i{ 0 }; i < bvhBenchmarkRays; ++i)
+	{
+		glm::vec3 camera{ 0.0f, 0.0f, -4.0f };
+		pickRays[i] = { .origin{ camera }, .direction{ glm::normalize(glm::vec3{ spread(random), spread(random), 0.5f } - camera) } };
+
+		glm::vec3 from{ spread(random), spread(random), depth(random) };
+		glm::vec3 to{ spread(random), spread(random), depth(random) };
+		sightRays[i] = { .origin{ from }, .direction{ to - from }, .maxDistance{ 1.0f } };
+	}
+
+	uint32_t pickHits{ 0 };
+	start = std::chrono::steady_clock::now();
+	for (const auto& ray : pickRays)
+		pickHits += scene.closestHit(ray).has_value() ? 1u : 0u;
+	double pickMs{ millisecondsSince(start) };
+
+	uint32_t blocked{ 0 };
+	start = std::chrono::steady_clock::now();
+	for (const auto& ray : sightRays)
+		blocked += scene.anyHit(ray) ? 1u : 0u;
+	double sightMs{ millisecondsSince(start) };
+
+	std::vector<std::optional<RayHit>> hits{};
+	start = std::chrono::steady_clock::now();
+	scene.closestHits(threadPool, pickRays, hits);
+	double batchMs{ millisecondsSince(start) };
+
+	// The same ray transform and triangle test as the BVH, so a correct walk agrees exactly.
+	const MeshLod& lod{ mesh.lods.at(0) };
+	auto bruteForce = [&](const Ray& ray, bool stopAtFirst)
+	{
+		std::optional<float> closest{};
+		float maxDistance{ ray.maxDistance };
+		for (const auto& instance : instances)
+		{
+			glm::mat4 worldToMesh{ glm::inverse(instance.transform) };
+			glm::vec3 origin{ worldToMesh * glm::vec4{ ray.origin, 1.0f } };
+			glm::vec3 direction{ glm::mat3{ worldToMesh } * ray.direction };
+
+			for (uint32_t i{ 0 }; i < lod.indexCount; i += 3)
+			{
+				const uint32_t* corners{ &mesh.indices[lod.firstIndex + i] };
+				glm::vec2 barycentric{};
+				float distance{};
+				if (!glm::intersectRayTriangle(origin, direction, mesh.vertices[corners[0]].position, mesh.vertices[corners[1]].position,
+					mesh.vertices[corners[2]].position, barycentric, distance) || distance < 0.0f || distance >= maxDistance)
+					continue;
+
+				closest = distance;
+				maxDistance = distance;
+				if (stopAtFirst)
+					return closest;
+			}
+		}
+		return closest;
+	};
+
+	for (uint32_t check{ 0 }; check < bvhBenchmarkCheckedRays; ++check)
+	{
+		uint32_t i{ check * (bvhBenchmarkRays / bvhBenchmarkCheckedRays) };
+
+		std::optional<float> expected{ bruteForce(pickRays[i], false) };
+		std::optional<RayHit> hit{ scene.closestHit(pickRays[i]) };
+		if (hit.has_value() != expected.has_value() || (hit && hit->distance != *expected))
+			throw std::runtime_error("The BVH closest hit disagrees with the brute-force test!");
+		if (hits[i].has_value() != expected.has_value() || (hits[i] && hits[i]->distance != *expected))
+			throw std::runtime_error("The BVH closest hit batch disagrees with the brute-force test!");
+
+		if (scene.anyHit(sightRays[i]) != bruteForce(sightRays[i], true).has_value())
+			throw std::runtime_error("The BVH any hit disagrees with the brute-force test!");
+	}
+
+	uint64_t sceneTriangles{ static_cast<uint64_t>(meshBvh.triangleCount()) * scene.instanceCount() };
+
+	std::cout << "BVH: " << meshBvh.triangleCount() << " triangles, " << meshBvh.nodeCount() << " nodes, " << scene.instanceCount()
+		<< " instances (" << sceneTriangles << " triangles in the scene)\n" << std::fixed << std::setprecision(3)
+		<< "  build: " << serialBuildMs << " ms on 1 thread, " << parallelBuildMs << " ms on " << threadPool.threadCount() + 1
+		<< " threads, top level " << sceneBuildMs << " ms\n"
+		<< "  closest hit: " << pickMs * 1e3 / bvhBenchmarkRays << " us per ray, " << pickHits << " of " << bvhBenchmarkRays << " hit\n"
+		<< "  any hit: " << sightMs * 1e3 / bvhBenchmarkRays << " us per ray, " << blocked << " of " << bvhBenchmarkRays << " blocked\n"
+		<< "  closest hit batch: " << batchMs << " ms, " << bvhBenchmarkRays / batchMs / 1e3 << " M rays/s"
+		<< std::defaultfloat << '\n'
+		<< "  " << bvhBenchmarkCheckedRays << " rays of each kind match a brute-force test\n\n";
+
+	threadPool.destroy();
+}
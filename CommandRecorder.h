@@ -0,0 +1,147 @@
+#pragma once
+#include <vulkan/vulkan.h>
+
+#include "CpuProfiler.h"
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <future>
+#include <stdexcept>
+#include <vector>
+
+
+// Records one range of draws [begin, end) into a secondary command buffer that continues the current render pass.
+using RecordRangeFunction = std::function<void(VkCommandBuffer commandBuffer, uint32_t begin, uint32_t end)>;
+
+// Splits the draws of a render pass into contiguous ranges that are recorded into secondary command buffers
+// on the thread pool. Every recording context owns one command pool per frame slot, so the pools never need
+// locking and a whole slot is recycled with a single vkResetCommandPool once it has been waited on.
+class CommandRecorder
+{
+public:
+	void create(VkDevice dev, uint32_t queueFamily, uint32_t contextCount, uint32_t framesInFlight, ThreadPool& threadPool)
+	{
+		device = dev;
+		pool = &threadPool;
+
+		contexts.resize(static_cast<size_t>(framesInFlight) * contextCount);
+		contextsPerFrame = contextCount;
+
+		VkCommandPoolCreateInfo poolInfo{
+			.sType{ VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO },
+			.flags{ VK_COMMAND_POOL_CREATE_TRANSIENT_BIT },
+			.queueFamilyIndex{ queueFamily }
+		};
+
+		for (auto& context : contexts)
+		{
+			if (vkCreateCommandPool(device, &poolInfo, nullptr, &context.commandPool) != VK_SUCCESS)
+				throw std::runtime_error("Failed to create a recording command pool!");
+
+			VkCommandBufferAllocateInfo allocInfo{
+				.sType{ VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO },
+				.commandPool{ context.commandPool },
+				.level{ VK_COMMAND_BUFFER_LEVEL_SECONDARY },
+				.commandBufferCount{ 1 }
+			};
+
+			if (vkAllocateCommandBuffers(device, &allocInfo, &context.commandBuffer) != VK_SUCCESS)
+				throw std::runtime_error("Failed to allocate a secondary command buffer!");
+		}
+	}
+
+	void destroy()
+	{
+		for (const auto& context : contexts)
+			vkDestroyCommandPool(device, context.commandPool, nullptr);
+	}
+
+	uint32_t contextCount() const { return contextsPerFrame; }
+
+	// Records `drawCount` draws into `primary`, which must be inside a render pass begun with
+	// VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS. The secondaries are executed in range order, so the
+	// result does not depend on which thread finished first.
+	void record(VkCommandBuffer primary, uint32_t frameSlot, const VkCommandBufferInheritanceInfo& inheritance,
+		uint32_t drawCount, const RecordRangeFunction& recordRange)
+	{
+		PROFILE_FUNCTION();
+
+		// Too few draws per range and the hand-off to the workers costs more than it saves.
+		uint32_t rangeCount{ std::clamp((drawCount + minDrawsPerRange - 1) / minDrawsPerRange, 1u, contextsPerFrame) };
+		uint32_t rangeSize{ (drawCount + rangeCount - 1) / rangeCount };
+
+		RecordingContext* slotContexts{ &contexts[static_cast<size_t>(frameSlot) * contextsPerFrame] };
+
+		std::vector<std::future<void>> pending{};
+		pending.reserve(rangeCount);
+
+		// The calling thread records the first range itself instead of idling on the futures.
+		for (uint32_t range{ 1 }; range < rangeCount; ++range)
+		{
+			pending.push_back(pool->submit([&, range]
+				{
+					recordSecondary(slotContexts[range], inheritance, range * rangeSize,
+						std::min(drawCount, (range + 1) * rangeSize), recordRange);
+				}));
+		}
+
+		try
+		{
+			recordSecondary(slotContexts[0], inheritance, 0, std::min(drawCount, rangeSize), recordRange);
+		}
+		catch (...)
+		{
+			// The queued tasks reference this stack frame.
+			for (auto& future : pending)
+				future.wait();
+			throw;
+		}
+
+		for (auto& future : pending)
+			future.get();
+
+		std::vector<VkCommandBuffer> secondaries(rangeCount);
+		for (uint32_t range{ 0 }; range < rangeCount; ++range)
+			secondaries[range] = slotContexts[range].commandBuffer;
+
+		vkCmdExecuteCommands(primary, rangeCount, secondaries.data());
+	}
+
+private:
+	struct RecordingContext
+	{
+		VkCommandPool commandPool{};
+		VkCommandBuffer commandBuffer{};
+	};
+
+	static constexpr uint32_t minDrawsPerRange{ 256 };
+
+	VkDevice device{};
+	ThreadPool* pool{ nullptr };
+	std::vector<RecordingContext> contexts{};
+	uint32_t contextsPerFrame{ 0 };
+
+	void recordSecondary(RecordingContext& context, const VkCommandBufferInheritanceInfo& inheritance,
+		uint32_t begin, uint32_t end, const RecordRangeFunction& recordRange)
+	{
+		PROFILE_FUNCTION();
+
+		vkResetCommandPool(device, context.commandPool, 0);
+
+		VkCommandBufferBeginInfo beginInfo{
+			.sType{ VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO },
+			.flags{ VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT | VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT },
+			.pInheritanceInfo{ &inheritance }
+		};
+
+		if (vkBeginCommandBuffer(context.commandBuffer, &beginInfo) != VK_SUCCESS)
+			throw std::runtime_error("Failed to begin recording a secondary command buffer!");
+
+		recordRange(context.commandBuffer, begin, end);
+
+		if (vkEndCommandBuffer(context.commandBuffer) != VK_SUCCESS)
+			throw std::runtime_error("Failed to record a secondary command buffer!");
+	}
+};
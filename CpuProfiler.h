@@ -0,0 +1,226 @@
+#pragma once
+#include "TraceExporter.h"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+
+struct CpuZoneEvent
+{
+	const char* name{};
+	std::chrono::steady_clock::rep start{};
+	std::chrono::steady_clock::rep end{};
+};
+
+// Single-producer single-consumer ring owned by one thread. The owning thread pushes, the collector drains;
+// neither ever blocks the other. When the collector falls behind, new events are dropped and counted.
+class CpuThreadBuffer
+{
+public:
+	explicit CpuThreadBuffer(std::string threadName)
+		: name{ std::move(threadName) }
+	{
+	}
+
+	void push(const CpuZoneEvent& event) noexcept
+	{
+		uint64_t writeIndex{ head.load(std::memory_order_relaxed) };
+
+		if (writeIndex - tail.load(std::memory_order_acquire) >= capacity)
+		{
+			dropped.fetch_add(1, std::memory_order_relaxed);
+			return;
+		}
+
+		events[writeIndex & (capacity - 1)] = event;
+		head.store(writeIndex + 1, std::memory_order_release);
+	}
+
+	template <typename F>
+	void drain(F&& consume)
+	{
+		uint64_t readIndex{ tail.load(std::memory_order_relaxed) };
+		uint64_t writeIndex{ head.load(std::memory_order_acquire) };
+
+		for (; readIndex != writeIndex; ++readIndex)
+			consume(events[readIndex & (capacity - 1)]);
+
+		tail.store(readIndex, std::memory_order_release);
+	}
+
+	uint64_t droppedEvents() const { return dropped.load(std::memory_order_relaxed); }
+
+	// Only touched under the profiler's registry lock.
+	std::string name{};
+	uint32_t traceTrack{ noTrack };
+
+	static constexpr uint32_t noTrack{ ~0u };
+
+private:
+	// Must be a power of two. Enough for a few frames of heavy instrumentation and all of startup.
+	static constexpr uint64_t capacity{ 16 * 1024 };
+
+	std::array<CpuZoneEvent, capacity> events{};
+	// Separate cache lines so the producer and the collector do not false-share.
+	alignas(64) std::atomic<uint64_t> head{ 0 };
+	alignas(64) std::atomic<uint64_t> tail{ 0 };
+	std::atomic<uint64_t> dropped{ 0 };
+};
+
+// Process-wide registry of the per-thread buffers. Threads register lazily on their first zone; the buffers are
+// owned here and outlive their threads so nothing recorded by a finished worker is lost.
+class CpuProfiler
+{
+public:
+	static CpuThreadBuffer& threadBuffer()
+	{
+		thread_local CpuThreadBuffer* buffer{ registerThread() };
+		return *buffer;
+	}
+
+	// Names the calling thread's track in traces and summaries.
+	static void setThreadName(const std::string& name)
+	{
+		CpuThreadBuffer& buffer{ threadBuffer() };
+
+		std::lock_guard lock{ registry().mutex };
+		buffer.name = name;
+	}
+
+	// Drains every thread's buffer into `trace` and the running totals. Called once per frame by the main thread.
+	static void collect(TraceExporter& trace)
+	{
+		Registry& r{ registry() };
+		std::lock_guard lock{ r.mutex };
+
+		for (auto& buffer : r.buffers)
+		{
+			if (trace.enabled() && buffer->traceTrack == CpuThreadBuffer::noTrack)
+				buffer->traceTrack = trace.registerTrack(buffer->name);
+
+			buffer->drain([&](const CpuZoneEvent& event)
+				{
+					trace.add(buffer->traceTrack, event.name, toTimePoint(event.start), toTimePoint(event.end));
+
+					ZoneTotals& totals{ r.totals[event.name] };
+					std::chrono::steady_clock::rep duration{ event.end - event.start };
+					++totals.count;
+					totals.total += duration;
+					totals.max = std::max(totals.max, duration);
+				});
+		}
+	}
+
+	// Zones sorted by total time, the most expensive first.
+	static void printSummary(size_t maxZones = 20)
+	{
+		Registry& r{ registry() };
+		std::lock_guard lock{ r.mutex };
+
+		std::vector<std::pair<const char*, ZoneTotals>> zones(r.totals.begin(), r.totals.end());
+		std::sort(zones.begin(), zones.end(), [](const auto& a, const auto& b) { return a.second.total > b.second.total; });
+
+		std::cout << "CPU zones (" << r.buffers.size() << " threads):\n" << std::fixed << std::setprecision(3);
+		for (size_t i{ 0 }; i < std::min(maxZones, zones.size()); ++i)
+		{
+			const auto& [name, totals] = zones[i];
+			std::cout << '\t' << name << ": " << totals.count << " calls, total " << toMilliseconds(totals.total)
+				<< " ms, avg " << toMilliseconds(totals.total) / totals.count << " ms, max " << toMilliseconds(totals.max) << " ms\n";
+		}
+
+		uint64_t dropped{ 0 };
+		for (const auto& buffer : r.buffers)
+			dropped += buffer->droppedEvents();
+
+		if (dropped > 0)
+			std::cout << '\t' << dropped << " events dropped because a thread buffer was full\n";
+
+		std::cout << std::defaultfloat << '\n';
+	}
+
+private:
+	struct ZoneTotals
+	{
+		uint64_t count{ 0 };
+		std::chrono::steady_clock::rep total{ 0 };
+		std::chrono::steady_clock::rep max{ 0 };
+	};
+
+	struct Registry
+	{
+		std::mutex mutex{};
+		std::vector<std::unique_ptr<CpuThreadBuffer>> buffers{};
+		// Keyed by the literal's address, which is what the zone macros pass.
+		std::unordered_map<const char*, ZoneTotals> totals{};
+	};
+
+	static Registry& registry()
+	{
+		static Registry instance{};
+		return instance;
+	}
+
+	static CpuThreadBuffer* registerThread()
+	{
+		Registry& r{ registry() };
+		std::lock_guard lock{ r.mutex };
+
+		r.buffers.push_back(std::make_unique<CpuThreadBuffer>("Thread " + std::to_string(r.buffers.size())));
+		return r.buffers.back().get();
+	}
+
+	static std::chrono::steady_clock::time_point toTimePoint(std::chrono::steady_clock::rep ticks)
+	{
+		return std::chrono::steady_clock::time_point{ std::chrono::steady_clock::duration{ ticks } };
+	}
+
+	static double toMilliseconds(std::chrono::steady_clock::rep ticks)
+	{
+		return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::duration{ ticks }).count();
+	}
+};
+
+// Times its own lifetime. Costs two clock reads and one ring write, so it can stay on in release builds.
+class CpuZone
+{
+public:
+	explicit CpuZone(const char* zoneName) noexcept
+		: name{ zoneName }, start{ std::chrono::steady_clock::now().time_since_epoch().count() }
+	{
+	}
+
+	CpuZone(const CpuZone&) = delete;
+	CpuZone& operator=(const CpuZone&) = delete;
+
+	~CpuZone()
+	{
+		CpuProfiler::threadBuffer().push({ name, start, std::chrono::steady_clock::now().time_since_epoch().count() });
+	}
+
+private:
+	const char* name;
+	std::chrono::steady_clock::rep start;
+};
+
+#define PROFILE_CONCAT_INNER(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_INNER(a, b)
+
+// Define HELLO_VULKAN_DISABLE_PROFILER to compile every zone out.
+#ifdef HELLO_VULKAN_DISABLE_PROFILER
+#define PROFILE_ZONE(name)
+#define PROFILE_FUNCTION()
+#else
+// `name` must be a string literal.
+#define PROFILE_ZONE(name) CpuZone PROFILE_CONCAT(cpuZone, __LINE__){ name }
+#define PROFILE_FUNCTION() PROFILE_ZONE(__func__)
+#endif
@@ -0,0 +1,112 @@
+#pragma once
+#include "Frustum.h"
+#include "FrustumCuller.h"
+#include "ThreadPool.h"
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+
+constexpr uint32_t cullBenchmarkIterations{ 20 };
+
+// Small counts finish below the clock's resolution, so an iteration repeats the cull until this much time has passed.
+constexpr double cullBenchmarkMinIterationMs{ 1.0 };
+
+// --cull-benchmark N: culls N random boxes spread over four times the view, so about a quarter are visible, with the
+// scalar test, the SIMD kernel on one thread and the SIMD kernel on every core. All three must return the same
+// indices; each prints its best and average time per cull over the iterations.
+inline void runCullingBenchmark(uint32_t boxCount)
+{
+	std::mt19937 random{ 1 };
+	std::uniform_real_distribution<float> position{ -2.0f, 2.0f };
+	std::uniform_real_distribution<float> depth{ 0.2f, 0.8f };
+	std::uniform_real_distribution<float> size{ 0.001f, 0.01f };
+
+	BoundingBoxes boxes{};
+	boxes.reserve(boxCount);
+	for (uint32_t i{ 0 }; i < boxCount; ++i)
+		boxes.push_back({ .center{ position(random), position(random), depth(random) }, .halfExtent{ size(random), size(random), size(random) } });
+
+	// Off-center, so the frustum cuts through the grid at an edge in both directions.
+	Frustum frustum{ extractFrustum(glm::translate(glm::mat4{ 1.0f }, glm::vec3{ 0.3f, -0.2f, 0.0f })) };
+
+	ThreadPool threadPool{};
+	threadPool.create(ThreadPool::defaultThreadCount());
+
+	std::vector<uint32_t> reference{};
+	bool haveReference{ false };
+
+	auto measure = [&](const char* name, auto&& cull)
+	{
+		std::vector<uint32_t> visible{};
+		double bestMs{ 0.0 };
+		double totalMs{ 0.0 };
+
+		for (uint32_t iteration{ 0 }; iteration < cullBenchmarkIterations; ++iteration)
+		{
+			auto start{ std::chrono::steady_clock::now() };
+			double elapsedMs{ 0.0 };
+			uint32_t repetitions{ 0 };
+			do
+			{
+				cull(visible);
+				++repetitions;
+				elapsedMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+			} while (elapsedMs < cullBenchmarkMinIterationMs);
+
+			double milliseconds{ elapsedMs / repetitions };
+
+			bestMs = iteration == 0 ? milliseconds : std::min(bestMs, milliseconds);
+			totalMs += milliseconds;
+		}
+
+		if (!haveReference)
+		{
+			reference = visible;
+			haveReference = true;
+		}
+		else if (visible != reference)
+			throw std::runtime_error(std::string{ name } + " culling disagrees with the scalar test!");
+
+		std::cout << "  " << std::left << std::setw(24) << name << std::right << std::fixed << std::setprecision(3)
+			<< bestMs << " ms best, " << totalMs / cullBenchmarkIterations << " ms average, "
+			<< boxCount / bestMs / 1e3 << " M boxes/s" << std::defaultfloat << '\n';
+	};
+
+	std::cout << "Frustum culling " << boxCount << " boxes, " << cullBenchmarkIterations << " iterations each, SIMD path "
+		<< cullSimdPath() << ":\n";
+
+	measure("scalar", [&](std::vector<uint32_t>& visible)
+	{
+		visible.clear();
+		for (uint32_t i{ 0 }; i < boxCount; ++i)
+			if (intersects(frustum, boxes[i]))
+				visible.push_back(i);
+	});
+
+	measure("SIMD, 1 thread", [&](std::vector<uint32_t>& visible)
+	{
+		visible.resize(boxCount);
+		visible.resize(cullBoxes(frustum, boxes, 0, boxCount, visible.data()));
+	});
+
+	const std::string parallelName{ "SIMD, " + std::to_string(threadPool.threadCount() + 1) + " threads" };
+	measure(parallelName.c_str(), [&](std::vector<uint32_t>& visible)
+	{
+		cullBoxesParallel(threadPool, frustum, boxes, visible);
+	});
+
+	std::cout << "  " << reference.size() << " visible\n\n";
+
+	threadPool.destroy();
+}
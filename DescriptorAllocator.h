@@ -0,0 +1,339 @@
+#pragma once
+#include <vulkan/vulkan.h>
+
+#include "Hash.h"
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <iostream>
+#include <mutex>
+#include <stdexcept>
+#include <unordered_map>
+#include <vector>
+
+
+// One descriptor's worth of update data. Sets are written from an array of these, one per descriptor in binding
+// order, which is the layout every DescriptorLayout's update template expects.
+union DescriptorData
+{
+	VkDescriptorBufferInfo buffer;
+	VkDescriptorImageInfo image;
+	VkBufferView texelBuffer;
+};
+
+struct DescriptorLayout
+{
+	VkDescriptorSetLayout layout{};
+	VkDescriptorUpdateTemplate updateTemplate{};
+	// Number of DescriptorData entries a write to a set of this layout takes.
+	uint32_t descriptorCount{ 0 };
+};
+
+// Creates each distinct set layout once, together with the update template that writes it. Pipelines and materials
+// asking for the same bindings get the same VkDescriptorSetLayout, which also keeps their sets compatible.
+class DescriptorLayoutCache
+{
+public:
+	void create(VkDevice dev)
+	{
+		device = dev;
+	}
+
+	void destroy()
+	{
+		for (auto& [hash, cached] : layouts)
+		{
+			vkDestroyDescriptorUpdateTemplate(device, cached.layout.updateTemplate, nullptr);
+			vkDestroyDescriptorSetLayout(device, cached.layout.layout, nullptr);
+		}
+
+		layouts.clear();
+	}
+
+	// Thread-safe; pipelines are built on the workers. The returned reference stays valid until destroy().
+	const DescriptorLayout& get(std::vector<VkDescriptorSetLayoutBinding> bindings)
+	{
+		// Equal binding lists in a different order must map to the same layout.
+		std::sort(bindings.begin(), bindings.end(), [](const auto& a, const auto& b) { return a.binding < b.binding; });
+
+		uint64_t hash{ hashBindings(bindings) };
+
+		std::lock_guard lock{ mutex };
+
+		if (auto it{ layouts.find(hash) }; it != layouts.end())
+		{
+			if (!sameBindings(it->second.bindings, bindings))
+				throw std::runtime_error("Descriptor set layout hash collision!");
+
+			return it->second.layout;
+		}
+
+		CachedLayout cached{ .bindings{ bindings } };
+		cached.layout = createLayout(bindings);
+
+		return layouts.emplace(hash, std::move(cached)).first->second.layout;
+	}
+
+	size_t size()
+	{
+		std::lock_guard lock{ mutex };
+		return layouts.size();
+	}
+
+private:
+	struct CachedLayout
+	{
+		std::vector<VkDescriptorSetLayoutBinding> bindings{};
+		DescriptorLayout layout{};
+	};
+
+	VkDevice device{};
+	std::unordered_map<uint64_t, CachedLayout> layouts{};
+	std::mutex mutex{};
+
+	// Hashes the fields that define the layout; the binding struct itself has padding and a pointer.
+	static uint64_t hashBindings(const std::vector<VkDescriptorSetLayoutBinding>& bindings)
+	{
+		uint64_t hash{ fnvOffsetBasis };
+
+		for (const auto& binding : bindings)
+		{
+			const uint32_t fields[]{ binding.binding, static_cast<uint32_t>(binding.descriptorType), binding.descriptorCount,
+				binding.stageFlags };
+			hash = hashBytes(fields, sizeof(fields), hash);
+
+			if (binding.pImmutableSamplers != nullptr)
+				hash = hashBytes(binding.pImmutableSamplers, binding.descriptorCount * sizeof(VkSampler), hash);
+		}
+
+		return hash;
+	}
+
+	static bool sameBindings(const std::vector<VkDescriptorSetLayoutBinding>& a, const std::vector<VkDescriptorSetLayoutBinding>& b)
+	{
+		return std::equal(a.begin(), a.end(), b.begin(), b.end(), [](const auto& x, const auto& y)
+			{
+				return x.binding == y.binding && x.descriptorType == y.descriptorType && x.descriptorCount == y.descriptorCount
+					&& x.stageFlags == y.stageFlags
+					&& (x.pImmutableSamplers == nullptr) == (y.pImmutableSamplers == nullptr)
+					&& (x.pImmutableSamplers == nullptr
+						|| std::equal(x.pImmutableSamplers, x.pImmutableSamplers + x.descriptorCount, y.pImmutableSamplers));
+			});
+	}
+
+	DescriptorLayout createLayout(const std::vector<VkDescriptorSetLayoutBinding>& bindings)
+	{
+		DescriptorLayout result{};
+
+		VkDescriptorSetLayoutCreateInfo layoutInfo{
+			.sType{ VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO },
+			.bindingCount{ static_cast<uint32_t>(bindings.size()) },
+			.pBindings{ bindings.data() }
+		};
+
+		if (vkCreateDescriptorSetLayout(device, &layoutInfo, nullptr, &result.layout) != VK_SUCCESS)
+			throw std::runtime_error("Failed to create a descriptor set layout!");
+
+		std::vector<VkDescriptorUpdateTemplateEntry> entries{};
+		for (const auto& binding : bindings)
+		{
+			// Immutable samplers are baked into the layout and are not written.
+			if (binding.descriptorCount == 0 || (binding.descriptorType == VK_DESCRIPTOR_TYPE_SAMPLER && binding.pImmutableSamplers != nullptr))
+				continue;
+
+			entries.push_back({
+				.dstBinding{ binding.binding },
+				.dstArrayElement{ 0 },
+				.descriptorCount{ binding.descriptorCount },
+				.descriptorType{ binding.descriptorType },
+				.offset{ result.descriptorCount * sizeof(DescriptorData) },
+				.stride{ sizeof(DescriptorData) }
+			});
+
+			result.descriptorCount += binding.descriptorCount;
+		}
+
+		// A template needs at least one entry; a layout with nothing to write gets none.
+		if (entries.empty())
+			return result;
+
+		VkDescriptorUpdateTemplateCreateInfo templateInfo{
+			.sType{ VK_STRUCTURE_TYPE_DESCRIPTOR_UPDATE_TEMPLATE_CREATE_INFO },
+			.descriptorUpdateEntryCount{ static_cast<uint32_t>(entries.size()) },
+			.pDescriptorUpdateEntries{ entries.data() },
+			.templateType{ VK_DESCRIPTOR_UPDATE_TEMPLATE_TYPE_DESCRIPTOR_SET },
+			.descriptorSetLayout{ result.layout }
+		};
+
+		if (vkCreateDescriptorUpdateTemplate(device, &templateInfo, nullptr, &result.updateTemplate) != VK_SUCCESS)
+			throw std::runtime_error("Failed to create a descriptor update template!");
+
+		return result;
+	}
+};
+
+// Hands out descriptor sets from chains of pools. Per-frame sets come from the frame slot's chain, and the whole
+// chain is recycled with one vkResetDescriptorPool per pool when the slot comes around again, so no set is ever
+// freed individually. Persistent sets (materials and the like) come from a chain that is never reset.
+// Exhausted chains take a recycled pool, or create one twice the size of the last, so after the first frames
+// a frame costs no pool creations at all and only a handful of resets however many sets it allocates.
+// Not thread-safe; sets are allocated on the main thread while recording.
+class DescriptorAllocator
+{
+public:
+	void create(VkDevice dev, uint32_t framesInFlight)
+	{
+		device = dev;
+		frameChains.resize(framesInFlight);
+	}
+
+	void destroy()
+	{
+		for (auto& chain : frameChains)
+			for (VkDescriptorPool pool : chain.pools)
+				vkDestroyDescriptorPool(device, pool, nullptr);
+
+		for (VkDescriptorPool pool : persistentChain.pools)
+			vkDestroyDescriptorPool(device, pool, nullptr);
+
+		for (VkDescriptorPool pool : freePools)
+			vkDestroyDescriptorPool(device, pool, nullptr);
+
+		frameChains.clear();
+		persistentChain = {};
+		freePools.clear();
+	}
+
+	// Call once the slot's previous frame has completed; every set that frame allocated becomes invalid.
+	void beginFrame(uint32_t frameSlot)
+	{
+		PoolChain& chain{ frameChains[frameSlot] };
+
+		for (VkDescriptorPool pool : chain.pools)
+		{
+			vkResetDescriptorPool(device, pool, 0);
+			freePools.push_back(pool);
+			++poolResets;
+		}
+
+		chain.pools.clear();
+	}
+
+	// Valid until the slot's next beginFrame().
+	VkDescriptorSet allocate(uint32_t frameSlot, const DescriptorLayout& layout)
+	{
+		return allocateFrom(frameChains[frameSlot], layout);
+	}
+
+	// Valid until destroy().
+	VkDescriptorSet allocatePersistent(const DescriptorLayout& layout)
+	{
+		return allocateFrom(persistentChain, layout);
+	}
+
+	// `data` holds layout.descriptorCount entries in binding order.
+	void write(VkDescriptorSet set, const DescriptorLayout& layout, const DescriptorData* data) const
+	{
+		if (layout.updateTemplate != VK_NULL_HANDLE)
+			vkUpdateDescriptorSetWithTemplate(device, set, layout.updateTemplate, data);
+	}
+
+	void printStatistics() const
+	{
+		std::cout << "Descriptors: " << setsAllocated << " sets allocated, " << poolsCreated << " pools created (largest "
+			<< largestPoolSets << " sets), " << poolResets << " pool resets\n\n";
+	}
+
+private:
+	// Each pool is the head of a chain until it runs out; earlier pools are only kept to be reset.
+	struct PoolChain
+	{
+		std::vector<VkDescriptorPool> pools{};
+	};
+
+	// Descriptors of each type per set a pool is sized for. Generous for buffers, which every set here uses.
+	static constexpr std::array<VkDescriptorPoolSize, 6> poolRatios{ {
+		{ VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 2 },
+		{ VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, 1 },
+		{ VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 2 },
+		{ VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC, 1 },
+		{ VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 4 },
+		{ VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1 }
+	} };
+
+	static constexpr uint32_t initialSetsPerPool{ 64 };
+	static constexpr uint32_t maxSetsPerPool{ 4096 };
+
+	VkDevice device{};
+	std::vector<PoolChain> frameChains{};
+	PoolChain persistentChain{};
+	// Reset pools waiting for a chain that runs out.
+	std::vector<VkDescriptorPool> freePools{};
+	uint32_t setsPerPool{ initialSetsPerPool };
+	uint64_t setsAllocated{ 0 };
+	uint32_t poolsCreated{ 0 };
+	uint32_t largestPoolSets{ 0 };
+	uint64_t poolResets{ 0 };
+
+	VkDescriptorSet allocateFrom(PoolChain& chain, const DescriptorLayout& layout)
+	{
+		if (chain.pools.empty())
+			chain.pools.push_back(acquirePool());
+
+		VkDescriptorSetAllocateInfo allocInfo{
+			.sType{ VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO },
+			.descriptorPool{ chain.pools.back() },
+			.descriptorSetCount{ 1 },
+			.pSetLayouts{ &layout.layout }
+		};
+
+		VkDescriptorSet set{};
+		VkResult result{ vkAllocateDescriptorSets(device, &allocInfo, &set) };
+
+		// Only the newest pool is ever allocated from, so a full one just moves the chain on.
+		if (result == VK_ERROR_OUT_OF_POOL_MEMORY || result == VK_ERROR_FRAGMENTED_POOL)
+		{
+			chain.pools.push_back(acquirePool());
+			allocInfo.descriptorPool = chain.pools.back();
+			result = vkAllocateDescriptorSets(device, &allocInfo, &set);
+		}
+
+		if (result != VK_SUCCESS)
+			throw std::runtime_error("Failed to allocate a descriptor set!");
+
+		++setsAllocated;
+		return set;
+	}
+
+	VkDescriptorPool acquirePool()
+	{
+		if (!freePools.empty())
+		{
+			VkDescriptorPool pool{ freePools.back() };
+			freePools.pop_back();
+			return pool;
+		}
+
+		std::array<VkDescriptorPoolSize, poolRatios.size()> poolSizes{ poolRatios };
+		for (auto& poolSize : poolSizes)
+			poolSize.descriptorCount *= setsPerPool;
+
+		VkDescriptorPoolCreateInfo poolInfo{
+			.sType{ VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO },
+			.maxSets{ setsPerPool },
+			.poolSizeCount{ static_cast<uint32_t>(poolSizes.size()) },
+			.pPoolSizes{ poolSizes.data() }
+		};
+
+		VkDescriptorPool pool{};
+		if (vkCreateDescriptorPool(device, &poolInfo, nullptr, &pool) != VK_SUCCESS)
+			throw std::runtime_error("Failed to create a descriptor pool!");
+
+		++poolsCreated;
+		largestPoolSets = setsPerPool;
+		setsPerPool = std::min(setsPerPool * 2, maxSetsPerPool);
+
+		return pool;
+	}
+};
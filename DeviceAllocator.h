@@ -0,0 +1,798 @@
+#pragma once
+#include <vulkan/vulkan.h>
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cstdint>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <vector>
+
+
+enum class MemoryUsage
+{
+	GpuOnly,	// device-local, never touched by the CPU
+	Upload,		// host-visible staging memory, written once and copied from
+	CpuToGpu,	// host-visible memory the GPU reads directly every frame, device-local when possible
+	GpuToCpu	// host-visible readback memory, cached when possible
+};
+
+// Buffers and linear images are "linear", optimal-tiling images are not.
+// They must not share a bufferImageGranularity page, see DeviceAllocator::allocate.
+enum class ResourceKind
+{
+	Linear,
+	Optimal
+};
+
+// Two-level segregated fit allocator for the ranges of one VkDeviceMemory block.
+// Allocation and free are O(1); neighbouring free ranges are merged on free.
+class TlsfBlock
+{
+public:
+	static constexpr uint32_t invalidChunk{ std::numeric_limits<uint32_t>::max() };
+
+	explicit TlsfBlock(VkDeviceSize blockSize)
+		: size{ blockSize }
+	{
+		freeHeads.fill(invalidChunk);
+
+		uint32_t chunk{ newChunk() };
+		chunks[chunk] = { .offset{ 0 }, .size{ blockSize } };
+		insertFree(chunk);
+	}
+
+	// Returns invalidChunk when no free range is large enough.
+	uint32_t allocate(VkDeviceSize allocationSize, VkDeviceSize alignment, VkDeviceSize& offset)
+	{
+		// Searching with the worst-case padding guarantees that whatever we find fits.
+		uint32_t chunk{ findSuitable(allocationSize + alignment - 1) };
+		if (chunk == invalidChunk)
+			return invalidChunk;
+
+		removeFree(chunk);
+
+		VkDeviceSize alignedOffset{ alignUp(chunks[chunk].offset, alignment) };
+		VkDeviceSize padding{ alignedOffset - chunks[chunk].offset };
+
+		if (padding > 0)
+		{
+			uint32_t front{ splitFront(chunk, padding) };
+			insertFree(front);
+		}
+
+		if (chunks[chunk].size > allocationSize)
+		{
+			uint32_t back{ splitBack(chunk, allocationSize) };
+			insertFree(back);
+		}
+
+		chunks[chunk].isFree = false;
+		usedBytes += chunks[chunk].size;
+		++allocationCount;
+
+		offset = chunks[chunk].offset;
+		return chunk;
+	}
+
+	void free(uint32_t chunk)
+	{
+		usedBytes -= chunks[chunk].size;
+		--allocationCount;
+
+		chunks[chunk].isFree = true;
+
+		uint32_t prev{ chunks[chunk].prevPhysical };
+		if (prev != invalidChunk && chunks[prev].isFree)
+		{
+			removeFree(prev);
+			chunk = merge(prev, chunk);
+		}
+
+		uint32_t next{ chunks[chunk].nextPhysical };
+		if (next != invalidChunk && chunks[next].isFree)
+		{
+			removeFree(next);
+			chunk = merge(chunk, next);
+		}
+
+		insertFree(chunk);
+	}
+
+	VkDeviceSize blockSize() const { return size; }
+	VkDeviceSize usedSize() const { return usedBytes; }
+	uint32_t allocations() const { return allocationCount; }
+	bool empty() const { return allocationCount == 0; }
+
+	static VkDeviceSize alignUp(VkDeviceSize value, VkDeviceSize alignment)
+	{
+		return (value + alignment - 1) / alignment * alignment;
+	}
+
+private:
+	struct Chunk
+	{
+		VkDeviceSize offset{};
+		VkDeviceSize size{};
+		uint32_t prevPhysical{ invalidChunk };
+		uint32_t nextPhysical{ invalidChunk };
+		uint32_t prevFree{ invalidChunk };
+		uint32_t nextFree{ invalidChunk };
+		bool isFree{ true };
+	};
+
+	static constexpr uint32_t secondLevelBits{ 4 };
+	static constexpr uint32_t secondLevelCount{ 1u << secondLevelBits };
+	static constexpr uint32_t firstLevelCount{ 64 };
+
+	VkDeviceSize size{};
+	VkDeviceSize usedBytes{ 0 };
+	uint32_t allocationCount{ 0 };
+	std::vector<Chunk> chunks{};
+	std::vector<uint32_t> unusedChunks{};
+	uint64_t firstLevelBitmap{ 0 };
+	std::array<uint32_t, firstLevelCount> secondLevelBitmaps{};
+	std::array<uint32_t, firstLevelCount * secondLevelCount> freeHeads{};
+
+	static void mapping(VkDeviceSize value, uint32_t& fl, uint32_t& sl)
+	{
+		fl = static_cast<uint32_t>(std::bit_width(value) - 1);
+		sl = fl < secondLevelBits ? 0 : static_cast<uint32_t>((value >> (fl - secondLevelBits)) & (secondLevelCount - 1));
+	}
+
+	// Rounds up to the next bin boundary so every range in the returned bin is large enough.
+	static void mappingSearch(VkDeviceSize value, uint32_t& fl, uint32_t& sl)
+	{
+		uint32_t msb{ static_cast<uint32_t>(std::bit_width(value) - 1) };
+		if (msb < secondLevelBits)
+			value = std::bit_ceil(value);
+		else
+			value += (VkDeviceSize{ 1 } << (msb - secondLevelBits)) - 1;
+
+		mapping(value, fl, sl);
+	}
+
+	uint32_t findSuitable(VkDeviceSize value) const
+	{
+		uint32_t fl{}, sl{};
+		mappingSearch(value, fl, sl);
+		if (fl >= firstLevelCount)
+			return invalidChunk;
+
+		uint32_t slMap{ secondLevelBitmaps[fl] & (~0u << sl) };
+		if (slMap == 0)
+		{
+			uint64_t flMap{ fl + 1 < firstLevelCount ? firstLevelBitmap & (~0ull << (fl + 1)) : 0 };
+			if (flMap == 0)
+				return invalidChunk;
+
+			fl = static_cast<uint32_t>(std::countr_zero(flMap));
+			slMap = secondLevelBitmaps[fl];
+		}
+
+		sl = static_cast<uint32_t>(std::countr_zero(slMap));
+		return freeHeads[fl * secondLevelCount + sl];
+	}
+
+	void insertFree(uint32_t chunk)
+	{
+		uint32_t fl{}, sl{};
+		mapping(chunks[chunk].size, fl, sl);
+
+		uint32_t& head{ freeHeads[fl * secondLevelCount + sl] };
+		chunks[chunk].isFree = true;
+		chunks[chunk].prevFree = invalidChunk;
+		chunks[chunk].nextFree = head;
+		if (head != invalidChunk)
+			chunks[head].prevFree = chunk;
+		head = chunk;
+
+		firstLevelBitmap |= 1ull << fl;
+		secondLevelBitmaps[fl] |= 1u << sl;
+	}
+
+	void removeFree(uint32_t chunk)
+	{
+		uint32_t fl{}, sl{};
+		mapping(chunks[chunk].size, fl, sl);
+
+		Chunk& c{ chunks[chunk] };
+		if (c.prevFree != invalidChunk)
+			chunks[c.prevFree].nextFree = c.nextFree;
+		else
+			freeHeads[fl * secondLevelCount + sl] = c.nextFree;
+
+		if (c.nextFree != invalidChunk)
+			chunks[c.nextFree].prevFree = c.prevFree;
+
+		c.prevFree = invalidChunk;
+		c.nextFree = invalidChunk;
+
+		if (freeHeads[fl * secondLevelCount + sl] == invalidChunk)
+		{
+			secondLevelBitmaps[fl] &= ~(1u << sl);
+			if (secondLevelBitmaps[fl] == 0)
+				firstLevelBitmap &= ~(1ull << fl);
+		}
+	}
+
+	uint32_t newChunk()
+	{
+		if (!unusedChunks.empty())
+		{
+			uint32_t chunk{ unusedChunks.back() };
+			unusedChunks.pop_back();
+			chunks[chunk] = Chunk{};
+			return chunk;
+		}
+
+		chunks.emplace_back();
+		return static_cast<uint32_t>(chunks.size() - 1);
+	}
+
+	// Cuts the first `frontSize` bytes of `chunk` into a new chunk placed before it.
+	uint32_t splitFront(uint32_t chunk, VkDeviceSize frontSize)
+	{
+		uint32_t front{ newChunk() };
+		Chunk& c{ chunks[chunk] };
+
+		chunks[front] = {
+			.offset{ c.offset },
+			.size{ frontSize },
+			.prevPhysical{ c.prevPhysical },
+			.nextPhysical{ chunk }
+		};
+
+		if (c.prevPhysical != invalidChunk)
+			chunks[c.prevPhysical].nextPhysical = front;
+
+		c.prevPhysical = front;
+		c.offset += frontSize;
+		c.size -= frontSize;
+
+		return front;
+	}
+
+	// Keeps the first `keepSize` bytes in `chunk` and returns the remainder as a new chunk after it.
+	uint32_t splitBack(uint32_t chunk, VkDeviceSize keepSize)
+	{
+		uint32_t back{ newChunk() };
+		Chunk& c{ chunks[chunk] };
+
+		chunks[back] = {
+			.offset{ c.offset + keepSize },
+			.size{ c.size - keepSize },
+			.prevPhysical{ chunk },
+			.nextPhysical{ c.nextPhysical }
+		};
+
+		if (c.nextPhysical != invalidChunk)
+			chunks[c.nextPhysical].prevPhysical = back;
+
+		c.nextPhysical = back;
+		c.size = keepSize;
+
+		return back;
+	}
+
+	// Absorbs `second` into `first`; both must be physically adjacent and off the free lists.
+	uint32_t merge(uint32_t first, uint32_t second)
+	{
+		chunks[first].size += chunks[second].size;
+		chunks[first].nextPhysical = chunks[second].nextPhysical;
+
+		if (chunks[second].nextPhysical != invalidChunk)
+			chunks[chunks[second].nextPhysical].prevPhysical = first;
+
+		unusedChunks.push_back(second);
+		return first;
+	}
+};
+
+struct MemoryBlock
+{
+	VkDeviceMemory memory{};
+	uint32_t memoryType{};
+	ResourceKind kind{};
+	void* mappedData{ nullptr };
+	TlsfBlock ranges;
+};
+
+struct Allocation
+{
+	VkDeviceMemory memory{};
+	VkDeviceSize offset{};
+	VkDeviceSize size{};
+	void* mappedData{ nullptr };
+	uint32_t memoryType{};
+	// nullptr for dedicated allocations
+	MemoryBlock* block{ nullptr };
+	uint32_t chunk{ TlsfBlock::invalidChunk };
+};
+
+struct AllocatedBuffer
+{
+	VkBuffer buffer{};
+	Allocation allocation{};
+};
+
+struct AllocatedImage
+{
+	VkImage image{};
+	Allocation allocation{};
+};
+
+// Sub-allocates buffers and images from large VkDeviceMemory blocks, so the number of vkAllocateMemory
+// calls stays far below maxMemoryAllocationCount. Host-visible blocks stay mapped for their whole lifetime.
+class DeviceAllocator
+{
+public:
+	void create(VkPhysicalDevice physicalDevice, VkDevice dev)
+	{
+		device = dev;
+		vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memoryProperties);
+
+		VkPhysicalDeviceProperties properties{};
+		vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+		bufferImageGranularity = properties.limits.bufferImageGranularity;
+		nonCoherentAtomSize = properties.limits.nonCoherentAtomSize;
+		maxAllocationCount = properties.limits.maxMemoryAllocationCount;
+	}
+
+	void destroy()
+	{
+		for (const auto& block : blocks)
+			vkFreeMemory(device, block->memory, nullptr);
+
+		blocks.clear();
+	}
+
+	// Allocates memory for `buffer` and binds it. `minAlignment` raises the driver's alignment, e.g. for whole cache lines.
+	Allocation allocateForBuffer(VkBuffer buffer, MemoryUsage usage, VkDeviceSize minAlignment = 1)
+	{
+		VkMemoryDedicatedRequirements dedicatedRequirements{
+			.sType{ VK_STRUCTURE_TYPE_MEMORY_DEDICATED_REQUIREMENTS }
+		};
+		VkMemoryRequirements2 requirements{
+			.sType{ VK_STRUCTURE_TYPE_MEMORY_REQUIREMENTS_2 },
+			.pNext{ &dedicatedRequirements }
+		};
+		VkBufferMemoryRequirementsInfo2 info{
+			.sType{ VK_STRUCTURE_TYPE_BUFFER_MEMORY_REQUIREMENTS_INFO_2 },
+			.buffer{ buffer }
+		};
+		vkGetBufferMemoryRequirements2(device, &info, &requirements);
+		requirements.memoryRequirements.alignment = std::max(requirements.memoryRequirements.alignment, minAlignment);
+
+		bool dedicated{ dedicatedRequirements.requiresDedicatedAllocation || dedicatedRequirements.prefersDedicatedAllocation };
+		Allocation allocation{ allocate(requirements.memoryRequirements, usage, ResourceKind::Linear, dedicated, buffer, VK_NULL_HANDLE) };
+
+		if (vkBindBufferMemory(device, buffer, allocation.memory, allocation.offset) != VK_SUCCESS)
+			throw std::runtime_error("Failed to bind the buffer memory!");
+
+		return allocation;
+	}
+
+	// Allocates memory for `image` and binds it.
+	Allocation allocateForImage(VkImage image, VkImageTiling tiling, MemoryUsage usage)
+	{
+		VkMemoryDedicatedRequirements dedicatedRequirements{
+			.sType{ VK_STRUCTURE_TYPE_MEMORY_DEDICATED_REQUIREMENTS }
+		};
+		VkMemoryRequirements2 requirements{
+			.sType{ VK_STRUCTURE_TYPE_MEMORY_REQUIREMENTS_2 },
+			.pNext{ &dedicatedRequirements }
+		};
+		VkImageMemoryRequirementsInfo2 info{
+			.sType{ VK_STRUCTURE_TYPE_IMAGE_MEMORY_REQUIREMENTS_INFO_2 },
+			.image{ image }
+		};
+		vkGetImageMemoryRequirements2(device, &info, &requirements);
+
+		bool dedicated{ dedicatedRequirements.requiresDedicatedAllocation || dedicatedRequirements.prefersDedicatedAllocation };
+		ResourceKind kind{ tiling == VK_IMAGE_TILING_OPTIMAL ? ResourceKind::Optimal : ResourceKind::Linear };
+		Allocation allocation{ allocate(requirements.memoryRequirements, usage, kind, dedicated, VK_NULL_HANDLE, image) };
+
+		if (vkBindImageMemory(device, image, allocation.memory, allocation.offset) != VK_SUCCESS)
+			throw std::runtime_error("Failed to bind the image memory!");
+
+		return allocation;
+	}
+
+	void free(Allocation& allocation)
+	{
+		if (allocation.memory == VK_NULL_HANDLE)
+			return;
+
+		std::lock_guard lock{ mutex };
+
+		uint32_t heap{ memoryProperties.memoryTypes[allocation.memoryType].heapIndex };
+
+		if (allocation.block == nullptr)
+		{
+			vkFreeMemory(device, allocation.memory, nullptr);
+			--deviceMemoryCount;
+			--heapStats[heap].dedicatedCount;
+			heapStats[heap].dedicatedBytes -= allocation.size;
+		}
+		else
+		{
+			MemoryBlock* block{ allocation.block };
+			block->ranges.free(allocation.chunk);
+			--heapStats[heap].allocationCount;
+			heapStats[heap].usedBytes -= allocation.size;
+
+			// Keep one empty block per memory type around so alloc/free cycles do not hit the driver.
+			if (block->ranges.empty() && countBlocks(block->memoryType, block->kind) > 1)
+				releaseBlock(block);
+		}
+
+		allocation = {};
+	}
+
+	AllocatedBuffer createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, MemoryUsage memoryUsage, VkDeviceSize minAlignment = 1)
+	{
+		VkBufferCreateInfo bufferInfo{
+			.sType{ VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO },
+			.size{ size },
+			.usage{ usage },
+			.sharingMode{ VK_SHARING_MODE_EXCLUSIVE }
+		};
+
+		AllocatedBuffer result{};
+		if (vkCreateBuffer(device, &bufferInfo, nullptr, &result.buffer) != VK_SUCCESS)
+			throw std::runtime_error("Failed to create a buffer!");
+
+		result.allocation = allocateForBuffer(result.buffer, memoryUsage, minAlignment);
+		return result;
+	}
+
+	void destroyBuffer(AllocatedBuffer& buffer)
+	{
+		vkDestroyBuffer(device, buffer.buffer, nullptr);
+		free(buffer.allocation);
+		buffer = {};
+	}
+
+	AllocatedImage createImage(const VkImageCreateInfo& imageInfo, MemoryUsage memoryUsage)
+	{
+		AllocatedImage result{};
+		if (vkCreateImage(device, &imageInfo, nullptr, &result.image) != VK_SUCCESS)
+			throw std::runtime_error("Failed to create an image!");
+
+		result.allocation = allocateForImage(result.image, imageInfo.tiling, memoryUsage);
+		return result;
+	}
+
+	void destroyImage(AllocatedImage& image)
+	{
+		vkDestroyImage(device, image.image, nullptr);
+		free(image.allocation);
+		image = {};
+	}
+
+	// Needed before the CPU reads GPU-written data from memory that is not HOST_COHERENT.
+	void invalidate(const Allocation& allocation)
+	{
+		if (isCoherent(allocation.memoryType))
+			return;
+
+		VkMappedMemoryRange range{ mappedRange(allocation) };
+		vkInvalidateMappedMemoryRanges(device, 1, &range);
+	}
+
+	// Needed after the CPU writes to memory that is not HOST_COHERENT.
+	void flush(const Allocation& allocation)
+	{
+		if (isCoherent(allocation.memoryType))
+			return;
+
+		VkMappedMemoryRange range{ mappedRange(allocation) };
+		vkFlushMappedMemoryRanges(device, 1, &range);
+	}
+
+	void printStatistics()
+	{
+		std::lock_guard lock{ mutex };
+
+		std::cout << "Device memory (" << deviceMemoryCount << " of " << maxAllocationCount << " vkAllocateMemory allocations):\n";
+		for (uint32_t heap{ 0 }; heap < memoryProperties.memoryHeapCount; ++heap)
+		{
+			const HeapStats& stats{ heapStats[heap] };
+			const VkMemoryHeap& heapInfo{ memoryProperties.memoryHeaps[heap] };
+
+			std::cout << "\theap " << heap << ((heapInfo.flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT) ? " (device-local)" : "")
+				<< ": " << toMiB(heapInfo.size) << " MiB"
+				<< " | " << stats.blockCount << " blocks, " << toMiB(stats.blockBytes) << " MiB reserved, "
+				<< toMiB(stats.usedBytes) << " MiB used by " << stats.allocationCount << " sub-allocations"
+				<< " | " << stats.dedicatedCount << " dedicated, " << toMiB(stats.dedicatedBytes) << " MiB\n";
+		}
+
+		std::cout << '\n';
+	}
+
+private:
+	struct HeapStats
+	{
+		uint32_t blockCount{ 0 };
+		VkDeviceSize blockBytes{ 0 };
+		uint32_t allocationCount{ 0 };
+		VkDeviceSize usedBytes{ 0 };
+		uint32_t dedicatedCount{ 0 };
+		VkDeviceSize dedicatedBytes{ 0 };
+	};
+
+	static constexpr VkDeviceSize largeHeapBlockSize{ 256ull * 1024 * 1024 };
+	static constexpr VkDeviceSize smallHeapThreshold{ 1024ull * 1024 * 1024 };
+
+	VkDevice device{};
+	VkPhysicalDeviceMemoryProperties memoryProperties{};
+	VkDeviceSize bufferImageGranularity{ 1 };
+	VkDeviceSize nonCoherentAtomSize{ 1 };
+	uint32_t maxAllocationCount{ 0 };
+	uint32_t deviceMemoryCount{ 0 };
+	std::vector<std::unique_ptr<MemoryBlock>> blocks{};
+	std::array<HeapStats, VK_MAX_MEMORY_HEAPS> heapStats{};
+	std::mutex mutex{};
+
+	static double toMiB(VkDeviceSize bytes)
+	{
+		return static_cast<double>(bytes) / (1024.0 * 1024.0);
+	}
+
+	bool isCoherent(uint32_t memoryType) const
+	{
+		return (memoryProperties.memoryTypes[memoryType].propertyFlags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT) != 0;
+	}
+
+	// Rounded out to nonCoherentAtomSize; a range that would run past the end of the memory object is
+	// passed as VK_WHOLE_SIZE instead, which the spec allows for exactly that case.
+	VkMappedMemoryRange mappedRange(const Allocation& allocation) const
+	{
+		VkDeviceSize memorySize{ allocation.block != nullptr ? allocation.block->ranges.blockSize() : allocation.size };
+		VkDeviceSize begin{ allocation.offset / nonCoherentAtomSize * nonCoherentAtomSize };
+		VkDeviceSize end{ TlsfBlock::alignUp(allocation.offset + allocation.size, nonCoherentAtomSize) };
+
+		return {
+			.sType{ VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE },
+			.memory{ allocation.memory },
+			.offset{ begin },
+			.size{ end >= memorySize ? VK_WHOLE_SIZE : end - begin }
+		};
+	}
+
+	VkDeviceSize preferredBlockSize(uint32_t memoryType) const
+	{
+		VkDeviceSize heapSize{ memoryProperties.memoryHeaps[memoryProperties.memoryTypes[memoryType].heapIndex].size };
+		return heapSize <= smallHeapThreshold ? heapSize / 8 : largeHeapBlockSize;
+	}
+
+	// Lowest cost wins: every missing preferred flag and every present unwanted flag costs one point.
+	int32_t findMemoryType(uint32_t typeBits, MemoryUsage usage) const
+	{
+		VkMemoryPropertyFlags required{ 0 };
+		VkMemoryPropertyFlags preferred{ 0 };
+		VkMemoryPropertyFlags unwanted{ 0 };
+
+		switch (usage)
+		{
+		case MemoryUsage::GpuOnly:
+			preferred = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+			unwanted = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT;
+			break;
+		case MemoryUsage::Upload:
+			required = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+			unwanted = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT | VK_MEMORY_PROPERTY_HOST_CACHED_BIT;
+			break;
+		case MemoryUsage::CpuToGpu:
+			required = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+			preferred = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+			break;
+		case MemoryUsage::GpuToCpu:
+			required = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT;
+			preferred = VK_MEMORY_PROPERTY_HOST_CACHED_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+			break;
+		}
+
+		int32_t bestType{ -1 };
+		int bestCost{ std::numeric_limits<int>::max() };
+
+		for (uint32_t i{ 0 }; i < memoryProperties.memoryTypeCount; ++i)
+		{
+			VkMemoryPropertyFlags flags{ memoryProperties.memoryTypes[i].propertyFlags };
+			if (!(typeBits & (1u << i)) || (flags & required) != required)
+				continue;
+
+			int cost{ std::popcount(preferred & ~flags) + std::popcount(unwanted & flags) };
+			if (cost < bestCost)
+			{
+				bestCost = cost;
+				bestType = static_cast<int32_t>(i);
+			}
+		}
+
+		return bestType;
+	}
+
+	uint32_t countBlocks(uint32_t memoryType, ResourceKind kind) const
+	{
+		return static_cast<uint32_t>(std::count_if(blocks.begin(), blocks.end(),
+			[&](const auto& block) { return block->memoryType == memoryType && block->kind == kind; }));
+	}
+
+	VkDeviceMemory allocateDeviceMemory(VkDeviceSize size, uint32_t memoryType, const void* pNext)
+	{
+		if (deviceMemoryCount >= maxAllocationCount)
+			return VK_NULL_HANDLE;
+
+		VkMemoryAllocateInfo allocInfo{
+			.sType{ VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO },
+			.pNext{ pNext },
+			.allocationSize{ size },
+			.memoryTypeIndex{ memoryType }
+		};
+
+		VkDeviceMemory memory{};
+		if (vkAllocateMemory(device, &allocInfo, nullptr, &memory) != VK_SUCCESS)
+			return VK_NULL_HANDLE;
+
+		++deviceMemoryCount;
+		return memory;
+	}
+
+	void* mapIfHostVisible(VkDeviceMemory memory, uint32_t memoryType)
+	{
+		if (!(memoryProperties.memoryTypes[memoryType].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT))
+			return nullptr;
+
+		void* data{ nullptr };
+		if (vkMapMemory(device, memory, 0, VK_WHOLE_SIZE, 0, &data) != VK_SUCCESS)
+			throw std::runtime_error("Failed to map device memory!");
+
+		return data;
+	}
+
+	MemoryBlock* createBlock(uint32_t memoryType, ResourceKind kind, VkDeviceSize size)
+	{
+		VkDeviceMemory memory{ allocateDeviceMemory(size, memoryType, nullptr) };
+		if (memory == VK_NULL_HANDLE)
+			return nullptr;
+
+		blocks.push_back(std::make_unique<MemoryBlock>(MemoryBlock{
+			.memory{ memory },
+			.memoryType{ memoryType },
+			.kind{ kind },
+			.mappedData{ mapIfHostVisible(memory, memoryType) },
+			.ranges{ TlsfBlock{ size } }
+		}));
+
+		HeapStats& stats{ heapStats[memoryProperties.memoryTypes[memoryType].heapIndex] };
+		++stats.blockCount;
+		stats.blockBytes += size;
+
+		return blocks.back().get();
+	}
+
+	void releaseBlock(MemoryBlock* block)
+	{
+		HeapStats& stats{ heapStats[memoryProperties.memoryTypes[block->memoryType].heapIndex] };
+		--stats.blockCount;
+		stats.blockBytes -= block->ranges.blockSize();
+
+		vkFreeMemory(device, block->memory, nullptr);
+		--deviceMemoryCount;
+
+		std::erase_if(blocks, [block](const auto& b) { return b.get() == block; });
+	}
+
+	bool allocateDedicated(const VkMemoryRequirements& requirements, uint32_t memoryType, VkBuffer buffer, VkImage image, Allocation& allocation)
+	{
+		VkMemoryDedicatedAllocateInfo dedicatedInfo{
+			.sType{ VK_STRUCTURE_TYPE_MEMORY_DEDICATED_ALLOCATE_INFO },
+			.image{ image },
+			.buffer{ buffer }
+		};
+
+		VkDeviceMemory memory{ allocateDeviceMemory(requirements.size, memoryType, &dedicatedInfo) };
+		if (memory == VK_NULL_HANDLE)
+			return false;
+
+		allocation = {
+			.memory{ memory },
+			.offset{ 0 },
+			.size{ requirements.size },
+			.mappedData{ mapIfHostVisible(memory, memoryType) },
+			.memoryType{ memoryType }
+		};
+
+		HeapStats& stats{ heapStats[memoryProperties.memoryTypes[memoryType].heapIndex] };
+		++stats.dedicatedCount;
+		stats.dedicatedBytes += requirements.size;
+
+		return true;
+	}
+
+	bool allocateFromBlocks(const VkMemoryRequirements& requirements, uint32_t memoryType, ResourceKind kind, Allocation& allocation)
+	{
+		VkDeviceSize alignment{ requirements.alignment };
+		if (!isCoherent(memoryType) && (memoryProperties.memoryTypes[memoryType].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT))
+			alignment = std::max(alignment, nonCoherentAtomSize);
+
+		auto tryBlock = [&](MemoryBlock* block)
+		{
+			VkDeviceSize offset{};
+			uint32_t chunk{ block->ranges.allocate(requirements.size, alignment, offset) };
+			if (chunk == TlsfBlock::invalidChunk)
+				return false;
+
+			allocation = {
+				.memory{ block->memory },
+				.offset{ offset },
+				.size{ requirements.size },
+				.mappedData{ block->mappedData ? static_cast<char*>(block->mappedData) + offset : nullptr },
+				.memoryType{ memoryType },
+				.block{ block },
+				.chunk{ chunk }
+			};
+
+			HeapStats& stats{ heapStats[memoryProperties.memoryTypes[memoryType].heapIndex] };
+			++stats.allocationCount;
+			stats.usedBytes += requirements.size;
+
+			return true;
+		};
+
+		for (const auto& block : blocks)
+		{
+			if (block->memoryType == memoryType && block->kind == kind && tryBlock(block.get()))
+				return true;
+		}
+
+		// Resources too large for the preferred size get a block of their own size, rounded up to a power of two so
+		// the TLSF search is guaranteed to find room in it; whatever they leave over is sub-allocated like any block.
+		VkDeviceSize blockSize{ std::max(preferredBlockSize(memoryType), std::bit_ceil(requirements.size + alignment - 1)) };
+		MemoryBlock* block{ createBlock(memoryType, kind, blockSize) };
+		return block != nullptr && tryBlock(block);
+	}
+
+	Allocation allocate(const VkMemoryRequirements& requirements, MemoryUsage usage, ResourceKind kind, bool dedicated, VkBuffer buffer, VkImage image)
+	{
+		std::lock_guard lock{ mutex };
+
+		// Linear and optimal resources only need separate blocks when they could otherwise share a granularity page.
+		if (bufferImageGranularity <= 1)
+			kind = ResourceKind::Linear;
+
+		uint32_t typeBits{ requirements.memoryTypeBits };
+
+		// When a heap is exhausted fall back to the next best memory type instead of failing outright.
+		while (typeBits != 0)
+		{
+			int32_t type{ findMemoryType(typeBits, usage) };
+			if (type < 0)
+				break;
+
+			uint32_t memoryType{ static_cast<uint32_t>(type) };
+
+			Allocation allocation{};
+			bool allocated{ dedicated ? allocateDedicated(requirements, memoryType, buffer, image, allocation)
+				: allocateFromBlocks(requirements, memoryType, kind, allocation) };
+
+			// The rounded-up block of an oversized resource can fail where the resource itself still fits in the heap.
+			if (!allocated && !dedicated && requirements.size > preferredBlockSize(memoryType))
+				allocated = allocateDedicated(requirements, memoryType, buffer, image, allocation);
+
+			if (allocated)
+				return allocation;
+
+			typeBits &= ~(1u << memoryType);
+		}
+
+		throw std::runtime_error("Failed to allocate device memory!");
+	}
+};
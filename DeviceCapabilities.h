@@ -0,0 +1,441 @@
+#pragma once
+#include <vulkan/vulkan.h>
+
+#include "Hash.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+
+// Instance layers and extensions can change whenever an SDK or overlay is installed, so they are queried on every
+// run; the sets only replace the nested strcmp scans.
+struct InstanceCapabilities
+{
+	std::unordered_set<std::string> layers{};
+	std::unordered_set<std::string> extensions{};
+
+	static InstanceCapabilities query()
+	{
+		InstanceCapabilities capabilities{};
+
+		uint32_t layerCount{ 0 };
+		vkEnumerateInstanceLayerProperties(&layerCount, nullptr);
+
+		std::vector<VkLayerProperties> availableLayers(layerCount);
+		vkEnumerateInstanceLayerProperties(&layerCount, availableLayers.data());
+
+		for (const auto& layer : availableLayers)
+			capabilities.layers.insert(layer.layerName);
+
+		uint32_t extensionCount{ 0 };
+		vkEnumerateInstanceExtensionProperties(nullptr, &extensionCount, nullptr);
+
+		std::vector<VkExtensionProperties> availableExtensions(extensionCount);
+		vkEnumerateInstanceExtensionProperties(nullptr, &extensionCount, availableExtensions.data());
+
+		for (const auto& extension : availableExtensions)
+			capabilities.extensions.insert(extension.extensionName);
+
+		return capabilities;
+	}
+
+	bool hasAllLayers(const std::vector<const char*>& names) const
+	{
+		for (const char* name : names)
+			if (!layers.contains(name))
+				return false;
+
+		return true;
+	}
+
+	bool hasAllExtensions(const std::vector<const char*>& names) const
+	{
+		for (const char* name : names)
+			if (!extensions.contains(name))
+				return false;
+
+		return true;
+	}
+};
+
+// Everything startup asks of one physical device. The surface-dependent part is always queried live because it
+// belongs to this run's window; the rest only changes with the driver and is persisted by DeviceCapabilityCache.
+struct DeviceCapabilities
+{
+	VkPhysicalDevice physicalDevice{};
+	VkPhysicalDeviceProperties properties{};
+	// Stable across driver updates and reboots, unlike the enumeration order; zero on Vulkan 1.0 devices.
+	uint8_t deviceUUID[VK_UUID_SIZE]{};
+	VkPhysicalDeviceFeatures features{};
+	VkPhysicalDeviceMemoryProperties memoryProperties{};
+	std::unordered_set<std::string> extensions{};
+	std::vector<VkQueueFamilyProperties> queueFamilies{};
+	// Empty in headless mode.
+	std::vector<VkBool32> presentSupport{};
+	std::vector<VkSurfaceFormatKHR> surfaceFormats{};
+	std::vector<VkPresentModeKHR> presentModes{};
+	bool loadedFromDisk{ false };
+
+	bool hasExtension(const char* name) const { return extensions.contains(name); }
+
+	bool hasAllExtensions(const std::vector<const char*>& names) const
+	{
+		for (const char* name : names)
+			if (!extensions.contains(name))
+				return false;
+
+		return true;
+	}
+};
+
+// On-disk layout: DeviceCapabilityFileHeader followed by `entryCount` entries, each one a DeviceCapabilityEntryHeader,
+// the features, the memory properties, the queue family properties and the extension names as NUL-terminated strings.
+struct DeviceCapabilityFileHeader
+{
+	uint32_t magic{};
+	uint32_t fileVersion{};
+	uint32_t entryCount{};
+	uint32_t reserved{};
+	uint64_t dataSize{};
+	uint64_t dataHash{};
+};
+
+struct DeviceCapabilityEntryHeader
+{
+	uint32_t vendorID{};
+	uint32_t deviceID{};
+	uint32_t driverVersion{};
+	uint32_t apiVersion{};
+	uint8_t pipelineCacheUUID[VK_UUID_SIZE]{};
+	uint32_t queueFamilyCount{};
+	uint32_t extensionCount{};
+	uint64_t extensionBytes{};
+};
+
+// Probes each physical device at most once per run and remembers the driver-dependent results between runs.
+// Entries are keyed by vendor, device, driver version and pipelineCacheUUID, so a driver update re-probes.
+class DeviceCapabilityCache
+{
+public:
+	static constexpr uint32_t fileMagic{ 0x43445648 }; // "HVDC"
+	static constexpr uint32_t fileVersion{ 2 };
+
+	void create(const std::string& filePath)
+	{
+		path = filePath;
+		loadEntries();
+	}
+
+	// `surface` may be VK_NULL_HANDLE, which skips the presentation queries.
+	const DeviceCapabilities& query(VkPhysicalDevice physicalDevice, VkSurfaceKHR surface)
+	{
+		if (auto it{ devices.find(physicalDevice) }; it != devices.end())
+			return it->second;
+
+		auto start{ std::chrono::steady_clock::now() };
+
+		DeviceCapabilities capabilities{ .physicalDevice{ physicalDevice } };
+		// Cheap, and the only way to know which stored entry belongs to this device.
+		vkGetPhysicalDeviceProperties(physicalDevice, &capabilities.properties);
+
+		// Needs VkPhysicalDeviceProperties2, which a 1.0 device may not accept with this pNext chain.
+		if (capabilities.properties.apiVersion >= VK_API_VERSION_1_1)
+		{
+			VkPhysicalDeviceIDProperties idProperties{ .sType{ VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_ID_PROPERTIES } };
+			VkPhysicalDeviceProperties2 properties2{
+				.sType{ VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2 },
+				.pNext{ &idProperties }
+			};
+
+			vkGetPhysicalDeviceProperties2(physicalDevice, &properties2);
+			std::memcpy(capabilities.deviceUUID, idProperties.deviceUUID, VK_UUID_SIZE);
+		}
+
+		// Entries stay after a hit: identical GPUs share a key, and the second one should not have to probe again.
+		uint64_t key{ entryKey(capabilities.properties) };
+		if (auto stored{ storedEntries.find(key) }; stored != storedEntries.end())
+		{
+			capabilities.features = stored->second.features;
+			capabilities.memoryProperties = stored->second.memoryProperties;
+			capabilities.extensions = stored->second.extensions;
+			capabilities.queueFamilies = stored->second.queueFamilies;
+			capabilities.loadedFromDisk = true;
+			stored->second.used = true;
+			++loadedCount;
+		}
+		else
+		{
+			probeDriver(capabilities);
+			++probedCount;
+			dirty = true;
+
+			storedEntries[key] = {
+				.features{ capabilities.features },
+				.memoryProperties{ capabilities.memoryProperties },
+				.extensions{ capabilities.extensions },
+				.queueFamilies{ capabilities.queueFamilies },
+				.used{ true }
+			};
+		}
+
+		if (surface != VK_NULL_HANDLE)
+			probeSurface(capabilities, surface);
+
+		queryMilliseconds += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+		return devices.emplace(physicalDevice, std::move(capabilities)).first->second;
+	}
+
+	// Only rewrites the file when its contents change: something had to be probed, or a stored entry matched no
+	// device this run. Such entries are dropped, which also retires the ones left behind by older drivers.
+	void save()
+	{
+		bool stale{ std::any_of(storedEntries.begin(), storedEntries.end(), [](const auto& entry) { return !entry.second.used; }) };
+		if (!dirty && !stale)
+			return;
+
+		// Identical GPUs share one entry.
+		std::unordered_set<uint64_t> writtenKeys{};
+		std::vector<char> data{};
+		for (const auto& [physicalDevice, capabilities] : devices)
+		{
+			if (writtenKeys.insert(entryKey(capabilities.properties)).second)
+				appendEntry(data, capabilities);
+		}
+
+		DeviceCapabilityFileHeader header{
+			.magic{ fileMagic },
+			.fileVersion{ fileVersion },
+			.entryCount{ static_cast<uint32_t>(writtenKeys.size()) },
+			.dataSize{ data.size() },
+			.dataHash{ hashBytes(data.data(), data.size()) }
+		};
+
+		const std::string tempPath{ path + ".tmp" };
+		{
+			std::ofstream file(tempPath, std::ios::binary | std::ios::trunc);
+			if (!file.is_open())
+			{
+				std::cerr << "Failed to open " << tempPath << " for writing the device capabilities\n";
+				return;
+			}
+
+			file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+			file.write(data.data(), static_cast<std::streamsize>(data.size()));
+
+			if (!file.good())
+			{
+				std::cerr << "Failed to write the device capabilities to " << tempPath << '\n';
+				return;
+			}
+		}
+
+		std::error_code error{};
+		std::filesystem::rename(tempPath, path, error);
+		if (error)
+		{
+			std::cerr << "Failed to replace " << path << ": " << error.message() << '\n';
+			std::filesystem::remove(tempPath, error);
+			return;
+		}
+
+		dirty = false;
+		std::erase_if(storedEntries, [](const auto& entry) { return !entry.second.used; });
+	}
+
+	void printStatistics() const
+	{
+		std::cout << "Device capabilities: " << loadedCount << " loaded from " << path << ", " << probedCount << " probed, "
+			<< std::fixed << std::setprecision(3) << queryMilliseconds << " ms" << std::defaultfloat << "\n\n";
+	}
+
+private:
+	struct StoredEntry
+	{
+		VkPhysicalDeviceFeatures features{};
+		VkPhysicalDeviceMemoryProperties memoryProperties{};
+		std::unordered_set<std::string> extensions{};
+		std::vector<VkQueueFamilyProperties> queueFamilies{};
+		// Matched or probed by a device this run.
+		bool used{ false };
+	};
+
+	std::string path{};
+	std::unordered_map<VkPhysicalDevice, DeviceCapabilities> devices{};
+	std::unordered_map<uint64_t, StoredEntry> storedEntries{};
+	uint32_t loadedCount{ 0 };
+	uint32_t probedCount{ 0 };
+	double queryMilliseconds{ 0.0 };
+	bool dirty{ false };
+
+	static uint64_t entryKey(uint32_t vendorID, uint32_t deviceID, uint32_t driverVersion, uint32_t apiVersion, const uint8_t* uuid)
+	{
+		uint64_t key{ hashBytes(&vendorID, sizeof(vendorID)) };
+		key = hashBytes(&deviceID, sizeof(deviceID), key);
+		key = hashBytes(&driverVersion, sizeof(driverVersion), key);
+		key = hashBytes(&apiVersion, sizeof(apiVersion), key);
+		return hashBytes(uuid, VK_UUID_SIZE, key);
+	}
+
+	static uint64_t entryKey(const VkPhysicalDeviceProperties& properties)
+	{
+		return entryKey(properties.vendorID, properties.deviceID, properties.driverVersion, properties.apiVersion,
+			properties.pipelineCacheUUID);
+	}
+
+	static void probeDriver(DeviceCapabilities& capabilities)
+	{
+		vkGetPhysicalDeviceFeatures(capabilities.physicalDevice, &capabilities.features);
+		vkGetPhysicalDeviceMemoryProperties(capabilities.physicalDevice, &capabilities.memoryProperties);
+
+		uint32_t extensionCount{ 0 };
+		vkEnumerateDeviceExtensionProperties(capabilities.physicalDevice, nullptr, &extensionCount, nullptr);
+
+		std::vector<VkExtensionProperties> availableExtensions(extensionCount);
+		vkEnumerateDeviceExtensionProperties(capabilities.physicalDevice, nullptr, &extensionCount, availableExtensions.data());
+
+		for (const auto& extension : availableExtensions)
+			capabilities.extensions.insert(extension.extensionName);
+
+		uint32_t queueFamilyCount{ 0 };
+		vkGetPhysicalDeviceQueueFamilyProperties(capabilities.physicalDevice, &queueFamilyCount, nullptr);
+
+		capabilities.queueFamilies.resize(queueFamilyCount);
+		vkGetPhysicalDeviceQueueFamilyProperties(capabilities.physicalDevice, &queueFamilyCount, capabilities.queueFamilies.data());
+	}
+
+	static void probeSurface(DeviceCapabilities& capabilities, VkSurfaceKHR surface)
+	{
+		capabilities.presentSupport.resize(capabilities.queueFamilies.size());
+		for (uint32_t i{ 0 }; i < capabilities.queueFamilies.size(); ++i)
+			vkGetPhysicalDeviceSurfaceSupportKHR(capabilities.physicalDevice, i, surface, &capabilities.presentSupport[i]);
+
+		uint32_t formatCount{ 0 };
+		vkGetPhysicalDeviceSurfaceFormatsKHR(capabilities.physicalDevice, surface, &formatCount, nullptr);
+		capabilities.surfaceFormats.resize(formatCount);
+		vkGetPhysicalDeviceSurfaceFormatsKHR(capabilities.physicalDevice, surface, &formatCount, capabilities.surfaceFormats.data());
+
+		uint32_t presentModeCount{ 0 };
+		vkGetPhysicalDeviceSurfacePresentModesKHR(capabilities.physicalDevice, surface, &presentModeCount, nullptr);
+		capabilities.presentModes.resize(presentModeCount);
+		vkGetPhysicalDeviceSurfacePresentModesKHR(capabilities.physicalDevice, surface, &presentModeCount, capabilities.presentModes.data());
+	}
+
+	static void appendBytes(std::vector<char>& data, const void* bytes, size_t size)
+	{
+		const auto* begin{ static_cast<const char*>(bytes) };
+		data.insert(data.end(), begin, begin + size);
+	}
+
+	static void appendEntry(std::vector<char>& data, const DeviceCapabilities& capabilities)
+	{
+		DeviceCapabilityEntryHeader entry{
+			.vendorID{ capabilities.properties.vendorID },
+			.deviceID{ capabilities.properties.deviceID },
+			.driverVersion{ capabilities.properties.driverVersion },
+			.apiVersion{ capabilities.properties.apiVersion },
+			.queueFamilyCount{ static_cast<uint32_t>(capabilities.queueFamilies.size()) },
+			.extensionCount{ static_cast<uint32_t>(capabilities.extensions.size()) }
+		};
+		std::memcpy(entry.pipelineCacheUUID, capabilities.properties.pipelineCacheUUID, VK_UUID_SIZE);
+
+		for (const auto& extension : capabilities.extensions)
+			entry.extensionBytes += extension.size() + 1;
+
+		appendBytes(data, &entry, sizeof(entry));
+		appendBytes(data, &capabilities.features, sizeof(capabilities.features));
+		appendBytes(data, &capabilities.memoryProperties, sizeof(capabilities.memoryProperties));
+		appendBytes(data, capabilities.queueFamilies.data(), capabilities.queueFamilies.size() * sizeof(VkQueueFamilyProperties));
+
+		for (const auto& extension : capabilities.extensions)
+			appendBytes(data, extension.c_str(), extension.size() + 1);
+	}
+
+	void loadEntries()
+	{
+		std::ifstream file(path, std::ios::ate | std::ios::binary);
+		if (!file.is_open())
+			return;
+
+		size_t fileSize{ static_cast<size_t>(file.tellg()) };
+		file.seekg(0);
+
+		DeviceCapabilityFileHeader header{};
+		if (fileSize < sizeof(header) || !file.read(reinterpret_cast<char*>(&header), sizeof(header)))
+			return reject("file is truncated");
+
+		if (header.magic != fileMagic || header.fileVersion != fileVersion)
+			return reject("unknown file format");
+
+		if (header.dataSize != fileSize - sizeof(header))
+			return reject("size mismatch");
+
+		std::vector<char> data(static_cast<size_t>(header.dataSize));
+		if (!file.read(data.data(), static_cast<std::streamsize>(data.size())))
+			return reject("failed to read data");
+
+		if (hashBytes(data.data(), data.size()) != header.dataHash)
+			return reject("data hash mismatch");
+
+		// The hash already rules out corruption; the bounds checks guard against a writer bug turning into a crash.
+		size_t offset{ 0 };
+		for (uint32_t i{ 0 }; i < header.entryCount; ++i)
+		{
+			DeviceCapabilityEntryHeader entry{};
+			if (data.size() - offset < sizeof(entry))
+				return reject("entry is truncated");
+
+			std::memcpy(&entry, data.data() + offset, sizeof(entry));
+			offset += sizeof(entry);
+
+			StoredEntry stored{};
+			if (data.size() - offset < sizeof(stored.features) + sizeof(stored.memoryProperties))
+				return reject("entry is truncated");
+
+			std::memcpy(&stored.features, data.data() + offset, sizeof(stored.features));
+			offset += sizeof(stored.features);
+			std::memcpy(&stored.memoryProperties, data.data() + offset, sizeof(stored.memoryProperties));
+			offset += sizeof(stored.memoryProperties);
+
+			size_t queueFamilyBytes{ static_cast<size_t>(entry.queueFamilyCount) * sizeof(VkQueueFamilyProperties) };
+			if (data.size() - offset < queueFamilyBytes || data.size() - offset - queueFamilyBytes < entry.extensionBytes)
+				return reject("entry is truncated");
+
+			stored.queueFamilies.resize(entry.queueFamilyCount);
+			std::memcpy(stored.queueFamilies.data(), data.data() + offset, queueFamilyBytes);
+			offset += queueFamilyBytes;
+
+			const char* names{ data.data() + offset };
+			const char* namesEnd{ names + entry.extensionBytes };
+			if (entry.extensionBytes > 0 && namesEnd[-1] != '\0')
+				return reject("extension names are not terminated");
+
+			for (const char* name{ names }; name < namesEnd; name += std::strlen(name) + 1)
+				stored.extensions.insert(name);
+			offset += static_cast<size_t>(entry.extensionBytes);
+
+			if (stored.extensions.size() != entry.extensionCount)
+				return reject("extension count mismatch");
+
+			storedEntries[entryKey(entry.vendorID, entry.deviceID, entry.driverVersion, entry.apiVersion, entry.pipelineCacheUUID)]
+				= std::move(stored);
+		}
+	}
+
+	void reject(const char* reason)
+	{
+		storedEntries.clear();
+		std::cout << "Ignoring device capabilities at " << path << ": " << reason << "\n\n";
+	}
+};
@@ -0,0 +1,315 @@
+#pragma once
+#include <vulkan/vulkan.h>
+
+#include "DeviceCapabilities.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cstdint>
+#include <iomanip>
+#include <iostream>
+#include <optional>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+
+struct QueueFamilyIndices
+{
+	std::optional<uint32_t> graphicsFamily{};
+	std::optional<uint32_t> presentFamily{};
+	// A compute family without graphics when the device has one, otherwise the graphics family.
+	std::optional<uint32_t> computeFamily{};
+	// A transfer-only family when the device has one, otherwise the graphics family.
+	std::optional<uint32_t> transferFamily{};
+
+	bool isComplete()
+	{
+		return graphicsFamily.has_value() && presentFamily.has_value();
+	}
+};
+
+// Present support is only known for devices queried with a surface, so headless runs never get a present family.
+inline QueueFamilyIndices findQueueFamilies(const DeviceCapabilities& capabilities)
+{
+	QueueFamilyIndices indices{};
+
+	uint32_t index{ 0 };
+	for (const auto& queueFamily : capabilities.queueFamilies)
+	{
+		if ((queueFamily.queueFlags & VK_QUEUE_GRAPHICS_BIT) && !indices.graphicsFamily.has_value())
+			indices.graphicsFamily = index;
+
+		// Compute without graphics runs asynchronously to the graphics queue on most hardware.
+		bool computeOnly{ (queueFamily.queueFlags & VK_QUEUE_COMPUTE_BIT) && !(queueFamily.queueFlags & VK_QUEUE_GRAPHICS_BIT) };
+		if (computeOnly && !indices.computeFamily.has_value())
+			indices.computeFamily = index;
+
+		// Families that can transfer but neither draw nor dispatch are usually backed by the copy engines.
+		bool transferOnly{ (queueFamily.queueFlags & VK_QUEUE_TRANSFER_BIT)
+			&& !(queueFamily.queueFlags & (VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT)) };
+		if (transferOnly && !indices.transferFamily.has_value())
+			indices.transferFamily = index;
+
+		if (index < capabilities.presentSupport.size() && capabilities.presentSupport[index] && !indices.presentFamily.has_value())
+			indices.presentFamily = index;
+
+		++index;
+	}
+
+	// Graphics families always support compute and transfers, so those fall back to it when there is no dedicated family.
+	if (!indices.computeFamily.has_value())
+		indices.computeFamily = indices.graphicsFamily;
+	if (!indices.transferFamily.has_value())
+		indices.transferFamily = indices.graphicsFamily;
+
+	return indices;
+}
+
+// What a device must offer to run at all. Everything else only affects its score.
+struct DeviceRequirements
+{
+	uint32_t minApiVersion{ VK_API_VERSION_1_2 };
+	std::vector<const char*> extensions{};
+	bool presentation{ true };
+};
+
+struct DeviceRanking
+{
+	const DeviceCapabilities* device{};
+	// Empty when the device meets the requirements.
+	std::string rejection{};
+	int64_t score{ 0 };
+	// Short "+points reason" notes, so the log shows why one device beat another.
+	std::vector<std::string> notes{};
+
+	bool suitable() const { return rejection.empty(); }
+};
+
+inline const char* toString(VkPhysicalDeviceType type)
+{
+	switch (type)
+	{
+	case VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU: return "discrete";
+	case VK_PHYSICAL_DEVICE_TYPE_INTEGRATED_GPU: return "integrated";
+	case VK_PHYSICAL_DEVICE_TYPE_VIRTUAL_GPU: return "virtual";
+	case VK_PHYSICAL_DEVICE_TYPE_CPU: return "cpu";
+	default: return "other";
+	}
+}
+
+inline std::string formatUUID(const uint8_t (&uuid)[VK_UUID_SIZE])
+{
+	std::ostringstream text{};
+	text << std::hex << std::setfill('0');
+
+	for (uint32_t i{ 0 }; i < VK_UUID_SIZE; ++i)
+	{
+		if (i == 4 || i == 6 || i == 8 || i == 10)
+			text << '-';
+		text << std::setw(2) << static_cast<uint32_t>(uuid[i]);
+	}
+
+	return text.str();
+}
+
+inline VkDeviceSize deviceLocalHeapSize(const VkPhysicalDeviceMemoryProperties& memoryProperties)
+{
+	VkDeviceSize largest{ 0 };
+	for (uint32_t i{ 0 }; i < memoryProperties.memoryHeapCount; ++i)
+		if (memoryProperties.memoryHeaps[i].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT)
+			largest = std::max(largest, memoryProperties.memoryHeaps[i].size);
+
+	return largest;
+}
+
+inline std::string checkRequirements(const DeviceCapabilities& device, const DeviceRequirements& requirements)
+{
+	if (device.properties.apiVersion < requirements.minApiVersion)
+		return "Vulkan " + std::to_string(VK_API_VERSION_MAJOR(device.properties.apiVersion)) + '.'
+			+ std::to_string(VK_API_VERSION_MINOR(device.properties.apiVersion)) + " is too old";
+
+	for (const char* extension : requirements.extensions)
+		if (!device.hasExtension(extension))
+			return std::string{ "missing " } + extension;
+
+	QueueFamilyIndices indices{ findQueueFamilies(device) };
+	if (!indices.graphicsFamily.has_value())
+		return "no graphics queue";
+
+	if (requirements.presentation)
+	{
+		if (!indices.presentFamily.has_value())
+			return "cannot present to the window";
+
+		if (device.surfaceFormats.empty() || device.presentModes.empty())
+			return "no surface formats or present modes";
+	}
+
+	return {};
+}
+
+// Weights are in rough "how much faster will this run" units. The device type dominates, since a discrete GPU with
+// little memory still beats an integrated one; the rest separates devices of the same type.
+inline int64_t scoreDevice(const DeviceCapabilities& device, std::vector<std::string>& notes)
+{
+	int64_t score{ 0 };
+
+	auto award = [&](int64_t points, const std::string& reason)
+	{
+		score += points;
+		notes.push_back('+' + std::to_string(points) + ' ' + reason);
+	};
+
+	switch (device.properties.deviceType)
+	{
+	case VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU: award(10000, "discrete"); break;
+	case VK_PHYSICAL_DEVICE_TYPE_INTEGRATED_GPU: award(4000, "integrated"); break;
+	case VK_PHYSICAL_DEVICE_TYPE_VIRTUAL_GPU: award(2000, "virtual"); break;
+	case VK_PHYSICAL_DEVICE_TYPE_CPU: award(100, "cpu"); break;
+	default: award(500, "other"); break;
+	}
+
+	// Capped so a huge integrated heap (which is system memory) cannot make up for the device type.
+	constexpr VkDeviceSize gib{ 1024ull * 1024 * 1024 };
+	VkDeviceSize heapGiB{ std::min<VkDeviceSize>(deviceLocalHeapSize(device.memoryProperties) / gib, 16) };
+	if (heapGiB > 0)
+		award(static_cast<int64_t>(heapGiB) * 150, std::to_string(heapGiB) + " GiB device-local");
+
+	bool dedicatedCompute{ false };
+	bool dedicatedTransfer{ false };
+	for (const auto& queueFamily : device.queueFamilies)
+	{
+		if ((queueFamily.queueFlags & VK_QUEUE_COMPUTE_BIT) && !(queueFamily.queueFlags & VK_QUEUE_GRAPHICS_BIT))
+			dedicatedCompute = true;
+
+		if ((queueFamily.queueFlags & VK_QUEUE_TRANSFER_BIT)
+			&& !(queueFamily.queueFlags & (VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT)))
+			dedicatedTransfer = true;
+	}
+
+	if (dedicatedCompute)
+		award(500, "async compute queue");
+	if (dedicatedTransfer)
+		award(500, "transfer queue");
+
+	const VkPhysicalDeviceLimits& limits{ device.properties.limits };
+	if (limits.maxImageDimension2D >= 16384)
+		award(200, "16K images");
+	if (limits.maxComputeWorkGroupInvocations >= 1024)
+		award(100, "1024-wide workgroups");
+	if (limits.timestampComputeAndGraphics)
+		award(100, "timestamps");
+
+	if (device.features.multiDrawIndirect && limits.maxDrawIndirectCount > 1)
+		award(300, "multi-draw indirect");
+	if (device.features.drawIndirectFirstInstance)
+		award(100, "indirect first instance");
+	if (device.features.samplerAnisotropy)
+		award(50, "anisotropy");
+
+	if (device.hasExtension(VK_EXT_CALIBRATED_TIMESTAMPS_EXTENSION_NAME))
+		award(50, "calibrated timestamps");
+	if (device.hasExtension(VK_EXT_PIPELINE_CREATION_FEEDBACK_EXTENSION_NAME))
+		award(50, "pipeline feedback");
+
+	return score;
+}
+
+// Suitable devices first, best score first; ties keep the enumeration order.
+inline std::vector<DeviceRanking> rankDevices(const std::vector<const DeviceCapabilities*>& devices, const DeviceRequirements& requirements)
+{
+	std::vector<DeviceRanking> rankings{};
+	rankings.reserve(devices.size());
+
+	for (const DeviceCapabilities* device : devices)
+	{
+		DeviceRanking ranking{ .device{ device }, .rejection{ checkRequirements(*device, requirements) } };
+
+		if (ranking.suitable())
+			ranking.score = scoreDevice(*device, ranking.notes);
+
+		rankings.push_back(std::move(ranking));
+	}
+
+	std::stable_sort(rankings.begin(), rankings.end(), [](const DeviceRanking& a, const DeviceRanking& b)
+		{
+			if (a.suitable() != b.suitable())
+				return a.suitable();
+
+			return a.score > b.score;
+		});
+
+	return rankings;
+}
+
+inline std::string toLower(std::string text)
+{
+	std::transform(text.begin(), text.end(), text.begin(), [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+	return text;
+}
+
+// A full device UUID (with or without dashes) or a case-insensitive part of the device name.
+inline bool matchesDeviceOverride(const DeviceCapabilities& device, const std::string& selection)
+{
+	std::string wanted{ toLower(selection) };
+
+	std::string uuid{ formatUUID(device.deviceUUID) };
+	std::string undashedUUID{ uuid };
+	std::erase(undashedUUID, '-');
+
+	if (wanted == uuid || wanted == undashedUUID)
+		return true;
+
+	return toLower(device.properties.deviceName).find(wanted) != std::string::npos;
+}
+
+inline void printDeviceRanking(const std::vector<DeviceRanking>& rankings, const DeviceRanking* selected)
+{
+	std::cout << "Physical devices:\n";
+
+	for (const auto& ranking : rankings)
+	{
+		const DeviceCapabilities& device{ *ranking.device };
+
+		std::cout << (&ranking == selected ? "  * " : "    ") << device.properties.deviceName
+			<< " (" << toString(device.properties.deviceType) << ", " << formatUUID(device.deviceUUID) << "): ";
+
+		if (!ranking.suitable())
+		{
+			std::cout << "unsuitable, " << ranking.rejection << '\n';
+			continue;
+		}
+
+		std::cout << ranking.score << " [";
+		for (size_t i{ 0 }; i < ranking.notes.size(); ++i)
+			std::cout << (i > 0 ? ", " : "") << ranking.notes[i];
+		std::cout << "]\n";
+	}
+
+	std::cout << '\n';
+}
+
+// The best suitable device, or the best suitable one matching `selection` when it is not empty.
+inline const DeviceRanking& selectDevice(const std::vector<DeviceRanking>& rankings, const std::string& selection)
+{
+	for (const auto& ranking : rankings)
+	{
+		if (!selection.empty() && !matchesDeviceOverride(*ranking.device, selection))
+			continue;
+
+		if (ranking.suitable())
+			return ranking;
+
+		// Suitable devices sort first, so no suitable one matches the selection either.
+		if (!selection.empty())
+			throw std::runtime_error(std::string{ "The requested device " } + ranking.device->properties.deviceName
+				+ " is not suitable: " + ranking.rejection);
+	}
+
+	if (!selection.empty())
+		throw std::runtime_error("No device matches --device " + selection);
+
+	throw std::runtime_error("Failed to find a suitable GPU!");
+}
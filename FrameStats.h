@@ -0,0 +1,81 @@
+#pragma once
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <iomanip>
+#include <iostream>
+
+
+// CPU-side timings of one frame. Everything spent in fenceWait/acquireWait is time the CPU sat idle
+// waiting for the GPU or the presentation engine.
+struct FrameTimings
+{
+	double fenceWaitMs{};
+	double acquireWaitMs{};
+	double recordSubmitMs{};
+	double frameMs{};
+	// GPU time of the frame's command buffer; arrives a few frames late, 0 when no result came back this frame.
+	double gpuMs{};
+};
+
+class FrameStats
+{
+public:
+	void add(const FrameTimings& timings)
+	{
+		last = timings;
+
+		++frameCount;
+		totalFenceWaitMs += timings.fenceWaitMs;
+		totalAcquireWaitMs += timings.acquireWaitMs;
+		totalRecordSubmitMs += timings.recordSubmitMs;
+		totalFrameMs += timings.frameMs;
+		if (timings.gpuMs > 0.0)
+		{
+			totalGpuMs += timings.gpuMs;
+			++gpuFrameCount;
+		}
+		maxCpuWaitMs = std::max(maxCpuWaitMs, timings.fenceWaitMs + timings.acquireWaitMs);
+	}
+
+	const FrameTimings& lastFrame() const { return last; }
+
+	// Prints once per reportInterval and starts a new window.
+	void reportPeriodically()
+	{
+		auto now{ std::chrono::steady_clock::now() };
+		if (now - windowStart < reportInterval || frameCount == 0)
+			return;
+
+		double windowSeconds{ std::chrono::duration<double>(now - windowStart).count() };
+		double averageWaitMs{ (totalFenceWaitMs + totalAcquireWaitMs) / frameCount };
+		double averageFrameMs{ totalFrameMs / frameCount };
+		double waitShare{ averageFrameMs > 0.0 ? averageWaitMs / averageFrameMs : 0.0 };
+
+		std::cout << std::fixed << std::setprecision(2)
+			<< frameCount / windowSeconds << " fps | frame " << averageFrameMs << " ms"
+			<< " | cpu wait " << averageWaitMs << " ms (fence " << totalFenceWaitMs / frameCount
+			<< ", acquire " << totalAcquireWaitMs / frameCount << ", max " << maxCpuWaitMs << ')'
+			<< " | record+submit " << totalRecordSubmitMs / frameCount << " ms"
+			<< " | gpu " << (gpuFrameCount > 0 ? totalGpuMs / gpuFrameCount : 0.0) << " ms"
+			<< " | " << (waitShare > 0.5 ? "GPU-bound" : "CPU-bound")
+			<< std::defaultfloat << '\n';
+
+		*this = FrameStats{};
+		windowStart = now;
+	}
+
+private:
+	static constexpr std::chrono::seconds reportInterval{ 1 };
+
+	std::chrono::steady_clock::time_point windowStart{ std::chrono::steady_clock::now() };
+	FrameTimings last{};
+	uint32_t frameCount{ 0 };
+	double totalFenceWaitMs{ 0.0 };
+	double totalAcquireWaitMs{ 0.0 };
+	double totalRecordSubmitMs{ 0.0 };
+	double totalFrameMs{ 0.0 };
+	double maxCpuWaitMs{ 0.0 };
+	double totalGpuMs{ 0.0 };
+	uint32_t gpuFrameCount{ 0 };
+};
@@ -0,0 +1,63 @@
+#pragma once
+#include "MeshData.h"
+
+#include <glm/glm.hpp>
+
+#include <array>
+
+
+// Inward-facing planes of a view-projection's clip volume, in the space the matrix maps from: a point p is inside
+// when dot(plane.xyz, p) + plane.w >= 0 for all six. The planes are normalized, so that expression is a distance.
+// Order: left, right, top, bottom, near, far.
+struct Frustum
+{
+	std::array<glm::vec4, 6> planes{};
+};
+
+// Axis-aligned box as center and half extent, which is what the plane tests take.
+struct BoundingBox
+{
+	glm::vec3 center{ 0.0f };
+	glm::vec3 halfExtent{ 0.0f };
+};
+
+// Vulkan clip space: -w <= x <= w, -w <= y <= w and 0 <= z <= w, each side one row combination.
+inline Frustum extractFrustum(const glm::mat4& viewProjection)
+{
+	// glm indexes columns; the planes are combinations of the rows.
+	glm::mat4 rows{ glm::transpose(viewProjection) };
+
+	Frustum frustum{
+		.planes{ rows[3] + rows[0], rows[3] - rows[0], rows[3] + rows[1], rows[3] - rows[1], rows[2], rows[3] - rows[2] }
+	};
+
+	for (auto& plane : frustum.planes)
+		plane /= glm::length(glm::vec3{ plane });
+
+	return frustum;
+}
+
+// The smallest axis-aligned box around the transformed bounds.
+inline BoundingBox transformBounds(const MeshBounds& bounds, const glm::mat4& transform)
+{
+	glm::mat3 absolute{ glm::abs(glm::vec3{ transform[0] }), glm::abs(glm::vec3{ transform[1] }), glm::abs(glm::vec3{ transform[2] }) };
+
+	return {
+		.center{ glm::vec3{ transform * glm::vec4{ bounds.center(), 1.0f } } },
+		.halfExtent{ absolute * (bounds.extent() * 0.5f) }
+	};
+}
+
+// Tests the box corner furthest along each plane's normal. Conservative: a box outside the frustum but straddling
+// two of its planes near an edge still passes, which only costs a draw.
+inline bool intersects(const Frustum& frustum, const BoundingBox& box)
+{
+	for (const auto& plane : frustum.planes)
+	{
+		glm::vec3 normal{ plane };
+		if (glm::dot(normal, box.center) + glm::dot(glm::abs(normal), box.halfExtent) + plane.w < 0.0f)
+			return false;
+	}
+
+	return true;
+}
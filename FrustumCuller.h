@@ -0,0 +1,193 @@
+#pragma once
+#include "CpuProfiler.h"
+#include "Frustum.h"
+#include "ThreadPool.h"
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <future>
+#include <vector>
+
+
+// Ranges below this are culled on the calling thread; splitting them costs more than it saves.
+constexpr uint32_t minBoxesPerTask{ 32768 };
+
+// Bounding boxes stored structure-of-arrays, so one SIMD load brings in the same component of 4 or 8 boxes.
+struct BoundingBoxes
+{
+	std::vector<float> centerX{};
+	std::vector<float> centerY{};
+	std::vector<float> centerZ{};
+	std::vector<float> halfExtentX{};
+	std::vector<float> halfExtentY{};
+	std::vector<float> halfExtentZ{};
+
+	uint32_t size() const { return static_cast<uint32_t>(centerX.size()); }
+
+	void reserve(size_t count)
+	{
+		for (auto* component : { &centerX, &centerY, &centerZ, &halfExtentX, &halfExtentY, &halfExtentZ })
+			component->reserve(count);
+	}
+
+	void push_back(const BoundingBox& box)
+	{
+		centerX.push_back(box.center.x);
+		centerY.push_back(box.center.y);
+		centerZ.push_back(box.center.z);
+		halfExtentX.push_back(box.halfExtent.x);
+		halfExtentY.push_back(box.halfExtent.y);
+		halfExtentZ.push_back(box.halfExtent.z);
+	}
+
+	BoundingBox operator[](uint32_t index) const
+	{
+		return {
+			.center{ centerX[index], centerY[index], centerZ[index] },
+			.halfExtent{ halfExtentX[index], halfExtentY[index], halfExtentZ[index] }
+		};
+	}
+};
+
+// The widest vector GLM's arch detection allows: AVX (8 boxes) when building with /arch:AVX or higher, SSE2
+// (4 boxes) otherwise, and the scalar test from Frustum.h where neither exists.
+#if GLM_ARCH & GLM_ARCH_AVX_BIT
+struct CullLanes
+{
+	using Vector = __m256;
+	static constexpr uint32_t width{ 8 };
+
+	static Vector load(const float* values) { return _mm256_loadu_ps(values); }
+	static Vector broadcast(float value) { return _mm256_set1_ps(value); }
+	static Vector add(Vector a, Vector b) { return _mm256_add_ps(a, b); }
+	static Vector multiply(Vector a, Vector b) { return _mm256_mul_ps(a, b); }
+	static Vector allSet() { return _mm256_castsi256_ps(_mm256_set1_epi32(-1)); }
+	static Vector insideAnd(Vector inside, Vector distance) { return _mm256_and_ps(inside, _mm256_cmp_ps(distance, _mm256_setzero_ps(), _CMP_GE_OQ)); }
+	static uint32_t mask(Vector inside) { return static_cast<uint32_t>(_mm256_movemask_ps(inside)); }
+};
+#elif GLM_ARCH & GLM_ARCH_SSE2_BIT
+struct CullLanes
+{
+	using Vector = __m128;
+	static constexpr uint32_t width{ 4 };
+
+	static Vector load(const float* values) { return _mm_loadu_ps(values); }
+	static Vector broadcast(float value) { return _mm_set1_ps(value); }
+	static Vector add(Vector a, Vector b) { return _mm_add_ps(a, b); }
+	static Vector multiply(Vector a, Vector b) { return _mm_mul_ps(a, b); }
+	static Vector allSet() { return _mm_castsi128_ps(_mm_set1_epi32(-1)); }
+	static Vector insideAnd(Vector inside, Vector distance) { return _mm_and_ps(inside, _mm_cmpge_ps(distance, _mm_setzero_ps())); }
+	static uint32_t mask(Vector inside) { return static_cast<uint32_t>(_mm_movemask_ps(inside)); }
+};
+#endif
+
+inline const char* cullSimdPath()
+{
+#if GLM_ARCH & GLM_ARCH_AVX_BIT
+	return "AVX, 8 boxes per step";
+#elif GLM_ARCH & GLM_ARCH_SSE2_BIT
+	return "SSE2, 4 boxes per step";
+#else
+	return "scalar";
+#endif
+}
+
+// Writes the indices of the boxes in [begin, end) that intersect the frustum to `visible`, in order, and returns how
+// many there were. `visible` must have room for end - begin indices. Gives exactly the results of intersects(): the
+// distances are summed in the same order.
+inline uint32_t cullBoxes(const Frustum& frustum, const BoundingBoxes& boxes, uint32_t begin, uint32_t end, uint32_t* visible)
+{
+	uint32_t visibleCount{ 0 };
+	uint32_t i{ begin };
+
+#if GLM_ARCH & GLM_ARCH_SSE2_BIT
+	using Lanes = CullLanes;
+
+	struct PlaneLanes
+	{
+		Lanes::Vector normalX, normalY, normalZ, absX, absY, absZ, distance;
+	};
+
+	std::array<PlaneLanes, 6> planes{};
+	for (size_t p{ 0 }; p < planes.size(); ++p)
+	{
+		const glm::vec4& plane{ frustum.planes[p] };
+		planes[p] = {
+			Lanes::broadcast(plane.x), Lanes::broadcast(plane.y), Lanes::broadcast(plane.z),
+			Lanes::broadcast(std::abs(plane.x)), Lanes::broadcast(std::abs(plane.y)), Lanes::broadcast(std::abs(plane.z)),
+			Lanes::broadcast(plane.w)
+		};
+	}
+
+	for (; i + Lanes::width <= end; i += Lanes::width)
+	{
+		Lanes::Vector centerX{ Lanes::load(&boxes.centerX[i]) };
+		Lanes::Vector centerY{ Lanes::load(&boxes.centerY[i]) };
+		Lanes::Vector centerZ{ Lanes::load(&boxes.centerZ[i]) };
+		Lanes::Vector halfExtentX{ Lanes::load(&boxes.halfExtentX[i]) };
+		Lanes::Vector halfExtentY{ Lanes::load(&boxes.halfExtentY[i]) };
+		Lanes::Vector halfExtentZ{ Lanes::load(&boxes.halfExtentZ[i]) };
+
+		Lanes::Vector inside{ Lanes::allSet() };
+		for (const auto& plane : planes)
+		{
+			Lanes::Vector center{ Lanes::add(Lanes::add(Lanes::multiply(plane.normalX, centerX), Lanes::multiply(plane.normalY, centerY)),
+				Lanes::multiply(plane.normalZ, centerZ)) };
+			Lanes::Vector extent{ Lanes::add(Lanes::add(Lanes::multiply(plane.absX, halfExtentX), Lanes::multiply(plane.absY, halfExtentY)),
+				Lanes::multiply(plane.absZ, halfExtentZ)) };
+			inside = Lanes::insideAnd(inside, Lanes::add(Lanes::add(center, extent), plane.distance));
+		}
+
+		for (uint32_t mask{ Lanes::mask(inside) }; mask != 0; mask &= mask - 1)
+			visible[visibleCount++] = i + static_cast<uint32_t>(std::countr_zero(mask));
+	}
+#endif
+
+	for (; i < end; ++i)
+		if (intersects(frustum, boxes[i]))
+			visible[visibleCount++] = i;
+
+	return visibleCount;
+}
+
+// Splits the boxes into one range per worker plus one for the caller. Every range writes to its own part of
+// `visible`, and the parts are then moved together, so the result is the same index list cullBoxes gives.
+inline void cullBoxesParallel(ThreadPool& threadPool, const Frustum& frustum, const BoundingBoxes& boxes, std::vector<uint32_t>& visible)
+{
+	PROFILE_FUNCTION();
+
+	uint32_t boxCount{ boxes.size() };
+	visible.resize(boxCount);
+
+	uint32_t taskCount{ std::clamp(boxCount / minBoxesPerTask, 1u, threadPool.threadCount() + 1) };
+	uint32_t perTask{ (boxCount + taskCount - 1) / taskCount };
+
+	// The caller takes the first range instead of idling until the workers are done.
+	std::vector<std::future<uint32_t>> tasks{};
+	for (uint32_t begin{ perTask }; begin < boxCount; begin += perTask)
+	{
+		uint32_t end{ std::min(begin + perTask, boxCount) };
+		tasks.push_back(threadPool.submit([&frustum, &boxes, &visible, begin, end] {
+			return cullBoxes(frustum, boxes, begin, end, visible.data() + begin);
+		}));
+	}
+
+	uint32_t visibleCount{ cullBoxes(frustum, boxes, 0, std::min(perTask, boxCount), visible.data()) };
+
+	uint32_t begin{ perTask };
+	for (auto& task : tasks)
+	{
+		uint32_t count{ task.get() };
+		std::memmove(visible.data() + visibleCount, visible.data() + begin, count * sizeof(uint32_t));
+		visibleCount += count;
+		begin += perTask;
+	}
+
+	visible.resize(visibleCount);
+}
@@ -0,0 +1,331 @@
+#pragma once
+#include <vulkan/vulkan.h>
+
+#include "CpuProfiler.h"
+#include "DescriptorAllocator.h"
+#include "DeviceAllocator.h"
+#include "Frustum.h"
+#include "UploadQueue.h"
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <iomanip>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+
+constexpr uint32_t cullWorkgroupSize{ 64 };
+
+// std430 layouts of shaders/cull.comp's storage buffers.
+struct GpuObjectBounds
+{
+	// w is unused.
+	glm::vec4 center{ 0.0f };
+	glm::vec4 halfExtent{ 0.0f };
+};
+
+// The index range an object draws; becomes its VkDrawIndexedIndirectCommand when it survives culling.
+struct GpuDrawRecord
+{
+	uint32_t indexCount{};
+	uint32_t firstIndex{};
+	int32_t vertexOffset{};
+	uint32_t reserved{};
+};
+
+// std140 layout of the culling pass's uniform block.
+struct CullConstants
+{
+	std::array<glm::vec4, 6> planes{};
+	uint32_t objectCount{};
+	uint32_t reserved[3]{};
+};
+
+// Static objects: one transform, bounding box and draw record each, all indexed by the object's position.
+struct GpuScene
+{
+	std::vector<glm::mat4> transforms{};
+	std::vector<GpuObjectBounds> bounds{};
+	std::vector<GpuDrawRecord> draws{};
+};
+
+// GPU-driven drawing of a static scene. The objects' transforms, bounds and draw records are uploaded once into
+// device-local storage buffers. Each frame a compute pass tests every object against the frustum and appends a
+// VkDrawIndexedIndirectCommand for the visible ones, with firstInstance set to the object's index so the vertex
+// shader finds its transform through gl_InstanceIndex. The graphics pass then draws them all with one
+// vkCmdDrawIndexedIndirectCount. The CPU records the same handful of commands whatever the object count.
+//
+// The pass runs on the compute queue, so it overlaps the tail of the previous frame's graphics work. When the compute
+// queue is in another family the slot's indirect region is released after the pass and acquired before the draw.
+// The next cull of the slot overwrites the region, so ownership never has to go back to the compute family.
+//
+// Without drawIndirectCount the draw falls back to vkCmdDrawIndexedIndirect over every slot. The command region is
+// cleared first, so the slots past the visible count are draws with no instances.
+class GpuCuller
+{
+public:
+	void create(DeviceAllocator& deviceAllocator, UploadQueue& uploadQueue, const GpuScene& scene, uint32_t framesInFlight,
+		VkDeviceSize minStorageBufferOffsetAlignment, uint32_t maxWorkgroupCount, bool drawCountSupported,
+		uint32_t cullQueueFamily, uint32_t drawQueueFamily)
+	{
+		PROFILE_FUNCTION();
+
+		allocator = &deviceAllocator;
+		objectCount = static_cast<uint32_t>(scene.transforms.size());
+		useDrawCount = drawCountSupported;
+		cullFamily = cullQueueFamily;
+		drawFamily = drawQueueFamily;
+
+		if (scene.bounds.size() != objectCount || scene.draws.size() != objectCount)
+			throw std::runtime_error("The GPU scene needs bounds and a draw record for every transform!");
+
+		if ((objectCount + cullWorkgroupSize - 1) / cullWorkgroupSize > maxWorkgroupCount)
+			throw std::runtime_error("The GPU scene has more objects than one culling dispatch can cover!");
+
+		transforms = createStorageBuffer(uploadQueue, scene.transforms.data(), objectCount * sizeof(glm::mat4),
+			VK_PIPELINE_STAGE_VERTEX_SHADER_BIT, UploadConsumer::Graphics);
+		bounds = createStorageBuffer(uploadQueue, scene.bounds.data(), objectCount * sizeof(GpuObjectBounds),
+			VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, UploadConsumer::Compute);
+		draws = createStorageBuffer(uploadQueue, scene.draws.data(), objectCount * sizeof(GpuDrawRecord),
+			VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, UploadConsumer::Compute);
+
+		// Per frame slot: the visible count followed by the commands, so slots in flight never share a command.
+		indirectSize = indirectHeaderSize + static_cast<VkDeviceSize>(objectCount) * sizeof(VkDrawIndexedIndirectCommand);
+		indirectStride = (indirectSize + minStorageBufferOffsetAlignment - 1) / minStorageBufferOffsetAlignment * minStorageBufferOffsetAlignment;
+		indirect = allocator->createBuffer(indirectStride * framesInFlight,
+			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT
+			| VK_BUFFER_USAGE_TRANSFER_DST_BIT, MemoryUsage::GpuOnly);
+
+		// The visible counts are copied back for the statistics; reading them never stalls a frame.
+		readback = allocator->createBuffer(framesInFlight * sizeof(uint32_t), VK_BUFFER_USAGE_TRANSFER_DST_BIT, MemoryUsage::GpuToCpu);
+		if (readback.allocation.mappedData == nullptr)
+			throw std::runtime_error("The culling readback buffer is not host-visible!");
+
+		readbackPending.assign(framesInFlight, false);
+	}
+
+	void destroy()
+	{
+		allocator->destroyBuffer(transforms);
+		allocator->destroyBuffer(bounds);
+		allocator->destroyBuffer(draws);
+		allocator->destroyBuffer(indirect);
+		allocator->destroyBuffer(readback);
+	}
+
+	// `cullSetLayout`: the constants (dynamic uniform buffer in `uniformBuffer`), the bounds, the draw records and the
+	// slot's indirect region (dynamic storage buffer). `objectSetLayout`: the transforms, for the vertex shader.
+	void writeDescriptors(DescriptorAllocator& descriptorAllocator, const DescriptorLayout& cullSetLayout,
+		const DescriptorLayout& objectSetLayout, VkBuffer uniformBuffer)
+	{
+		cullSet = descriptorAllocator.allocatePersistent(cullSetLayout);
+
+		std::array<DescriptorData, 4> cullData{};
+		cullData[0].buffer = { .buffer{ uniformBuffer }, .offset{ 0 }, .range{ sizeof(CullConstants) } };
+		cullData[1].buffer = { .buffer{ bounds.buffer }, .offset{ 0 }, .range{ VK_WHOLE_SIZE } };
+		cullData[2].buffer = { .buffer{ draws.buffer }, .offset{ 0 }, .range{ VK_WHOLE_SIZE } };
+		cullData[3].buffer = { .buffer{ indirect.buffer }, .offset{ 0 }, .range{ indirectSize } };
+		descriptorAllocator.write(cullSet, cullSetLayout, cullData.data());
+
+		objectSet = descriptorAllocator.allocatePersistent(objectSetLayout);
+
+		DescriptorData objectData{};
+		objectData.buffer = { .buffer{ transforms.buffer }, .offset{ 0 }, .range{ VK_WHOLE_SIZE } };
+		descriptorAllocator.write(objectSet, objectSetLayout, &objectData);
+	}
+
+	uint32_t count() const { return objectCount; }
+	VkDescriptorSet objectDescriptorSet() const { return objectSet; }
+	// Draws may only be recorded once this has been uploaded.
+	UploadTicket uploadTicket() const { return ticket; }
+
+	CullConstants constants(const glm::mat4& viewProjection) const
+	{
+		return { .planes{ extractFrustum(viewProjection).planes }, .objectCount{ objectCount } };
+	}
+
+	// Call once the slot's previous frame has completed; picks up how many objects that frame drew.
+	void collect(uint32_t frameSlot)
+	{
+		if (!readbackPending[frameSlot])
+			return;
+
+		allocator->invalidate(readback.allocation);
+		visibleTotal += static_cast<const uint32_t*>(readback.allocation.mappedData)[frameSlot];
+		++visibleSamples;
+		readbackPending[frameSlot] = false;
+	}
+
+	// On the compute queue. Leaves the slot's region ready for recordAcquire and recordDraw on the graphics queue, whose
+	// submit has to wait for this one at the draw indirect stage.
+	void recordCull(VkCommandBuffer commandBuffer, uint32_t frameSlot, VkPipeline pipeline, VkPipelineLayout layout, uint32_t constantsOffset)
+	{
+		PROFILE_FUNCTION();
+
+		auto start{ std::chrono::steady_clock::now() };
+
+		VkDeviceSize slotOffset{ frameSlot * indirectStride };
+
+		// The count variant only reads the commands below the count, so only the count needs resetting.
+		vkCmdFillBuffer(commandBuffer, indirect.buffer, slotOffset, useDrawCount ? indirectHeaderSize : indirectSize, 0);
+
+		VkBufferMemoryBarrier clearBarrier{
+			.sType{ VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER },
+			.srcAccessMask{ VK_ACCESS_TRANSFER_WRITE_BIT },
+			.dstAccessMask{ VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT },
+			.srcQueueFamilyIndex{ VK_QUEUE_FAMILY_IGNORED },
+			.dstQueueFamilyIndex{ VK_QUEUE_FAMILY_IGNORED },
+			.buffer{ indirect.buffer },
+			.offset{ slotOffset },
+			.size{ indirectSize }
+		};
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, nullptr,
+			1, &clearBarrier, 0, nullptr);
+
+		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline);
+
+		std::array<uint32_t, 2> dynamicOffsets{ constantsOffset, static_cast<uint32_t>(slotOffset) };
+		vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, layout, 0, 1, &cullSet,
+			static_cast<uint32_t>(dynamicOffsets.size()), dynamicOffsets.data());
+
+		vkCmdDispatch(commandBuffer, (objectCount + cullWorkgroupSize - 1) / cullWorkgroupSize, 1, 1);
+
+		// The draws see the commands through the semaphore the graphics submit waits on; only the copy needs a barrier here.
+		VkBufferMemoryBarrier cullBarrier{
+			.sType{ VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER },
+			.srcAccessMask{ VK_ACCESS_SHADER_WRITE_BIT },
+			.dstAccessMask{ VK_ACCESS_TRANSFER_READ_BIT },
+			.srcQueueFamilyIndex{ VK_QUEUE_FAMILY_IGNORED },
+			.dstQueueFamilyIndex{ VK_QUEUE_FAMILY_IGNORED },
+			.buffer{ indirect.buffer },
+			.offset{ slotOffset },
+			.size{ indirectSize }
+		};
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr,
+			1, &cullBarrier, 0, nullptr);
+
+		VkBufferCopy countCopy{ .srcOffset{ slotOffset }, .dstOffset{ frameSlot * sizeof(uint32_t) }, .size{ sizeof(uint32_t) } };
+		vkCmdCopyBuffer(commandBuffer, indirect.buffer, readback.buffer, 1, &countCopy);
+
+		VkBufferMemoryBarrier hostBarrier{
+			.sType{ VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER },
+			.srcAccessMask{ VK_ACCESS_TRANSFER_WRITE_BIT },
+			.dstAccessMask{ VK_ACCESS_HOST_READ_BIT },
+			.srcQueueFamilyIndex{ VK_QUEUE_FAMILY_IGNORED },
+			.dstQueueFamilyIndex{ VK_QUEUE_FAMILY_IGNORED },
+			.buffer{ readback.buffer },
+			.offset{ countCopy.dstOffset },
+			.size{ countCopy.size }
+		};
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0, 0, nullptr, 1, &hostBarrier, 0, nullptr);
+
+		if (cullFamily != drawFamily)
+		{
+			VkBufferMemoryBarrier release{ ownershipTransfer(slotOffset) };
+			release.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+			vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT,
+				VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, 0, nullptr, 1, &release, 0, nullptr);
+		}
+
+		readbackPending[frameSlot] = true;
+		recordMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	}
+
+	// On the graphics queue, outside a render pass and before recordDraw: the acquire half of the indirect region's
+	// ownership transfer. Nothing to do when both queues are in the same family.
+	void recordAcquire(VkCommandBuffer commandBuffer, uint32_t frameSlot)
+	{
+		if (cullFamily == drawFamily)
+			return;
+
+		VkBufferMemoryBarrier acquire{ ownershipTransfer(frameSlot * indirectStride) };
+		acquire.dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT;
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT, 0, 0, nullptr,
+			1, &acquire, 0, nullptr);
+	}
+
+	// Inside the render pass, with the mesh, the pipeline and the object set bound.
+	void recordDraw(VkCommandBuffer commandBuffer, uint32_t frameSlot)
+	{
+		auto start{ std::chrono::steady_clock::now() };
+
+		VkDeviceSize slotOffset{ frameSlot * indirectStride };
+
+		if (useDrawCount)
+			vkCmdDrawIndexedIndirectCount(commandBuffer, indirect.buffer, slotOffset + indirectHeaderSize, indirect.buffer, slotOffset,
+				objectCount, sizeof(VkDrawIndexedIndirectCommand));
+		else
+			vkCmdDrawIndexedIndirect(commandBuffer, indirect.buffer, slotOffset + indirectHeaderSize, objectCount,
+				sizeof(VkDrawIndexedIndirectCommand));
+
+		recordMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+		++frames;
+	}
+
+	void printStatistics(double cullGpuMs) const
+	{
+		if (frames == 0)
+			return;
+
+		std::cout << "GPU-driven: " << objectCount << " objects, " << (useDrawCount ? "vkCmdDrawIndexedIndirectCount" : "vkCmdDrawIndexedIndirect")
+			<< ", " << std::fixed << std::setprecision(1) << (visibleSamples > 0 ? visibleTotal / static_cast<double>(visibleSamples) : 0.0)
+			<< " visible on average; " << std::setprecision(3) << recordMs / frames * 1e3 << " us CPU recording and " << cullGpuMs
+			<< " ms GPU culling per frame" << std::defaultfloat << "\n\n";
+	}
+
+private:
+	// The visible count, padded so the commands after it stay 16-byte aligned.
+	static constexpr VkDeviceSize indirectHeaderSize{ 16 };
+
+	DeviceAllocator* allocator{ nullptr };
+	uint32_t objectCount{ 0 };
+	bool useDrawCount{ false };
+	uint32_t cullFamily{};
+	uint32_t drawFamily{};
+	AllocatedBuffer transforms{};
+	AllocatedBuffer bounds{};
+	AllocatedBuffer draws{};
+	AllocatedBuffer indirect{};
+	AllocatedBuffer readback{};
+	VkDeviceSize indirectSize{ 0 };
+	VkDeviceSize indirectStride{ 0 };
+	VkDescriptorSet cullSet{};
+	VkDescriptorSet objectSet{};
+	// Uploads complete in order, so the last one covers all three buffers.
+	UploadTicket ticket{ 0 };
+	std::vector<bool> readbackPending{};
+	uint64_t visibleTotal{ 0 };
+	uint64_t visibleSamples{ 0 };
+	double recordMs{ 0.0 };
+	uint64_t frames{ 0 };
+
+	AllocatedBuffer createStorageBuffer(UploadQueue& uploadQueue, const void* data, VkDeviceSize size, VkPipelineStageFlags dstStages,
+		UploadConsumer consumer)
+	{
+		AllocatedBuffer buffer{ allocator->createBuffer(size, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+			MemoryUsage::GpuOnly) };
+		ticket = uploadQueue.uploadBuffer(buffer.buffer, 0, data, size, dstStages, VK_ACCESS_SHADER_READ_BIT, consumer);
+		return buffer;
+	}
+
+	// Both halves use the same barrier apart from the access masks.
+	VkBufferMemoryBarrier ownershipTransfer(VkDeviceSize slotOffset) const
+	{
+		return {
+			.sType{ VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER },
+			.srcAccessMask{ 0 },
+			.dstAccessMask{ 0 },
+			.srcQueueFamilyIndex{ cullFamily },
+			.dstQueueFamilyIndex{ drawFamily },
+			.buffer{ indirect.buffer },
+			.offset{ slotOffset },
+			.size{ indirectSize }
+		};
+	}
+};
@@ -0,0 +1,320 @@
+#pragma once
+#include <vulkan/vulkan.h>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#endif
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <limits>
+#include <stdexcept>
+#include <vector>
+
+
+// One closed scope of a finished frame, already mapped onto the CPU's steady_clock.
+struct GpuScopeTiming
+{
+	const char* name{};
+	uint64_t frame{};
+	std::chrono::steady_clock::time_point start{};
+	std::chrono::steady_clock::time_point end{};
+
+	double milliseconds() const { return std::chrono::duration<double, std::milli>(end - start).count(); }
+};
+
+// Timestamp queries around named scopes, with one query pool per frame slot. A slot's results are read when the
+// slot comes around again, after its previous submit has been waited on, so reading them never stalls; they arrive
+// framesInFlight frames late.
+class GpuProfiler
+{
+public:
+	void create(VkInstance instance, VkPhysicalDevice physicalDevice, VkDevice dev, uint32_t queueFamily,
+		uint32_t framesInFlight, bool calibratedTimestampsEnabled)
+	{
+		device = dev;
+
+		uint32_t queueFamilyCount{ 0 };
+		vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyCount, nullptr);
+		std::vector<VkQueueFamilyProperties> queueFamilies(queueFamilyCount);
+		vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyCount, queueFamilies.data());
+
+		uint32_t validBits{ queueFamilies[queueFamily].timestampValidBits };
+		if (validBits == 0)
+		{
+			std::cout << "GPU profiler: timestamps are not supported on queue family " << queueFamily << ", disabled\n\n";
+			return;
+		}
+
+		timestampMask = validBits >= 64 ? std::numeric_limits<uint64_t>::max() : (1ull << validBits) - 1;
+
+		VkPhysicalDeviceProperties properties{};
+		vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+		nanosecondsPerTick = properties.limits.timestampPeriod;
+
+		slots.resize(framesInFlight);
+
+		VkQueryPoolCreateInfo poolInfo{
+			.sType{ VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO },
+			.queryType{ VK_QUERY_TYPE_TIMESTAMP },
+			.queryCount{ maxScopesPerFrame * 2 }
+		};
+
+		for (auto& slot : slots)
+		{
+			if (vkCreateQueryPool(device, &poolInfo, nullptr, &slot.queryPool) != VK_SUCCESS)
+				throw std::runtime_error("Failed to create a timestamp query pool!");
+
+			slot.scopes.reserve(maxScopesPerFrame);
+		}
+
+		if (calibratedTimestampsEnabled)
+			setUpCalibration(instance, physicalDevice);
+
+		std::cout << "GPU profiler: " << validBits << " valid timestamp bits, " << nanosecondsPerTick << " ns per tick, "
+			<< (getCalibratedTimestamps != nullptr ? "calibrated against the CPU clock" : "aligned to submit times") << "\n\n";
+	}
+
+	void destroy()
+	{
+		for (const auto& slot : slots)
+			vkDestroyQueryPool(device, slot.queryPool, nullptr);
+	}
+
+	bool enabled() const { return !slots.empty(); }
+
+	// Call after the slot's previous submit has been waited on. Returns the scopes of the frame that last used the slot.
+	const std::vector<GpuScopeTiming>& collect(uint32_t frameSlot)
+	{
+		results.clear();
+
+		if (!enabled())
+			return results;
+
+		FrameSlot& slot{ slots[frameSlot] };
+		if (slot.scopes.empty() || !slot.submitted)
+			return results;
+
+		// Pairs of (timestamp, availability); nothing blocks, unavailable scopes are just skipped.
+		uint32_t queryCount{ static_cast<uint32_t>(slot.scopes.size() * 2) };
+		std::vector<uint64_t> data(static_cast<size_t>(queryCount) * 2);
+		vkGetQueryPoolResults(device, slot.queryPool, 0, queryCount, data.size() * sizeof(uint64_t), data.data(),
+			2 * sizeof(uint64_t), VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WITH_AVAILABILITY_BIT);
+
+		// A frame that gave up after the slot wait does not reuse the slot, so it must not report this frame twice.
+		slot.submitted = false;
+
+		recalibrate();
+
+		uint64_t frameStartTicks{ data[0] & timestampMask };
+
+		// Without calibration the best available bound is that the GPU cannot start a frame before it was submitted.
+		if (getCalibratedTimestamps == nullptr && data[1] != 0)
+		{
+			double submitNs{ static_cast<double>(std::chrono::duration_cast<std::chrono::nanoseconds>(slot.submitTime.time_since_epoch()).count()) };
+			double gpuNs{ static_cast<double>(frameStartTicks) * nanosecondsPerTick };
+			offsetNs = std::max(offsetNs, submitNs - gpuNs);
+		}
+
+		if (offsetNs == -std::numeric_limits<double>::infinity())
+			return results;
+
+		for (size_t i{ 0 }; i < slot.scopes.size(); ++i)
+		{
+			uint64_t begin{ data[i * 4] & timestampMask };
+			bool beginAvailable{ data[i * 4 + 1] != 0 };
+			uint64_t end{ data[i * 4 + 2] & timestampMask };
+			bool endAvailable{ data[i * 4 + 3] != 0 };
+
+			if (!beginAvailable || !endAvailable || !slot.scopes[i].closed)
+				continue;
+
+			// Masked subtraction survives counters that wrap within the valid bits.
+			results.push_back({
+				.name{ slot.scopes[i].name },
+				.frame{ slot.frame },
+				.start{ toCpuTime(begin) },
+				.end{ toCpuTime(begin) + std::chrono::nanoseconds(static_cast<int64_t>(((end - begin) & timestampMask) * nanosecondsPerTick)) }
+			});
+		}
+
+		return results;
+	}
+
+	// Resets the slot's queries; must be recorded outside a render pass, before any scope of the frame.
+	void beginFrame(VkCommandBuffer commandBuffer, uint32_t frameSlot, uint64_t frame)
+	{
+		if (!enabled())
+			return;
+
+		currentSlot = &slots[frameSlot];
+		currentSlot->scopes.clear();
+		currentSlot->frame = frame;
+		currentSlot->submitted = false;
+
+		vkCmdResetQueryPool(commandBuffer, currentSlot->queryPool, 0, maxScopesPerFrame * 2);
+	}
+
+	void markSubmitted(std::chrono::steady_clock::time_point submitTime)
+	{
+		if (!enabled())
+			return;
+
+		currentSlot->submitted = true;
+		currentSlot->submitTime = submitTime;
+	}
+
+	// `name` must be a string literal or otherwise outlive the results. Scopes past the per-frame limit are dropped.
+	uint32_t beginScope(VkCommandBuffer commandBuffer, const char* name)
+	{
+		if (!enabled() || currentSlot->scopes.size() >= maxScopesPerFrame)
+			return invalidScope;
+
+		uint32_t scope{ static_cast<uint32_t>(currentSlot->scopes.size()) };
+		currentSlot->scopes.push_back({ .name{ name } });
+		vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, currentSlot->queryPool, scope * 2);
+
+		return scope;
+	}
+
+	void endScope(VkCommandBuffer commandBuffer, uint32_t scope)
+	{
+		if (scope == invalidScope)
+			return;
+
+		vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, currentSlot->queryPool, scope * 2 + 1);
+		currentSlot->scopes[scope].closed = true;
+	}
+
+private:
+	struct Scope
+	{
+		const char* name{};
+		bool closed{ false };
+	};
+
+	struct FrameSlot
+	{
+		VkQueryPool queryPool{};
+		std::vector<Scope> scopes{};
+		uint64_t frame{};
+		bool submitted{ false };
+		std::chrono::steady_clock::time_point submitTime{};
+	};
+
+	static constexpr uint32_t maxScopesPerFrame{ 64 };
+	static constexpr uint32_t invalidScope{ std::numeric_limits<uint32_t>::max() };
+	static constexpr std::chrono::seconds calibrationInterval{ 1 };
+
+	VkDevice device{};
+	std::vector<FrameSlot> slots{};
+	FrameSlot* currentSlot{ nullptr };
+	std::vector<GpuScopeTiming> results{};
+	uint64_t timestampMask{ 0 };
+	double nanosecondsPerTick{ 1.0 };
+
+	// CPU steady_clock nanoseconds = GPU ticks * nanosecondsPerTick + offsetNs.
+	double offsetNs{ -std::numeric_limits<double>::infinity() };
+	PFN_vkGetCalibratedTimestampsEXT getCalibratedTimestamps{ nullptr };
+	VkTimeDomainEXT hostTimeDomain{};
+	std::chrono::steady_clock::time_point lastCalibration{};
+
+	std::chrono::steady_clock::time_point toCpuTime(uint64_t ticks) const
+	{
+		double ns{ static_cast<double>(ticks) * nanosecondsPerTick + offsetNs };
+		return std::chrono::steady_clock::time_point{ std::chrono::nanoseconds(static_cast<int64_t>(ns)) };
+	}
+
+	// steady_clock is QueryPerformanceCounter on Windows and CLOCK_MONOTONIC elsewhere, which are exactly the
+	// host domains VK_EXT_calibrated_timestamps can sample together with the GPU clock.
+	void setUpCalibration(VkInstance instance, VkPhysicalDevice physicalDevice)
+	{
+#ifdef _WIN32
+		hostTimeDomain = VK_TIME_DOMAIN_QUERY_PERFORMANCE_COUNTER_EXT;
+#else
+		hostTimeDomain = VK_TIME_DOMAIN_CLOCK_MONOTONIC_EXT;
+#endif
+
+		auto getTimeDomains{ reinterpret_cast<PFN_vkGetPhysicalDeviceCalibrateableTimeDomainsEXT>(
+			vkGetInstanceProcAddr(instance, "vkGetPhysicalDeviceCalibrateableTimeDomainsEXT")) };
+		if (getTimeDomains == nullptr)
+			return;
+
+		uint32_t domainCount{ 0 };
+		getTimeDomains(physicalDevice, &domainCount, nullptr);
+		std::vector<VkTimeDomainEXT> domains(domainCount);
+		getTimeDomains(physicalDevice, &domainCount, domains.data());
+
+		bool deviceDomain{ std::find(domains.begin(), domains.end(), VK_TIME_DOMAIN_DEVICE_EXT) != domains.end() };
+		bool hostDomain{ std::find(domains.begin(), domains.end(), hostTimeDomain) != domains.end() };
+		if (!deviceDomain || !hostDomain)
+			return;
+
+		getCalibratedTimestamps = reinterpret_cast<PFN_vkGetCalibratedTimestampsEXT>(
+			vkGetDeviceProcAddr(device, "vkGetCalibratedTimestampsEXT"));
+	}
+
+	// The two clocks drift apart slowly, so the offset is refreshed about once a second.
+	void recalibrate()
+	{
+		if (getCalibratedTimestamps == nullptr)
+			return;
+
+		auto now{ std::chrono::steady_clock::now() };
+		if (now - lastCalibration < calibrationInterval)
+			return;
+
+		VkCalibratedTimestampInfoEXT infos[]{
+			{ .sType{ VK_STRUCTURE_TYPE_CALIBRATED_TIMESTAMP_INFO_EXT }, .timeDomain{ VK_TIME_DOMAIN_DEVICE_EXT } },
+			{ .sType{ VK_STRUCTURE_TYPE_CALIBRATED_TIMESTAMP_INFO_EXT }, .timeDomain{ hostTimeDomain } }
+		};
+
+		uint64_t timestamps[2]{};
+		uint64_t maxDeviation{};
+		if (getCalibratedTimestamps(device, 2, infos, timestamps, &maxDeviation) != VK_SUCCESS)
+			return;
+
+		double hostNs{ static_cast<double>(timestamps[1]) };
+#ifdef _WIN32
+		LARGE_INTEGER frequency{};
+		QueryPerformanceFrequency(&frequency);
+		hostNs = static_cast<double>(timestamps[1] / frequency.QuadPart) * 1e9
+			+ static_cast<double>(timestamps[1] % frequency.QuadPart) * 1e9 / frequency.QuadPart;
+#endif
+
+		offsetNs = hostNs - static_cast<double>(timestamps[0] & timestampMask) * nanosecondsPerTick;
+		lastCalibration = now;
+	}
+};
+
+// Times the commands recorded while it is alive. Primary command buffers only: a render pass whose contents
+// come from secondaries cannot contain timestamps, so scope the whole pass instead.
+class GpuScope
+{
+public:
+	GpuScope(GpuProfiler& gpuProfiler, VkCommandBuffer commandBuffer, const char* name)
+		: profiler{ gpuProfiler }, commandBuffer{ commandBuffer }, scope{ gpuProfiler.beginScope(commandBuffer, name) }
+	{
+	}
+
+	GpuScope(const GpuScope&) = delete;
+	GpuScope& operator=(const GpuScope&) = delete;
+
+	~GpuScope()
+	{
+		profiler.endScope(commandBuffer, scope);
+	}
+
+private:
+	GpuProfiler& profiler;
+	VkCommandBuffer commandBuffer;
+	uint32_t scope;
+};
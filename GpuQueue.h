@@ -0,0 +1,151 @@
+#pragma once
+#include <vulkan/vulkan.h>
+
+#include <cstdint>
+#include <limits>
+#include <stdexcept>
+#include <vector>
+
+
+// One semaphore a submit waits on. `value` is the timeline point to reach and is ignored for binary semaphores.
+struct SemaphoreWait
+{
+	VkSemaphore semaphore{ VK_NULL_HANDLE };
+	uint64_t value{ 0 };
+	VkPipelineStageFlags stages{ 0 };
+};
+
+// A device queue with its own timeline semaphore. Every submit signals the next point on the timeline, so other
+// queues wait for "submit N of this queue" and the host polls or waits for it without fences.
+// Submits are not synchronized; they all come from the main thread. Several GpuQueues may wrap the same VkQueue
+// when the device has fewer queues than roles, each keeping its own timeline.
+class GpuQueue
+{
+public:
+	void create(VkDevice dev, uint32_t queueFamily, uint32_t queueIndex)
+	{
+		device = dev;
+		family = queueFamily;
+		index = queueIndex;
+		vkGetDeviceQueue(device, family, index, &queue);
+
+		VkSemaphoreTypeCreateInfo typeInfo{
+			.sType{ VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO },
+			.semaphoreType{ VK_SEMAPHORE_TYPE_TIMELINE },
+			.initialValue{ 0 }
+		};
+
+		VkSemaphoreCreateInfo semaphoreInfo{
+			.sType{ VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO },
+			.pNext{ &typeInfo }
+		};
+
+		if (vkCreateSemaphore(device, &semaphoreInfo, nullptr, &timeline) != VK_SUCCESS)
+			throw std::runtime_error("Failed to create a timeline semaphore!");
+
+		submittedValue = 0;
+	}
+
+	void destroy()
+	{
+		vkDestroySemaphore(device, timeline, nullptr);
+		timeline = VK_NULL_HANDLE;
+	}
+
+	VkQueue handle() const { return queue; }
+	uint32_t familyIndex() const { return family; }
+	uint32_t queueIndex() const { return index; }
+
+	// For another queue's submit that consumes work submitted here.
+	SemaphoreWait waitFor(uint64_t value, VkPipelineStageFlags stages) const
+	{
+		return { .semaphore{ timeline }, .value{ value }, .stages{ stages } };
+	}
+
+	// Returns the timeline point that signals once `commandBuffers` have finished. `binarySignals` is for consumers
+	// that cannot take a timeline semaphore, which is only vkQueuePresentKHR.
+	uint64_t submit(const std::vector<VkCommandBuffer>& commandBuffers, const std::vector<SemaphoreWait>& waits = {},
+		const std::vector<VkSemaphore>& binarySignals = {})
+	{
+		std::vector<VkSemaphore> waitSemaphores{};
+		std::vector<uint64_t> waitValues{};
+		std::vector<VkPipelineStageFlags> waitStages{};
+		for (const auto& wait : waits)
+		{
+			waitSemaphores.push_back(wait.semaphore);
+			waitValues.push_back(wait.value);
+			waitStages.push_back(wait.stages);
+		}
+
+		uint64_t signalValue{ submittedValue + 1 };
+
+		std::vector<VkSemaphore> signalSemaphores{ binarySignals };
+		signalSemaphores.push_back(timeline);
+		std::vector<uint64_t> signalValues(signalSemaphores.size(), 0);
+		signalValues.back() = signalValue;
+
+		// Binary semaphores take part in the value arrays too; their entries are ignored.
+		VkTimelineSemaphoreSubmitInfo timelineInfo{
+			.sType{ VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO },
+			.waitSemaphoreValueCount{ static_cast<uint32_t>(waitValues.size()) },
+			.pWaitSemaphoreValues{ waitValues.data() },
+			.signalSemaphoreValueCount{ static_cast<uint32_t>(signalValues.size()) },
+			.pSignalSemaphoreValues{ signalValues.data() }
+		};
+
+		VkSubmitInfo submitInfo{
+			.sType{ VK_STRUCTURE_TYPE_SUBMIT_INFO },
+			.pNext{ &timelineInfo },
+			.waitSemaphoreCount{ static_cast<uint32_t>(waitSemaphores.size()) },
+			.pWaitSemaphores{ waitSemaphores.data() },
+			.pWaitDstStageMask{ waitStages.data() },
+			.commandBufferCount{ static_cast<uint32_t>(commandBuffers.size()) },
+			.pCommandBuffers{ commandBuffers.data() },
+			.signalSemaphoreCount{ static_cast<uint32_t>(signalSemaphores.size()) },
+			.pSignalSemaphores{ signalSemaphores.data() }
+		};
+
+		if (vkQueueSubmit(queue, 1, &submitInfo, VK_NULL_HANDLE) != VK_SUCCESS)
+			throw std::runtime_error("Failed to submit to a queue!");
+
+		submittedValue = signalValue;
+		return signalValue;
+	}
+
+	uint64_t lastSubmittedValue() const { return submittedValue; }
+
+	uint64_t completedValue() const
+	{
+		uint64_t value{ 0 };
+		vkGetSemaphoreCounterValue(device, timeline, &value);
+		return value;
+	}
+
+	bool isComplete(uint64_t value) const { return value <= completedValue(); }
+
+	// Blocks the calling thread until the timeline reaches `value`; 0 never blocks.
+	void wait(uint64_t value) const
+	{
+		if (value == 0)
+			return;
+
+		VkSemaphoreWaitInfo waitInfo{
+			.sType{ VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO },
+			.semaphoreCount{ 1 },
+			.pSemaphores{ &timeline },
+			.pValues{ &value }
+		};
+
+		vkWaitSemaphores(device, &waitInfo, std::numeric_limits<uint64_t>::max());
+	}
+
+	void waitIdle() const { wait(submittedValue); }
+
+private:
+	VkDevice device{};
+	VkQueue queue{};
+	uint32_t family{};
+	uint32_t index{};
+	VkSemaphore timeline{};
+	uint64_t submittedValue{ 0 };
+};
@@ -0,0 +1,22 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+
+constexpr uint64_t fnvOffsetBasis{ 14695981039346656037ull };
+constexpr uint64_t fnvPrime{ 1099511628211ull };
+
+// FNV-1a. Not cryptographic, only meant for cache keys and detecting corrupted or unchanged data.
+inline uint64_t hashBytes(const void* data, size_t size, uint64_t seed = fnvOffsetBasis)
+{
+	const auto* bytes{ static_cast<const uint8_t*>(data) };
+
+	uint64_t hash{ seed };
+	for (size_t i{ 0 }; i < size; ++i)
+	{
+		hash ^= bytes[i];
+		hash *= fnvPrime;
+	}
+
+	return hash;
+}
@@ -2,22 +2,60 @@
 #define GLFW_INCLUDE_VULKAN
 #include <GLFW/glfw3.h>
 
+#include "AppConfig.h"
+#include "CommandRecorder.h"
+#include "CpuProfiler.h"
+#include "DescriptorAllocator.h"
+#include "DeviceAllocator.h"
+#include "DeviceCapabilities.h"
+#include "DeviceSelector.h"
+#include "FrameStats.h"
+#include "GpuCuller.h"
+#include "GpuProfiler.h"
+#include "GpuQueue.h"
+#include "InstanceTransforms.h"
+#include "Mesh.h"
+#include "PipelineBuilder.h"
+#include "PipelineCache.h"
+#include "PresentPolicy.h"
+#include "ShaderLibrary.h"
+#include "ThreadPool.h"
+#include "TraceExporter.h"
+#include "UniformRing.h"
+#include "UploadQueue.h"
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
 #include <algorithm>
+#include <array>
+#include <bit>
+#include <chrono>
+#include <cmath>
 #include <cstdint>
 #include <cstdlib>
-#include <cstring>
 #include <fstream>
+#include <future>
+#include <iomanip>
 #include <iostream>
 #include <limits>
-#include <optional>
-#include <set>
+#include <map>
 #include <stdexcept>
+#include <string>
+#include <string_view>
 #include <vector>
 
 
 constexpr int width{ 800 };
 constexpr int height{ 600 };
 
+constexpr const char* pipelineCachePath{ "pipeline_cache.bin" };
+constexpr const char* deviceCapabilitiesPath{ "device_capabilities.bin" };
+
+constexpr VkFormat headlessImageFormat{ VK_FORMAT_R8G8B8A8_UNORM };
+
+constexpr uint32_t maxGeneratedLods{ 4 };
+
 #ifdef NDEBUG
 constexpr bool enableValidationLayers{ false };
 #else
@@ -32,15 +70,17 @@ const std::vector<const char*> deviceExtensions = {
 	VK_KHR_SWAPCHAIN_EXTENSION_NAME
 };
 
-struct QueueFamilyIndices
+// A replaced swap chain and what was built on its images. Frames submitted before `retiredAtFrame` may
+// still use them, so they are destroyed once those frames have completed.
+struct RetiredSwapChain
 {
-	std::optional<uint32_t> graphicsFamily{};
-	std::optional<uint32_t> presentFamily{};
-
-	bool isComplete()
-	{
-		return graphicsFamily.has_value() && presentFamily.has_value();
-	}
+	VkSwapchainKHR swapChain{};
+	std::vector<VkImageView> imageViews{};
+	std::vector<VkFramebuffer> framebuffers{};
+	std::vector<VkSemaphore> renderFinishedSemaphores{};
+	AllocatedImage depthImage{};
+	VkImageView depthImageView{};
+	uint64_t retiredAtFrame{};
 };
 
 struct SwapChainSupportDetails
@@ -50,14 +90,51 @@ struct SwapChainSupportDetails
 	std::vector<VkPresentModeKHR> presentModes{};
 };
 
+// Everything one frame in flight needs, so the CPU can record frame N+1 while the GPU still executes frame N.
+struct FrameContext
+{
+	VkCommandBuffer commandBuffer{};
+	// Only allocated with --gpu-driven; the culling pass and the acquires of the uploads it reads.
+	VkCommandBuffer computeCommandBuffer{};
+	VkSemaphore imageAvailableSemaphore{};
+	// Graphics timeline point of the slot's last submit; 0 before the first one.
+	uint64_t submittedValue{ 0 };
+};
+
+// std140 layouts of the vertex shader's uniform blocks; mat4 and vec4 members need no padding.
+struct CameraConstants
+{
+	glm::mat4 viewProjection{ 1.0f };
+};
+
+struct ObjectConstants
+{
+	glm::mat4 model{ 1.0f };
+	glm::vec4 tint{ 1.0f };
+};
+
 class HelloTriangleApp
 {
 public:
 	VkSurfaceKHR surface;
 
+	explicit HelloTriangleApp(const AppConfig& appConfig)
+		: config{ appConfig }, presentProfile{ appConfig.presentProfile }
+	{
+	}
+
 	void run()
 	{
-		initWindow();
+		startTime = std::chrono::steady_clock::now();
+
+		CpuProfiler::setThreadName("Main thread");
+		// Enabled first so startup shows up in the trace too.
+		if (!config.tracePath.empty())
+			trace.enable(config.tracePath);
+
+		if (!config.headless)
+			initWindow();
+
 		initVulkan();
 		mainLoop();
 		cleanup();
@@ -75,32 +152,176 @@ public:
 	}
 
 private:
+	AppConfig config{};
+	std::chrono::steady_clock::time_point startTime{};
+
 	// TODO: read on learncpp if you should put "{}" here as in structs
 	GLFWwindow* window;
 	VkInstance instance;
 	VkDebugUtilsMessengerEXT debugMessenger;
 	VkPhysicalDevice physicalDevice;
+	DeviceCapabilityCache deviceCapabilityCache{};
+	// Points into deviceCapabilityCache, which owns it for the whole run.
+	const DeviceCapabilities* deviceCapabilities{ nullptr };
+	QueueFamilyIndices queueFamilies{};
 	VkDevice device;
-	VkQueue graphicsQueue;
+	GpuQueue graphicsQueue{};
+	GpuQueue computeQueue{};
+	GpuQueue transferQueue{};
 	VkQueue presentQueue;
 	VkSwapchainKHR swapChain;
+	VkPresentModeKHR swapChainPresentMode;
+	// In headless mode these describe the offscreen render targets instead of swap chain images.
 	std::vector<VkImage> swapChainImages;
+	VkSurfaceFormatKHR swapChainSurfaceFormat;
 	VkFormat swapChainImageFormat;
 	VkExtent2D swapChainExtent;
 	std::vector<VkImageView> swapChainImageViews;
+	std::vector<AllocatedImage> headlessImages;
+	// Shared by every framebuffer: frames run in submission order on the graphics queue, and the render pass
+	// dependency orders each frame's depth clear after the previous frame's depth writes.
+	VkFormat depthFormat;
+	AllocatedImage depthImage{};
+	VkImageView depthImageView{};
+	DeviceAllocator allocator{};
+	UploadQueue uploadQueue{};
+	MeshLibrary meshLibrary{};
+	MeshId sceneMesh{};
+	// Set once per frame after the uploads are flushed; nothing is drawn before the mesh data has arrived.
+	bool sceneMeshResident{ false };
+	VkRenderPass renderPass;
+	VkPipelineLayout pipelineLayout;
+	DescriptorLayoutCache descriptorLayouts{};
+	DescriptorAllocator descriptorAllocator{};
+	UniformRing uniformRing{};
+	// Camera and object constants, both read from uniformRing through dynamic offsets.
+	const DescriptorLayout* drawSetLayout{ nullptr };
+	VkDescriptorSet drawSet{};
+	uint32_t cameraOffset{ 0 };
+	// Only created with --instances.
+	InstanceTransforms instanceTransforms{};
+	// Only created with --gpu-driven, which draws the instances from buffers the GPU fills itself.
+	GpuCuller gpuCuller{};
+	const DescriptorLayout* cullSetLayout{ nullptr };
+	const DescriptorLayout* objectSetLayout{ nullptr };
+	VkPipelineLayout cullPipelineLayout{};
+	// The draw set plus the object transforms.
+	VkPipelineLayout gpuDrivenPipelineLayout{};
+	VkPipeline cullPipeline{};
+	uint32_t cullConstantsOffset{ 0 };
+	bool drawIndirectCountSupported{ false };
+	// One pipeline per vertex format; the mesh's format picks the one it is drawn with.
+	VkPipeline graphicsPipeline;
+	VkPipeline quantizedPipeline;
+	// The same with a per-instance model matrix instead of the object constants' one.
+	VkPipeline instancedPipeline;
+	VkPipeline quantizedInstancedPipeline;
+	// The same reading the model matrix of the object named by the indirect draw.
+	VkPipeline gpuDrivenPipeline{};
+	VkPipeline quantizedGpuDrivenPipeline{};
+	PipelineCache pipelineCache{};
+	ShaderLibrary shaderLibrary{};
+	PipelineBuilder pipelineBuilder{};
+	bool pipelineCreationFeedbackSupported{ false };
+	bool calibratedTimestampsSupported{ false };
+	std::vector<VkFramebuffer> swapChainFramebuffers;
+	// One per swap chain image rather than per frame slot: the frame's wait does not show when the presentation
+	// engine is done with the semaphore, but the image cannot be acquired again before it is.
+	std::vector<VkSemaphore> renderFinishedSemaphores;
+	std::vector<RetiredSwapChain> retiredSwapChains{};
+	bool swapChainOutOfDate{ false };
+	PresentProfile presentProfile{};
+	FrameLimiter frameLimiter{};
+	double targetFps{ 0.0 };
+	PresentStats presentStats{};
+	VkCommandPool commandPool;
+	VkCommandPool computeCommandPool{};
+	ThreadPool threadPool{};
+	CommandRecorder commandRecorder{};
+	std::vector<FrameContext> frames;
+	// Graphics timeline point of the last frame that rendered to each image.
+	std::vector<uint64_t> imagesInFlight;
+	uint32_t currentFrame{ 0 };
+	uint64_t frameNumber{ 0 };
+	FrameStats frameStats{};
+	GpuProfiler gpuProfiler{};
+	// Only created with --gpu-driven; times the culling pass on the compute queue.
+	GpuProfiler computeProfiler{};
+	double mainPassGpuMs{ 0.0 };
+	uint32_t mainPassSamples{ 0 };
+	double cullingGpuMs{ 0.0 };
+	uint32_t cullingSamples{ 0 };
+	double instancedDrawMs{ 0.0 };
+	uint32_t instancedDrawSamples{ 0 };
+	TraceExporter trace{};
+	uint32_t gpuTrack{};
+	uint32_t computeTrack{};
 
 	void initWindow()
 	{
 		glfwInit();
 		glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
-		glfwWindowHint(GLFW_RESIZABLE, GLFW_FALSE);
+		glfwWindowHint(GLFW_RESIZABLE, GLFW_TRUE);
 
 		window = glfwCreateWindow(width, height, "HelloTriangleApp", nullptr, nullptr);
+		glfwSetWindowUserPointer(window, this);
+		glfwSetFramebufferSizeCallback(window, framebufferResizeCallback);
+		glfwSetKeyCallback(window, keyCallback);
+	}
+
+	// Not every platform reports a resize through VK_ERROR_OUT_OF_DATE_KHR, so GLFW's notification is tracked as well.
+	static void framebufferResizeCallback(GLFWwindow* resizedWindow, int, int)
+	{
+		auto* app{ static_cast<HelloTriangleApp*>(glfwGetWindowUserPointer(resizedWindow)) };
+		app->swapChainOutOfDate = true;
+	}
+
+	// 1, 2 and 3 switch between the low-latency, smooth and throughput present profiles.
+	static void keyCallback(GLFWwindow* keyWindow, int key, int, int action, int)
+	{
+		if (action != GLFW_PRESS || key < GLFW_KEY_1 || key >= GLFW_KEY_1 + static_cast<int>(presentProfiles.size()))
+			return;
+
+		auto* app{ static_cast<HelloTriangleApp*>(glfwGetWindowUserPointer(keyWindow)) };
+		PresentProfile profile{ presentProfiles[key - GLFW_KEY_1] };
+
+		if (profile == app->presentProfile)
+			return;
+
+		app->reportPresentStats();
+		app->presentProfile = profile;
+		// The present mode and image count are baked into the swap chain.
+		app->swapChainOutOfDate = true;
+		app->applyFrameLimit();
+	}
+
+	void applyFrameLimit()
+	{
+		targetFps = config.fpsLimit;
+
+		if (targetFps == 0.0 && !config.headless && getPresentPolicy(presentProfile).limitToRefreshRate)
+		{
+			const GLFWvidmode* videoMode{ glfwGetVideoMode(glfwGetPrimaryMonitor()) };
+			targetFps = videoMode != nullptr ? videoMode->refreshRate : 60.0;
+		}
+
+		frameLimiter.setTargetFps(targetFps);
+		presentStats.begin();
+	}
+
+	void reportPresentStats()
+	{
+		if (!config.headless)
+			presentStats.report(presentProfile, swapChainPresentMode, static_cast<uint32_t>(swapChainImages.size()), targetFps);
 	}
 
 	void createInstance()
 	{
-		if (enableValidationLayers && !checkValidationLayersSupport())
+		PROFILE_FUNCTION();
+
+		InstanceCapabilities instanceCapabilities{ InstanceCapabilities::query() };
+
+		if (enableValidationLayers && !instanceCapabilities.hasAllLayers(validationLayers))
 			throw std::runtime_error("Validation layers requested, but not available!");
 
 		constexpr VkApplicationInfo appInfo{
@@ -109,7 +330,7 @@ private:
 			.applicationVersion{ VK_API_VERSION_1_0 },
 			.pEngineName{ "Test" },
 			.engineVersion{ VK_API_VERSION_1_0 },
-			.apiVersion{ VK_API_VERSION_1_0 }
+			.apiVersion{ VK_API_VERSION_1_2 }
 		};
 
 		const std::vector<const char*> requiredExtensions{ getRequiredExtensions() };
@@ -120,7 +341,7 @@ private:
 
 		std::cout << '\n';
 
-		if (!checkExtensionsSupport(requiredExtensions))
+		if (!instanceCapabilities.hasAllExtensions(requiredExtensions))
 			throw std::runtime_error("Not all the required extensions are supported!");
 
 		VkInstanceCreateInfo createInfo{
@@ -148,6 +369,8 @@ private:
 
 	void setupDebugMessenger()
 	{
+		PROFILE_FUNCTION();
+
 		if (!enableValidationLayers) return;
 
 		VkDebugUtilsMessengerCreateInfoEXT createInfo{};
@@ -159,8 +382,7 @@ private:
 
 	void pickPhysicalDevice()
 	{
-		// TODO: is this necessary?
-		physicalDevice = VK_NULL_HANDLE;
+		PROFILE_FUNCTION();
 
 		uint32_t devicesCount{ 0 };
 		vkEnumeratePhysicalDevices(instance, &devicesCount, nullptr);
@@ -171,372 +393,1129 @@ private:
 		std::vector<VkPhysicalDevice> devices(devicesCount);
 		vkEnumeratePhysicalDevices(instance, &devicesCount, devices.data());
 
+		deviceCapabilityCache.create(deviceCapabilitiesPath);
+
+		std::vector<const DeviceCapabilities*> candidates{};
 		for (const auto& dev : devices)
+			candidates.push_back(&deviceCapabilityCache.query(dev, config.headless ? VK_NULL_HANDLE : surface));
+
+		deviceCapabilityCache.save();
+
+		DeviceRequirements requirements{
+			.minApiVersion{ VK_API_VERSION_1_2 },
+			.extensions{ getRequiredDeviceExtensions() },
+			.presentation{ !config.headless }
+		};
+
+		std::vector<DeviceRanking> rankings{ rankDevices(candidates, requirements) };
+
+		const DeviceRanking* selected{ nullptr };
+		try
 		{
-			if (isDeviceSuitable(dev))
-			{
-				physicalDevice = dev;
-				break;
-			}
+			selected = &selectDevice(rankings, config.deviceSelection);
+		}
+		catch (const std::exception&)
+		{
+			// The ranking explains why nothing, or not the requested device, could be used.
+			printDeviceRanking(rankings, nullptr);
+			throw;
 		}
 
-		if (physicalDevice == VK_NULL_HANDLE)
-			throw std::runtime_error("Failed to find a suitable GPU!");
+		printDeviceRanking(rankings, selected);
+
+		deviceCapabilities = selected->device;
+		physicalDevice = deviceCapabilities->physicalDevice;
+		queueFamilies = findQueueFamilies(*deviceCapabilities);
 	}
 
 	void createLogicalDevice()
 	{
-		QueueFamilyIndices indices{ findQueueFamilies(physicalDevice) };
+		PROFILE_FUNCTION();
 
-		std::vector<VkDeviceQueueCreateInfo> queueCreateInfos{};
-		std::set<uint32_t> uniqueQueueFamilies = { indices.graphicsFamily.value(), indices.presentFamily.value() };
+		// Each role gets a queue of its own while its family has one to spare and shares the family's last queue after
+		// that, so compute and transfer still run beside graphics when they fall back to the graphics family.
+		std::map<uint32_t, uint32_t> queuesPerFamily{};
+		auto assignQueue = [&](uint32_t family)
+		{
+			uint32_t index{ std::min(queuesPerFamily[family], deviceCapabilities->queueFamilies[family].queueCount - 1) };
+			queuesPerFamily[family] = index + 1;
+			return index;
+		};
+
+		uint32_t graphicsIndex{ assignQueue(queueFamilies.graphicsFamily.value()) };
+		uint32_t computeIndex{ assignQueue(queueFamilies.computeFamily.value()) };
+		uint32_t transferIndex{ assignQueue(queueFamilies.transferFamily.value()) };
 
-		float queuePriority{ 1.0f };
-		for (uint32_t queueFamily : uniqueQueueFamilies)
+		// Presenting from the graphics queue avoids another cross-queue hop at the end of every frame.
+		uint32_t presentIndex{ graphicsIndex };
+		if (queueFamilies.presentFamily.has_value() && queueFamilies.presentFamily != queueFamilies.graphicsFamily)
+			presentIndex = assignQueue(queueFamilies.presentFamily.value());
+
+		uint32_t maxQueuesPerFamily{ 1 };
+		for (const auto& [family, count] : queuesPerFamily)
+			maxQueuesPerFamily = std::max(maxQueuesPerFamily, count);
+
+		std::vector<float> queuePriorities(maxQueuesPerFamily, 1.0f);
+		std::vector<VkDeviceQueueCreateInfo> queueCreateInfos{};
+		for (const auto& [family, count] : queuesPerFamily)
 		{
 			VkDeviceQueueCreateInfo queueCreateInfo{
 				.sType{ VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO },
-				.queueFamilyIndex{ queueFamily },
-				.queueCount{ 1 },
-				.pQueuePriorities{ &queuePriority },
+				.queueFamilyIndex{ family },
+				.queueCount{ count },
+				.pQueuePriorities{ queuePriorities.data() },
 			};
 
 			queueCreateInfos.push_back(queueCreateInfo);
 		}
 
 		VkPhysicalDeviceFeatures deviceFeatures{};
+		if (config.gpuDriven)
+			enableGpuDrivenFeatures(deviceFeatures);
+
+		std::vector<const char*> enabledExtensions{ getRequiredDeviceExtensions() };
+
+		pipelineCreationFeedbackSupported = deviceCapabilities->hasExtension(VK_EXT_PIPELINE_CREATION_FEEDBACK_EXTENSION_NAME);
+		if (pipelineCreationFeedbackSupported)
+			enabledExtensions.push_back(VK_EXT_PIPELINE_CREATION_FEEDBACK_EXTENSION_NAME);
+
+		calibratedTimestampsSupported = deviceCapabilities->hasExtension(VK_EXT_CALIBRATED_TIMESTAMPS_EXTENSION_NAME);
+		if (calibratedTimestampsSupported)
+			enabledExtensions.push_back(VK_EXT_CALIBRATED_TIMESTAMPS_EXTENSION_NAME);
+
+		// Timeline semaphores are core and always supported in Vulkan 1.2, but still have to be enabled.
+		VkPhysicalDeviceVulkan12Features vulkan12Features{
+			.sType{ VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES },
+			.drawIndirectCount{ drawIndirectCountSupported ? VK_TRUE : VK_FALSE },
+			.timelineSemaphore{ VK_TRUE }
+		};
 
 		VkDeviceCreateInfo createInfo{
 			.sType{ VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO },
+			.pNext{ &vulkan12Features },
 			.queueCreateInfoCount{ static_cast<uint32_t>(queueCreateInfos.size()) },
 			.pQueueCreateInfos{ queueCreateInfos.data() },
 			.enabledLayerCount{ 0 },
-			.enabledExtensionCount{ static_cast<uint32_t>(deviceExtensions.size()) },
-			.ppEnabledExtensionNames{ deviceExtensions.data() },
+			.enabledExtensionCount{ static_cast<uint32_t>(enabledExtensions.size()) },
+			.ppEnabledExtensionNames{ enabledExtensions.data() },
 			.pEnabledFeatures{ &deviceFeatures },
 		};
 
 		if (vkCreateDevice(physicalDevice, &createInfo, nullptr, &device) != VK_SUCCESS)
 			throw std::runtime_error("Failed to create the logical device!");
 
-		vkGetDeviceQueue(device, indices.graphicsFamily.value(), 0, &graphicsQueue);
-		vkGetDeviceQueue(device, indices.presentFamily.value(), 0, &presentQueue);
-	}
+		graphicsQueue.create(device, queueFamilies.graphicsFamily.value(), graphicsIndex);
+		computeQueue.create(device, queueFamilies.computeFamily.value(), computeIndex);
+		transferQueue.create(device, queueFamilies.transferFamily.value(), transferIndex);
+		if (queueFamilies.presentFamily.has_value())
+			vkGetDeviceQueue(device, queueFamilies.presentFamily.value(), presentIndex, &presentQueue);
 
-	void createSurface()
-	{
-		if (glfwCreateWindowSurface(instance, window, nullptr, &surface) != VK_SUCCESS)
-			throw std::runtime_error("Failed to create the window surface!");
+		auto describeQueue = [&](const char* role, const GpuQueue& queue)
+		{
+			std::cout << '\t' << role << ": family " << queue.familyIndex() << ", queue " << queue.queueIndex();
+
+			if (queue.familyIndex() != graphicsQueue.familyIndex())
+				std::cout << " (dedicated family)";
+			else if (queue.queueIndex() != graphicsQueue.queueIndex())
+				std::cout << " (separate queue in the graphics family)";
+			else
+				std::cout << " (shares the graphics queue)";
+
+			std::cout << '\n';
+		};
+
+		std::cout << "Queues:\n\tgraphics: family " << graphicsQueue.familyIndex() << ", queue " << graphicsQueue.queueIndex() << '\n';
+		describeQueue("compute", computeQueue);
+		describeQueue("transfer", transferQueue);
+		std::cout << '\n';
 	}
 
-	void initVulkan()
+	// Culled draws carry their object index in firstInstance, and all of them go out in one indirect call.
+	// drawIndirectCount is optional; without it every slot is drawn and the culled ones have no instances.
+	void enableGpuDrivenFeatures(VkPhysicalDeviceFeatures& features)
 	{
-		createInstance();
-		setupDebugMessenger();
-		createSurface();
-		pickPhysicalDevice();
-		createLogicalDevice();
-		createSwapChain();
-		createImageViews();
-		createGraphicsPipeline();
+		if (!deviceCapabilities->features.drawIndirectFirstInstance || !deviceCapabilities->features.multiDrawIndirect)
+			throw std::runtime_error("--gpu-driven needs the drawIndirectFirstInstance and multiDrawIndirect features!");
+
+		features.drawIndirectFirstInstance = VK_TRUE;
+		features.multiDrawIndirect = VK_TRUE;
+
+		// Vulkan 1.2 features are not part of the capability cache, so this one is queried live.
+		VkPhysicalDeviceVulkan12Features supported12{ .sType{ VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES } };
+		VkPhysicalDeviceFeatures2 supported{
+			.sType{ VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2 },
+			.pNext{ &supported12 }
+		};
+		vkGetPhysicalDeviceFeatures2(physicalDevice, &supported);
+		drawIndirectCountSupported = supported12.drawIndirectCount == VK_TRUE;
+
+		if (!drawIndirectCountSupported && deviceCapabilities->properties.limits.maxDrawIndirectCount < config.instanceCount)
+			throw std::runtime_error("--instances exceeds the device's maxDrawIndirectCount!");
+
+		std::cout << "GPU-driven drawing with " << (drawIndirectCountSupported ? "vkCmdDrawIndexedIndirectCount" : "vkCmdDrawIndexedIndirect")
+			<< "\n\n";
 	}
 
-	void mainLoop()
+	void createUploadQueue()
 	{
-		while (!glfwWindowShouldClose(window))
-		{
-			glfwPollEvents();
-		}
+		PROFILE_FUNCTION();
+
+		uploadQueue.create(device, allocator, transferQueue, queueFamilies.graphicsFamily.value(), computeQueue.familyIndex(),
+			config.framesInFlight);
 	}
 
-	void cleanup()
+	// The geometry streams in through the upload queue over the first frames.
+	void createMeshes()
 	{
-		if (enableValidationLayers)
-			destroyDebugUtilsMessengerEXT(instance, debugMessenger, nullptr);
+		PROFILE_FUNCTION();
 
-		// NOTE: is the reference appropriate here?
-		for (const auto& imageView : swapChainImageViews)
+		meshLibrary.create(allocator, uploadQueue);
+
+		if (!config.meshPath.empty())
+			sceneMesh = meshLibrary.load(config.meshPath);
+		else if (config.sphereSegments > 0)
 		{
-			vkDestroyImageView(device, imageView, nullptr);
+			MeshData sphere{ makeSphere(config.sphereSegments) };
+			appendClusteredLods(sphere, maxGeneratedLods);
+			sceneMesh = meshLibrary.add("sphere", sphere, config.vertexFormat);
 		}
+		else
+			sceneMesh = meshLibrary.add("triangle", makeTriangle(), config.vertexFormat);
 
-		vkDestroySwapchainKHR(device, swapChain, nullptr);
-		vkDestroyDevice(device, nullptr);
-		vkDestroySurfaceKHR(instance, surface, nullptr);
-		vkDestroyInstance(instance, nullptr);
-
-		glfwDestroyWindow(window);
-		glfwTerminate();
+		meshLibrary.printStatistics();
 	}
 
-	void populateDebugMessengerCreateInfo(VkDebugUtilsMessengerCreateInfoEXT& createInfo)
+	void createSurface()
 	{
-		createInfo = {};
-		createInfo.sType = VK_STRUCTURE_TYPE_DEBUG_UTILS_MESSENGER_CREATE_INFO_EXT;
-		createInfo.messageSeverity = VK_DEBUG_UTILS_MESSAGE_SEVERITY_VERBOSE_BIT_EXT
-			| VK_DEBUG_UTILS_MESSAGE_SEVERITY_WARNING_BIT_EXT
-			| VK_DEBUG_UTILS_MESSAGE_SEVERITY_ERROR_BIT_EXT;
-		createInfo.messageType = VK_DEBUG_UTILS_MESSAGE_TYPE_GENERAL_BIT_EXT | VK_DEBUG_UTILS_MESSAGE_TYPE_VALIDATION_BIT_EXT | VK_DEBUG_UTILS_MESSAGE_TYPE_PERFORMANCE_BIT_EXT;
-		createInfo.pfnUserCallback = debugCallback;
+		PROFILE_FUNCTION();
+
+		if (glfwCreateWindowSurface(instance, window, nullptr, &surface) != VK_SUCCESS)
+			throw std::runtime_error("Failed to create the window surface!");
 	}
 
-	std::vector<const char*> getRequiredExtensions()
+	void initVulkan()
 	{
-		uint32_t glfwExtensionsCount{ 0 };
-		const char** glfwExtensions{ glfwGetRequiredInstanceExtensions(&glfwExtensionsCount) };
-		std::vector<const char*> extensions(glfwExtensions, glfwExtensions + glfwExtensionsCount);
+		PROFILE_FUNCTION();
 
-		if (enableValidationLayers)
-			extensions.push_back(VK_EXT_DEBUG_UTILS_EXTENSION_NAME);
+		auto start{ std::chrono::steady_clock::now() };
 
-		return extensions;
+		createInstance();
+		setupDebugMessenger();
+		if (!config.headless)
+			createSurface();
+		pickPhysicalDevice();
+		createLogicalDevice();
+		threadPool.create(ThreadPool::defaultThreadCount());
+		allocator.create(physicalDevice, device);
+		descriptorLayouts.create(device);
+		descriptorAllocator.create(device, config.framesInFlight);
+
+		// Pipelines only depend on the image format, so they compile on the workers while the rest is set up.
+		chooseImageFormat();
+		createRenderPass();
+		createPipelineLayout();
+		pipelineCache.create(physicalDevice, device, pipelineCachePath, pipelineCreationFeedbackSupported);
+		shaderLibrary.create(device);
+		pipelineBuilder.create(pipelineCache, shaderLibrary, threadPool);
+		auto pipelinesQueued{ std::chrono::steady_clock::now() };
+		std::vector<std::future<VkPipeline>> pipelineBuilds{ queuePipelineBuilds() };
+
+		createUploadQueue();
+		createMeshes();
+		createUniformRing();
+		if (instanced())
+			createInstanceTransforms();
+		if (config.gpuDriven)
+			createGpuCuller();
+		if (config.headless)
+			createHeadlessImages();
+		else
+			createSwapChain();
+		createImageViews();
+		createDepthImage();
+		createFramebuffers();
+		createCommandPool();
+		createFrameContexts();
+		createRenderFinishedSemaphores();
+		createCommandRecorder();
+		createProfilers();
+
+		auto setupDone{ std::chrono::steady_clock::now() };
+		graphicsPipeline = pipelineBuilds[0].get();
+		quantizedPipeline = pipelineBuilds[1].get();
+		instancedPipeline = pipelineBuilds[2].get();
+		quantizedInstancedPipeline = pipelineBuilds[3].get();
+		if (config.gpuDriven)
+		{
+			gpuDrivenPipeline = pipelineBuilds[4].get();
+			quantizedGpuDrivenPipeline = pipelineBuilds[5].get();
+			cullPipeline = pipelineBuilds[6].get();
+		}
+
+		auto end{ std::chrono::steady_clock::now() };
+
+		std::cout << "Pipelines ready " << std::chrono::duration<double, std::milli>(end - pipelinesQueued).count()
+			<< " ms after being queued, " << std::chrono::duration<double, std::milli>(end - setupDone).count()
+			<< " ms of it spent waiting after the rest of setup\n";
+		pipelineCache.printStatistics();
+		shaderLibrary.printStatistics();
+		allocator.printStatistics();
+		deviceCapabilityCache.printStatistics();
+		std::cout << "Vulkan initialized in " << std::chrono::duration<double, std::milli>(end - start).count() << " ms\n\n";
 	}
 
-	bool checkValidationLayersSupport()
+	void mainLoop()
 	{
-		// TODO: maybe use std::set with erase to perform this check?
-		uint32_t layerCount{};
-		vkEnumerateInstanceLayerProperties(&layerCount, nullptr);
+		auto loopStart{ std::chrono::steady_clock::now() };
 
-		std::vector<VkLayerProperties> availableLayers(layerCount);
-		vkEnumerateInstanceLayerProperties(&layerCount, availableLayers.data());
+		applyFrameLimit();
 
-		for (const char* layerName : validationLayers)
+		while (config.frameCount == 0 || frameNumber < config.frameCount)
 		{
-			bool found{ false };
+			// Waiting before polling input keeps the limiter's idle time out of the input-to-photon latency.
+			{
+				PROFILE_ZONE("frame limiter");
+				frameLimiter.wait();
+			}
 
-			for (const auto& layerProperties : availableLayers)
+			if (!config.headless)
 			{
-				if (strcmp(layerName, layerProperties.layerName) == 0)
-				{
-					found = true;
+				if (glfwWindowShouldClose(window))
 					break;
+
+				{
+					PROFILE_ZONE("poll events");
+					glfwPollEvents();
+				}
+
+				// A minimized window has no surface area to render to; sleep until it comes back.
+				int framebufferWidth{}, framebufferHeight{};
+				glfwGetFramebufferSize(window, &framebufferWidth, &framebufferHeight);
+				if (framebufferWidth == 0 || framebufferHeight == 0)
+				{
+					glfwWaitEvents();
+					continue;
 				}
 			}
 
-			if (!found)
-				return false;
+			drawFrame();
+			frameStats.reportPeriodically();
+			CpuProfiler::collect(trace);
 		}
 
-		return true;
-	}
+		vkDeviceWaitIdle(device);
 
-	bool checkExtensionsSupport(const std::vector<const char*>& glfwExtensions)
-	{
-		// TODO: maybe use std::set with erase to perform this check?
-		uint32_t extensionsCount{ 0 };
-		vkEnumerateInstanceExtensionProperties(nullptr, &extensionsCount, nullptr);
+		reportPresentStats();
+		descriptorAllocator.printStatistics();
+		uniformRing.printStatistics();
+		reportVertexThroughput();
+		reportInstancing();
+		if (config.gpuDriven)
+			gpuCuller.printStatistics(cullingSamples > 0 ? cullingGpuMs / cullingSamples : 0.0);
+		CpuProfiler::collect(trace);
+		CpuProfiler::printSummary();
+		trace.write();
 
-		std::vector<VkExtensionProperties> availableExtensions(extensionsCount);
-		vkEnumerateInstanceExtensionProperties(nullptr, &extensionsCount, availableExtensions.data());
+		double seconds{ std::chrono::duration<double>(std::chrono::steady_clock::now() - loopStart).count() };
+		std::cout << "Rendered " << frameNumber << " frames in " << seconds << " s ("
+			<< (seconds > 0.0 ? frameNumber / seconds : 0.0) << " fps)\n\n";
 
-		for (const char* extensionName : glfwExtensions)
+		if (!config.readbackPath.empty())
 		{
-			bool found{ false };
-
-			for (const auto& extension : availableExtensions)
-			{
-				if (strcmp(extensionName, extension.extensionName) == 0)
-				{
-					found = true;
-					break;
-				}
-			}
-
-			if (!found)
-				return false;
+			// Slots are used round robin, so the last submitted frame lives in the previous slot.
+			readbackImage((currentFrame + config.framesInFlight - 1) % config.framesInFlight, config.readbackPath);
 		}
-
-		return true;
 	}
 
-	bool checkDeviceExtensionsSupport(VkPhysicalDevice dev)
+	void drawFrame()
 	{
-		uint32_t extensionsCount{};
-		vkEnumerateDeviceExtensionProperties(dev, nullptr, &extensionsCount, nullptr);
+		PROFILE_FUNCTION();
+
+		using clock = std::chrono::steady_clock;
 
-		std::vector<VkExtensionProperties> availableExtensions(extensionsCount);
-		vkEnumerateDeviceExtensionProperties(dev, nullptr, &extensionsCount, availableExtensions.data());
+		FrameContext& frame{ frames[currentFrame] };
+		FrameTimings timings{};
 
-		std::set<std::string> requiredExtensions(deviceExtensions.begin(), deviceExtensions.end());
+		auto frameStart{ clock::now() };
 
-		for (const auto& extension : availableExtensions)
 		{
-			requiredExtensions.erase(extension.extensionName);
+			PROFILE_ZONE("wait for frame slot");
+			graphicsQueue.wait(frame.submittedValue);
 		}
 
-		return requiredExtensions.empty();
-	}
+		auto fenceSignaled{ clock::now() };
 
-	bool isDeviceSuitable(VkPhysicalDevice dev)
-	{
-		VkPhysicalDeviceProperties deviceProperties{};
-		vkGetPhysicalDeviceProperties(dev, &deviceProperties);
+		// Sets allocated by the frame that last used this slot are no longer referenced by the GPU.
+		descriptorAllocator.beginFrame(currentFrame);
+		uniformRing.beginFrame(currentFrame);
 
-		SwapChainSupportDetails swapChainSupport{ querySwapChainSupport(dev) };
-		bool swapChainAdequate = !swapChainSupport.formats.empty() && !swapChainSupport.presentModes.empty();
+		float seconds{ std::chrono::duration<float>(frameStart - startTime).count() };
+		glm::mat4 viewProjection{ cameraViewProjection(seconds) };
+		cameraOffset = uniformRing.push(CameraConstants{ .viewProjection{ viewProjection } });
 
-		return deviceProperties.deviceType == VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU
-			&& findQueueFamilies(dev).isComplete()
-			&& checkDeviceExtensionsSupport(dev)
-			&& swapChainAdequate;
-	}
+		if (instanced())
+			instanceTransforms.update(currentFrame, seconds, fitToUnit(meshLibrary.get(sceneMesh)));
 
-	VkResult createDebugUtilsMessengerEXT(VkInstance inst,
-		const VkDebugUtilsMessengerCreateInfoEXT* pCreateInfo,
-		const VkAllocationCallbacks* pAllocator,
-		VkDebugUtilsMessengerEXT* debugMesng)
-	{
-		auto func{ (PFN_vkCreateDebugUtilsMessengerEXT)vkGetInstanceProcAddr(inst, "vkCreateDebugUtilsMessengerEXT") };
-		if (func != nullptr)
-			return func(inst, pCreateInfo, pAllocator, debugMesng);
-		else
-			return VK_ERROR_EXTENSION_NOT_PRESENT;
-	}
+		if (config.gpuDriven)
+		{
+			gpuCuller.collect(currentFrame);
+			cullConstantsOffset = uniformRing.push(gpuCuller.constants(viewProjection));
+		}
 
-	void destroyDebugUtilsMessengerEXT(VkInstance inst,
-		VkDebugUtilsMessengerEXT debugMesng,
-		const VkAllocationCallbacks* pAllocator)
-	{
-		auto func{ (PFN_vkDestroyDebugUtilsMessengerEXT)vkGetInstanceProcAddr(inst, "vkDestroyDebugUtilsMessengerEXT") };
-		if (func != nullptr)
-			return func(inst, debugMesng, pAllocator);
-	}
+		// Results of the frame that last used this slot; the first scope spans its whole command buffer.
+		const std::vector<GpuScopeTiming>& gpuScopes{ gpuProfiler.collect(currentFrame) };
+		if (!gpuScopes.empty())
+			timings.gpuMs = gpuScopes.front().milliseconds();
 
-	QueueFamilyIndices findQueueFamilies(VkPhysicalDevice dev)
-	{
-		QueueFamilyIndices indices{};
+		for (const auto& scope : gpuScopes)
+		{
+			trace.add(gpuTrack, scope.name, scope.start, scope.end);
+
+			if (std::string_view{ scope.name } == "main pass")
+			{
+				mainPassGpuMs += scope.milliseconds();
+				++mainPassSamples;
+			}
+		}
+
+		// The slot's graphics submit waited on its compute submit, so the culling results are ready as well.
+		if (config.gpuDriven)
+		{
+			for (const auto& scope : computeProfiler.collect(currentFrame))
+			{
+				trace.add(computeTrack, scope.name, scope.start, scope.end);
+
+				if (std::string_view{ scope.name } == "culling")
+				{
+					cullingGpuMs += scope.milliseconds();
+					++cullingSamples;
+				}
+			}
+		}
 
-		uint32_t queueFamilyCount{ 0 };
-		vkGetPhysicalDeviceQueueFamilyProperties(dev, &queueFamilyCount, nullptr);
+		if (!config.headless)
+		{
+			destroyRetiredSwapChains(false);
 
-		std::vector<VkQueueFamilyProperties> queueFamilies(queueFamilyCount);
-		vkGetPhysicalDeviceQueueFamilyProperties(dev, &queueFamilyCount, queueFamilies.data());
+			if (swapChainOutOfDate)
+				recreateSwapChain();
+		}
 
-		uint32_t index{ 0 };
-		VkBool32 presentSupport{ false };
-		for (const auto& queueFamily : queueFamilies)
+		// Headless runs own one offscreen image per frame slot, so there is nothing to acquire.
+		uint32_t imageIndex{ currentFrame };
+		auto acquireStart{ fenceSignaled };
+		if (!config.headless)
 		{
-			if (queueFamily.queueFlags & VK_QUEUE_GRAPHICS_BIT)
-				indices.graphicsFamily = index;
+			PROFILE_ZONE("acquire image");
+			acquireStart = clock::now();
 
-			vkGetPhysicalDeviceSurfaceSupportKHR(dev, index, surface, &presentSupport);
+			VkResult result{ vkAcquireNextImageKHR(device, swapChain, std::numeric_limits<uint64_t>::max(),
+				frame.imageAvailableSemaphore, VK_NULL_HANDLE, &imageIndex) };
 
-			if (presentSupport)
-				indices.presentFamily = index;
+			// Nothing was signaled and nothing was submitted, so the slot is simply tried again next iteration.
+			if (result == VK_ERROR_OUT_OF_DATE_KHR)
+			{
+				recreateSwapChain();
+				return;
+			}
 
-			if (indices.isComplete())
-				break;
+			// A suboptimal image is still presentable, so this frame goes ahead and the swap chain is replaced on the next one.
+			if (result == VK_SUBOPTIMAL_KHR)
+				swapChainOutOfDate = true;
+			else if (result != VK_SUCCESS)
+				throw std::runtime_error("Failed to acquire a swap chain image!");
 
-			++index;
+			// With more frames in flight than swap chain images an image can come back while another slot still renders to it.
+			graphicsQueue.wait(imagesInFlight[imageIndex]);
 		}
 
-		return indices;
-	}
+		auto imageAcquired{ clock::now() };
 
-	SwapChainSupportDetails querySwapChainSupport(VkPhysicalDevice dev)
-	{
-		SwapChainSupportDetails details{};
+		// Everything queued for upload since the last frame goes out in one transfer submit that this frame waits on.
+		UploadBatch uploads{ uploadQueue.flush(currentFrame) };
+		sceneMeshResident = meshLibrary.isResident(sceneMesh) && (!config.gpuDriven || uploadQueue.isUploaded(gpuCuller.uploadTicket()));
 
-		vkGetPhysicalDeviceSurfaceCapabilitiesKHR(dev, surface, &details.capabilities);
+		std::vector<SemaphoreWait> waits{};
+		std::vector<VkSemaphore> binarySignals{};
 
-		uint32_t formatsCount{};
-		vkGetPhysicalDeviceSurfaceFormatsKHR(dev, surface, &formatsCount, nullptr);
-		if (formatsCount != 0)
+		if (config.gpuDriven)
+			waits.push_back(submitCompute(frame, uploads));
+
+		vkResetCommandBuffer(frame.commandBuffer, 0);
+		recordCommandBuffer(frame.commandBuffer, imageIndex, uploads);
+
+		if (!config.headless)
 		{
-			details.formats.resize(formatsCount);
-			vkGetPhysicalDeviceSurfaceFormatsKHR(dev, surface, &formatsCount, details.formats.data());
+			waits.push_back({ .semaphore{ frame.imageAvailableSemaphore }, .stages{ VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT } });
+			binarySignals.push_back(renderFinishedSemaphores[imageIndex]);
 		}
 
-		uint32_t presentModesCount{};
-		vkGetPhysicalDeviceSurfacePresentModesKHR(dev, surface, &presentModesCount, nullptr);
-		if (formatsCount != 0)
+		if (uploads.wait.semaphore != VK_NULL_HANDLE)
+			waits.push_back(uploads.wait);
+
 		{
-			details.presentModes.resize(formatsCount);
-			vkGetPhysicalDeviceSurfacePresentModesKHR(dev, surface, &presentModesCount, details.presentModes.data());
+			PROFILE_ZONE("submit");
+			frame.submittedValue = graphicsQueue.submit({ frame.commandBuffer }, waits, binarySignals);
 		}
 
-		return details;
-	}
+		if (!config.headless)
+			imagesInFlight[imageIndex] = frame.submittedValue;
 
-	VkSurfaceFormatKHR chooseSwapSurfaceFormat(const std::vector<VkSurfaceFormatKHR>& availableFormats)
-	{
-		for (const auto& availableFormat : availableFormats)
+		gpuProfiler.markSubmitted(clock::now());
+
+		if (!config.headless)
 		{
-			if (availableFormat.format == VK_FORMAT_B8G8R8A8_SRGB
-				&& availableFormat.colorSpace == VK_COLOR_SPACE_SRGB_NONLINEAR_KHR)
-			{
-				return availableFormat;
-			}
+			PROFILE_ZONE("present");
+
+			VkPresentInfoKHR presentInfo{
+				.sType{ VK_STRUCTURE_TYPE_PRESENT_INFO_KHR },
+				.waitSemaphoreCount{ 1 },
+				.pWaitSemaphores{ &renderFinishedSemaphores[imageIndex] },
+				.swapchainCount{ 1 },
+				.pSwapchains{ &swapChain },
+				.pImageIndices{ &imageIndex }
+			};
+
+			VkResult result{ vkQueuePresentKHR(presentQueue, &presentInfo) };
+			presentStats.add(std::chrono::duration<double, std::milli>(clock::now() - acquireStart).count());
+			if (result == VK_ERROR_OUT_OF_DATE_KHR || result == VK_SUBOPTIMAL_KHR)
+				swapChainOutOfDate = true;
+			else if (result != VK_SUCCESS)
+				throw std::runtime_error("Failed to present the swap chain image!");
 		}
 
-		return availableFormats[0];
-	}
+		auto frameEnd{ clock::now() };
 
-	VkPresentModeKHR chooseSwapPresentMode(const std::vector<VkPresentModeKHR>& availablePresentModes)
-	{
-		for (const auto& availablePresentMode : availablePresentModes)
-			if (availablePresentMode == VK_PRESENT_MODE_MAILBOX_KHR)
-				return availablePresentMode;
+		timings.fenceWaitMs = std::chrono::duration<double, std::milli>(fenceSignaled - frameStart).count();
+		timings.acquireWaitMs = std::chrono::duration<double, std::milli>(imageAcquired - fenceSignaled).count();
+		timings.recordSubmitMs = std::chrono::duration<double, std::milli>(frameEnd - imageAcquired).count();
+		timings.frameMs = std::chrono::duration<double, std::milli>(frameEnd - frameStart).count();
+		frameStats.add(timings);
+
+		if (frameNumber == 0)
+			std::cout << "First frame submitted " << std::chrono::duration<double, std::milli>(frameEnd - startTime).count() << " ms after startup\n\n";
 
-		return VK_PRESENT_MODE_FIFO_KHR;
+		++frameNumber;
+		currentFrame = (currentFrame + 1) % config.framesInFlight;
 	}
 
-	VkExtent2D chooseSwapExtent(const VkSurfaceCapabilitiesKHR& capabilities)
+	// Culls the frame's objects on the compute queue. Submitted every GPU-driven frame, also before the scene is
+	// resident, so the uploads the pass reads are acquired by the compute family in the frame they arrive. Returns
+	// what the graphics submit waits on before its indirect draw.
+	SemaphoreWait submitCompute(FrameContext& frame, const UploadBatch& uploads)
 	{
-		if (capabilities.currentExtent.width != std::numeric_limits<uint32_t>::max())
-			return capabilities.currentExtent;
-		else
-		{
-			int width{}, height{};
-			glfwGetFramebufferSize(window, &width, &height);
+		PROFILE_FUNCTION();
 
-			VkExtent2D actualExtent{
-				.width{ static_cast<uint32_t>(width) },
-				.height{ static_cast<uint32_t>(height) }
-			};
+		VkCommandBuffer commandBuffer{ frame.computeCommandBuffer };
+		vkResetCommandBuffer(commandBuffer, 0);
 
-			actualExtent.width = std::clamp(actualExtent.width, capabilities.minImageExtent.width, capabilities.maxImageExtent.width);
-			actualExtent.height = std::clamp(actualExtent.height, capabilities.minImageExtent.height, capabilities.maxImageExtent.height);
-			return actualExtent;
+		VkCommandBufferBeginInfo beginInfo{
+			.sType{ VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO },
+			.flags{ VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT }
+		};
+
+		if (vkBeginCommandBuffer(commandBuffer, &beginInfo) != VK_SUCCESS)
+			throw std::runtime_error("Failed to begin recording the compute command buffer!");
+
+		computeProfiler.beginFrame(commandBuffer, currentFrame, frameNumber);
+
+		UploadQueue::recordAcquireBarriers(commandBuffer, uploads, UploadConsumer::Compute);
+
+		if (sceneMeshResident)
+		{
+			GpuScope cullingScope{ computeProfiler, commandBuffer, "culling" };
+			gpuCuller.recordCull(commandBuffer, currentFrame, cullPipeline, cullPipelineLayout, cullConstantsOffset);
 		}
+
+		if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS)
+			throw std::runtime_error("Failed to record the compute command buffer!");
+
+		std::vector<SemaphoreWait> waits{};
+		if (uploads.computeWait.semaphore != VK_NULL_HANDLE)
+			waits.push_back(uploads.computeWait);
+
+		uint64_t cullValue{ computeQueue.submit({ commandBuffer }, waits) };
+		computeProfiler.markSubmitted(std::chrono::steady_clock::now());
+
+		return computeQueue.waitFor(cullValue, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT);
 	}
 
-	void createSwapChain()
+	void recordCommandBuffer(VkCommandBuffer commandBuffer, uint32_t imageIndex, const UploadBatch& uploads)
 	{
-		SwapChainSupportDetails swapChainSupport{ querySwapChainSupport(physicalDevice) };
+		PROFILE_FUNCTION();
 
-		VkSurfaceFormatKHR surfaceFormat{ chooseSwapSurfaceFormat(swapChainSupport.formats) };
-		VkPresentModeKHR presentMode{ chooseSwapPresentMode(swapChainSupport.presentModes) };
-		swapChainExtent = chooseSwapExtent(swapChainSupport.capabilities);
+		VkCommandBufferBeginInfo beginInfo{
+			.sType{ VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO },
+			.flags{ VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT }
+		};
 
-		uint32_t imageCount{ swapChainSupport.capabilities.minImageCount + 1 };
-		if (swapChainSupport.capabilities.maxImageCount > 0
-			&& imageCount > swapChainSupport.capabilities.maxImageCount)
-		{
-			imageCount = swapChainSupport.capabilities.maxImageCount;
-		}
+		if (vkBeginCommandBuffer(commandBuffer, &beginInfo) != VK_SUCCESS)
+			throw std::runtime_error("Failed to begin recording the command buffer!");
 
-		swapChainImageFormat = surfaceFormat.format;
+		gpuProfiler.beginFrame(commandBuffer, currentFrame, frameNumber);
+		uint32_t frameScope{ gpuProfiler.beginScope(commandBuffer, "frame") };
 
-		VkSwapchainCreateInfoKHR createInfo{
-			.sType{ VK_STRUCTURE_TYPE_SWAPCHAIN_CREATE_INFO_KHR },
-			.surface{ surface },
-			.minImageCount{ imageCount },
-			.imageFormat{ surfaceFormat.format },
-			.imageColorSpace{ surfaceFormat.colorSpace },
-			.imageExtent{ swapChainExtent },
-			.imageArrayLayers{ 1 },
-			.imageUsage{ VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT }
+		UploadQueue::recordAcquireBarriers(commandBuffer, uploads);
+
+		// The culling pass already went to the compute queue in submitCompute.
+		if (config.gpuDriven && sceneMeshResident)
+			gpuCuller.recordAcquire(commandBuffer, currentFrame);
+
+		std::array<VkClearValue, 2> clearValues{};
+		clearValues[0].color = { .float32{ 0.0f, 0.0f, 0.0f, 1.0f } };
+		clearValues[1].depthStencil = { .depth{ 1.0f }, .stencil{ 0 } };
+
+		VkRenderPassBeginInfo renderPassInfo{
+			.sType{ VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO },
+			.renderPass{ renderPass },
+			.framebuffer{ swapChainFramebuffers[imageIndex] },
+			.renderArea{
+				.offset{ 0, 0 },
+				.extent{ swapChainExtent }
+			},
+			.clearValueCount{ static_cast<uint32_t>(clearValues.size()) },
+			.pClearValues{ clearValues.data() }
 		};
 
-		QueueFamilyIndices indices{ findQueueFamilies(physicalDevice) };
-		uint32_t queueFamilyIndices[] = { indices.graphicsFamily.value(), indices.presentFamily.value() };
+		uint32_t mainPassScope{ gpuProfiler.beginScope(commandBuffer, "main pass") };
 
-		if (indices.graphicsFamily != indices.presentFamily)
+		if (config.recordThreads > 1)
 		{
-			createInfo.imageSharingMode = VK_SHARING_MODE_CONCURRENT;
-			createInfo.queueFamilyIndexCount = 2;
+			vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
+
+			VkCommandBufferInheritanceInfo inheritance{
+				.sType{ VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO },
+				.renderPass{ renderPass },
+				.subpass{ 0 },
+				.framebuffer{ swapChainFramebuffers[imageIndex] }
+			};
+
+			commandRecorder.record(commandBuffer, currentFrame, inheritance, config.drawCount,
+				[this](VkCommandBuffer secondary, uint32_t begin, uint32_t end) { recordDraws(secondary, begin, end); });
+		}
+		else
+		{
+			vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+			recordDraws(commandBuffer, 0, config.drawCount);
+		}
+
+		vkCmdEndRenderPass(commandBuffer);
+		gpuProfiler.endScope(commandBuffer, mainPassScope);
+
+		gpuProfiler.endScope(commandBuffer, frameScope);
+
+		if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS)
+			throw std::runtime_error("Failed to record the command buffer!");
+	}
+
+	// Records draws [begin, end) of the frame. Dynamic state is not inherited by secondary command buffers,
+	// so every range binds and sets everything it uses.
+	void recordDraws(VkCommandBuffer commandBuffer, uint32_t begin, uint32_t end)
+	{
+		PROFILE_FUNCTION();
+
+		if (!sceneMeshResident)
+			return;
+
+		const Mesh& mesh{ meshLibrary.get(sceneMesh) };
+
+		bool quantized{ mesh.vertexFormat == MeshVertexFormat::Quantized };
+		VkPipeline pipeline{ quantized ? quantizedPipeline : graphicsPipeline };
+		if (config.gpuDriven)
+			pipeline = quantized ? quantizedGpuDrivenPipeline : gpuDrivenPipeline;
+		else if (instanced())
+			pipeline = quantized ? quantizedInstancedPipeline : instancedPipeline;
+
+		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
+		mesh.bind(commandBuffer);
+
+		VkRect2D scissor{
+			.offset{ 0, 0 },
+			.extent{ swapChainExtent }
+		};
+		vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+
+		VkViewport viewport{
+			.x{ 0.0f },
+			.y{ 0.0f },
+			.width{ static_cast<float>(swapChainExtent.width) },
+			.height{ static_cast<float>(swapChainExtent.height) },
+			.minDepth{ 0.0f },
+			.maxDepth{ 1.0f }
+		};
+		vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+
+		if (config.gpuDriven)
+		{
+			recordGpuDrivenDraw(commandBuffer);
+			return;
+		}
+
+		uint32_t lod{ drawLod() };
+
+		if (instanced())
+		{
+			recordInstancedDraw(commandBuffer, mesh, lod);
+			return;
+		}
+
+		uint32_t gridSize{ drawGridSize() };
+		float cellSize{ 2.0f / gridSize };
+		glm::mat4 meshTransform{ fitToUnit(mesh) };
+
+		for (uint32_t draw{ begin }; draw < end; ++draw)
+		{
+			// Pushed to z = 0.5 so meshes up to one unit deep stay inside the [0, 1] depth range.
+			glm::vec3 cellCenter{ -1.0f + ((draw % gridSize) + 0.5f) * cellSize, -1.0f + ((draw / gridSize) + 0.5f) * cellSize, 0.5f };
+			float shade{ 0.5f + 0.5f * (draw + 1) / config.drawCount };
+
+			ObjectConstants object{
+				.model{ glm::scale(glm::translate(glm::mat4{ 1.0f }, cellCenter), glm::vec3{ 1.0f / gridSize, 1.0f / gridSize, 1.0f }) * meshTransform },
+				.tint{ shade, shade, shade, 1.0f }
+			};
+
+			// The set never changes; only the object's offset into this frame's part of the ring does.
+			std::array<uint32_t, 2> dynamicOffsets{ cameraOffset, uniformRing.push(object) };
+			vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1, &drawSet,
+				static_cast<uint32_t>(dynamicOffsets.size()), dynamicOffsets.data());
+
+			mesh.draw(commandBuffer, lod);
+		}
+	}
+
+	// The whole scene is one draw whatever the instance count: the transforms were written by
+	// InstanceTransforms::update, so recording costs the same for a hundred instances as for a million.
+	void recordInstancedDraw(VkCommandBuffer commandBuffer, const Mesh& mesh, uint32_t lod)
+	{
+		auto start{ std::chrono::steady_clock::now() };
+
+		instanceTransforms.bind(commandBuffer, currentFrame);
+
+		std::array<uint32_t, 2> dynamicOffsets{ cameraOffset, uniformRing.push(ObjectConstants{}) };
+		vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1, &drawSet,
+			static_cast<uint32_t>(dynamicOffsets.size()), dynamicOffsets.data());
+
+		mesh.draw(commandBuffer, lod, instanceTransforms.count());
+
+		instancedDrawMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+		++instancedDrawSamples;
+	}
+
+	// Which objects are drawn, and with which index range, was decided by the culling pass; this only records the
+	// indirect draw that reads its output.
+	void recordGpuDrivenDraw(VkCommandBuffer commandBuffer)
+	{
+		std::array<VkDescriptorSet, 2> sets{ drawSet, gpuCuller.objectDescriptorSet() };
+		std::array<uint32_t, 2> dynamicOffsets{ cameraOffset, uniformRing.push(ObjectConstants{}) };
+		vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, gpuDrivenPipelineLayout, 0,
+			static_cast<uint32_t>(sets.size()), sets.data(), static_cast<uint32_t>(dynamicOffsets.size()), dynamicOffsets.data());
+
+		gpuCuller.recordDraw(commandBuffer, currentFrame);
+	}
+
+	// Centers bounds and scales their largest side to one unit, whatever units the file was authored in.
+	static glm::mat4 unitTransform(const MeshBounds& bounds)
+	{
+		float largestSide{ std::max({ bounds.extent().x, bounds.extent().y, bounds.extent().z, 1e-6f }) };
+		return glm::translate(glm::scale(glm::mat4{ 1.0f }, glm::vec3{ 1.0f / largestSide }), -bounds.center());
+	}
+
+	// From the mesh's vertex positions, quantized or not, to the unit-sized space of unitTransform.
+	static glm::mat4 fitToUnit(const Mesh& mesh)
+	{
+		return unitTransform(mesh.bounds) * mesh.positionTransform;
+	}
+
+	// GPU-driven scenes cover twice the view's width and height and the camera pans across them, so the culling
+	// pass always has objects to reject. Everything else is drawn with an identity camera.
+	glm::mat4 cameraViewProjection(float seconds) const
+	{
+		if (!config.gpuDriven)
+			return glm::mat4{ 1.0f };
+
+		return glm::translate(glm::mat4{ 1.0f }, glm::vec3{ std::sin(seconds * 0.3f), std::cos(seconds * 0.2f), 0.0f });
+	}
+
+	// Instances whose transforms the CPU writes every frame, as opposed to GPU-driven ones.
+	bool instanced() const
+	{
+		return config.instanceCount > 0 && !config.gpuDriven;
+	}
+
+	// Separate draws or instances, whichever the scene is made of.
+	uint32_t objectCount() const
+	{
+		return config.instanceCount > 0 ? config.instanceCount : config.drawCount;
+	}
+
+	// Each object gets its own cell of a square grid; a single one covers the whole framebuffer.
+	uint32_t drawGridSize() const
+	{
+		return static_cast<uint32_t>(std::ceil(std::sqrt(static_cast<double>(objectCount()))));
+	}
+
+	// Every halving of the cell size quarters its area, which is what each coarser LOD does to the triangle count.
+	uint32_t drawLod() const
+	{
+		return static_cast<uint32_t>(std::bit_width(drawGridSize())) - 1;
+	}
+
+	// Vertex-bound runs (big meshes, many draws) are limited by vertex fetch, so comparing this between runs with
+	// --vertex-format float and quantized shows what the smaller vertices buy.
+	void reportVertexThroughput() const
+	{
+		if (mainPassSamples == 0)
+			return;
+
+		const Mesh& mesh{ meshLibrary.get(sceneMesh) };
+		const MeshLod& lod{ mesh.lods[std::min<size_t>(drawLod(), mesh.lods.size() - 1)] };
+
+		double indicesPerFrame{ static_cast<double>(lod.indexCount) * objectCount() };
+		double averageMs{ mainPassGpuMs / mainPassSamples };
+		// An upper bound; the post-transform cache skips fetching vertices it has seen recently.
+		double bytesPerFrame{ indicesPerFrame * vertexStride(mesh.vertexFormat) };
+
+		std::cout << "Vertex fetch (" << mesh.name << ", " << toString(mesh.vertexFormat) << ", " << vertexStride(mesh.vertexFormat)
+			<< " bytes per vertex): " << std::fixed << std::setprecision(3) << averageMs << " ms main pass, "
+			<< indicesPerFrame / averageMs / 1e3 << " M indices/s, up to " << bytesPerFrame / averageMs / 1e6 << " GB/s"
+			<< std::defaultfloat << "\n\n";
+	}
+
+	// Compare with a run using --draws and the same count: the update replaces per-draw recording, and should
+	// scale with the instance count at a far lower cost per object.
+	void reportInstancing() const
+	{
+		if (!instanced())
+			return;
+
+		instanceTransforms.printStatistics();
+
+		if (instancedDrawSamples > 0)
+			std::cout << "Instanced draw: " << config.instanceCount << " instances in one draw, " << std::fixed << std::setprecision(3)
+				<< instancedDrawMs / instancedDrawSamples * 1e3 << " us recording per frame" << std::defaultfloat << "\n\n";
+	}
+
+	void cleanup()
+	{
+		PROFILE_FUNCTION();
+
+		if (enableValidationLayers)
+			destroyDebugUtilsMessengerEXT(instance, debugMessenger, nullptr);
+
+		for (const auto& frame : frames)
+			vkDestroySemaphore(device, frame.imageAvailableSemaphore, nullptr);
+
+		for (const auto& semaphore : renderFinishedSemaphores)
+			vkDestroySemaphore(device, semaphore, nullptr);
+
+		gpuProfiler.destroy();
+		if (config.gpuDriven)
+			computeProfiler.destroy();
+
+		if (config.recordThreads > 1)
+			commandRecorder.destroy();
+		threadPool.destroy();
+
+		vkDestroyCommandPool(device, commandPool, nullptr);
+		if (config.gpuDriven)
+			vkDestroyCommandPool(device, computeCommandPool, nullptr);
+
+		for (const auto& framebuffer : swapChainFramebuffers)
+			vkDestroyFramebuffer(device, framebuffer, nullptr);
+
+		pipelineCache.save();
+		pipelineCache.destroy();
+
+		vkDestroyPipeline(device, graphicsPipeline, nullptr);
+		vkDestroyPipeline(device, quantizedPipeline, nullptr);
+		vkDestroyPipeline(device, instancedPipeline, nullptr);
+		vkDestroyPipeline(device, quantizedInstancedPipeline, nullptr);
+		vkDestroyPipeline(device, gpuDrivenPipeline, nullptr);
+		vkDestroyPipeline(device, quantizedGpuDrivenPipeline, nullptr);
+		vkDestroyPipeline(device, cullPipeline, nullptr);
+		shaderLibrary.destroy();
+		vkDestroyPipelineLayout(device, pipelineLayout, nullptr);
+		vkDestroyPipelineLayout(device, gpuDrivenPipelineLayout, nullptr);
+		vkDestroyPipelineLayout(device, cullPipelineLayout, nullptr);
+		if (instanced())
+			instanceTransforms.destroy();
+		if (config.gpuDriven)
+			gpuCuller.destroy();
+		uniformRing.destroy();
+		descriptorAllocator.destroy();
+		descriptorLayouts.destroy();
+		vkDestroyRenderPass(device, renderPass, nullptr);
+
+		// NOTE: is the reference appropriate here?
+		for (const auto& imageView : swapChainImageViews)
+		{
+			vkDestroyImageView(device, imageView, nullptr);
+		}
+
+		vkDestroyImageView(device, depthImageView, nullptr);
+		allocator.destroyImage(depthImage);
+
+		if (config.headless)
+		{
+			for (auto& image : headlessImages)
+				allocator.destroyImage(image);
+		}
+		else
+		{
+			destroyRetiredSwapChains(true);
+			vkDestroySwapchainKHR(device, swapChain, nullptr);
+		}
+
+		meshLibrary.destroy();
+		uploadQueue.destroy();
+		allocator.destroy();
+		graphicsQueue.destroy();
+		computeQueue.destroy();
+		transferQueue.destroy();
+		vkDestroyDevice(device, nullptr);
+
+		if (!config.headless)
+			vkDestroySurfaceKHR(instance, surface, nullptr);
+
+		vkDestroyInstance(instance, nullptr);
+
+		if (!config.headless)
+		{
+			glfwDestroyWindow(window);
+			glfwTerminate();
+		}
+	}
+
+	void populateDebugMessengerCreateInfo(VkDebugUtilsMessengerCreateInfoEXT& createInfo)
+	{
+		createInfo = {};
+		createInfo.sType = VK_STRUCTURE_TYPE_DEBUG_UTILS_MESSENGER_CREATE_INFO_EXT;
+		createInfo.messageSeverity = VK_DEBUG_UTILS_MESSAGE_SEVERITY_VERBOSE_BIT_EXT
+			| VK_DEBUG_UTILS_MESSAGE_SEVERITY_WARNING_BIT_EXT
+			| VK_DEBUG_UTILS_MESSAGE_SEVERITY_ERROR_BIT_EXT;
+		createInfo.messageType = VK_DEBUG_UTILS_MESSAGE_TYPE_GENERAL_BIT_EXT | VK_DEBUG_UTILS_MESSAGE_TYPE_VALIDATION_BIT_EXT | VK_DEBUG_UTILS_MESSAGE_TYPE_PERFORMANCE_BIT_EXT;
+		createInfo.pfnUserCallback = debugCallback;
+	}
+
+	std::vector<const char*> getRequiredExtensions()
+	{
+		std::vector<const char*> extensions{};
+
+		if (!config.headless)
+		{
+			uint32_t glfwExtensionsCount{ 0 };
+			const char** glfwExtensions{ glfwGetRequiredInstanceExtensions(&glfwExtensionsCount) };
+			extensions.assign(glfwExtensions, glfwExtensions + glfwExtensionsCount);
+		}
+
+		if (enableValidationLayers)
+			extensions.push_back(VK_EXT_DEBUG_UTILS_EXTENSION_NAME);
+
+		return extensions;
+	}
+
+	std::vector<const char*> getRequiredDeviceExtensions()
+	{
+		if (config.headless)
+			return {};
+
+		return deviceExtensions;
+	}
+
+	VkResult createDebugUtilsMessengerEXT(VkInstance inst,
+		const VkDebugUtilsMessengerCreateInfoEXT* pCreateInfo,
+		const VkAllocationCallbacks* pAllocator,
+		VkDebugUtilsMessengerEXT* debugMesng)
+	{
+		auto func{ (PFN_vkCreateDebugUtilsMessengerEXT)vkGetInstanceProcAddr(inst, "vkCreateDebugUtilsMessengerEXT") };
+		if (func != nullptr)
+			return func(inst, pCreateInfo, pAllocator, debugMesng);
+		else
+			return VK_ERROR_EXTENSION_NOT_PRESENT;
+	}
+
+	void destroyDebugUtilsMessengerEXT(VkInstance inst,
+		VkDebugUtilsMessengerEXT debugMesng,
+		const VkAllocationCallbacks* pAllocator)
+	{
+		auto func{ (PFN_vkDestroyDebugUtilsMessengerEXT)vkGetInstanceProcAddr(inst, "vkDestroyDebugUtilsMessengerEXT") };
+		if (func != nullptr)
+			return func(inst, debugMesng, pAllocator);
+	}
+
+	// Formats and present modes come from the capability snapshot; only the surface capabilities, whose current
+	// extent follows the window, are queried again.
+	SwapChainSupportDetails querySwapChainSupport()
+	{
+		SwapChainSupportDetails details{
+			.formats{ deviceCapabilities->surfaceFormats },
+			.presentModes{ deviceCapabilities->presentModes }
+		};
+
+		vkGetPhysicalDeviceSurfaceCapabilitiesKHR(physicalDevice, surface, &details.capabilities);
+
+		return details;
+	}
+
+	VkSurfaceFormatKHR chooseSwapSurfaceFormat(const std::vector<VkSurfaceFormatKHR>& availableFormats)
+	{
+		for (const auto& availableFormat : availableFormats)
+		{
+			if (availableFormat.format == VK_FORMAT_B8G8R8A8_SRGB
+				&& availableFormat.colorSpace == VK_COLOR_SPACE_SRGB_NONLINEAR_KHR)
+			{
+				return availableFormat;
+			}
+		}
+
+		return availableFormats[0];
+	}
+
+	VkExtent2D chooseSwapExtent(const VkSurfaceCapabilitiesKHR& capabilities)
+	{
+		if (capabilities.currentExtent.width != std::numeric_limits<uint32_t>::max())
+			return capabilities.currentExtent;
+		else
+		{
+			int width{}, height{};
+			glfwGetFramebufferSize(window, &width, &height);
+
+			VkExtent2D actualExtent{
+				.width{ static_cast<uint32_t>(width) },
+				.height{ static_cast<uint32_t>(height) }
+			};
+
+			actualExtent.width = std::clamp(actualExtent.width, capabilities.minImageExtent.width, capabilities.maxImageExtent.width);
+			actualExtent.height = std::clamp(actualExtent.height, capabilities.minImageExtent.height, capabilities.maxImageExtent.height);
+			return actualExtent;
+		}
+	}
+
+	// The render pass and pipelines only depend on the image formats, so they are picked before the swap chain exists.
+	void chooseImageFormat()
+	{
+		PROFILE_FUNCTION();
+
+		depthFormat = chooseDepthFormat();
+
+		if (config.headless)
+		{
+			swapChainImageFormat = headlessImageFormat;
+			return;
+		}
+
+		SwapChainSupportDetails swapChainSupport{ querySwapChainSupport() };
+		swapChainSurfaceFormat = chooseSwapSurfaceFormat(swapChainSupport.formats);
+		swapChainImageFormat = swapChainSurfaceFormat.format;
+	}
+
+	// D16 is the only depth format every device must support as an attachment; D32 is preferred where available.
+	VkFormat chooseDepthFormat() const
+	{
+		for (VkFormat format : { VK_FORMAT_D32_SFLOAT, VK_FORMAT_D16_UNORM })
+		{
+			VkFormatProperties properties{};
+			vkGetPhysicalDeviceFormatProperties(physicalDevice, format, &properties);
+
+			if (properties.optimalTilingFeatures & VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT)
+				return format;
+		}
+
+		throw std::runtime_error("Failed to find a supported depth format!");
+	}
+
+	// Builds the new swap chain from the old one and retires the old resources instead of waiting for the device
+	// to go idle; frames still in flight finish on the old images while the next frame already uses the new ones.
+	void recreateSwapChain()
+	{
+		PROFILE_FUNCTION();
+
+		swapChainOutOfDate = false;
+
+		retiredSwapChains.push_back({
+			.swapChain{ swapChain },
+			.imageViews{ std::move(swapChainImageViews) },
+			.framebuffers{ std::move(swapChainFramebuffers) },
+			.renderFinishedSemaphores{ std::move(renderFinishedSemaphores) },
+			.depthImage{ depthImage },
+			.depthImageView{ depthImageView },
+			.retiredAtFrame{ frameNumber }
+		});
+
+		auto start{ std::chrono::steady_clock::now() };
+
+		createSwapChain(retiredSwapChains.back().swapChain);
+		createImageViews();
+		createDepthImage();
+		createFramebuffers();
+		createRenderFinishedSemaphores();
+
+		// Timeline points guarding the old images are meaningless for the new ones.
+		imagesInFlight.assign(swapChainImages.size(), 0);
+
+		auto end{ std::chrono::steady_clock::now() };
+
+		std::cout << "Swap chain recreated at " << swapChainExtent.width << 'x' << swapChainExtent.height << " in "
+			<< std::chrono::duration<double, std::milli>(end - start).count() << " ms\n";
+	}
+
+	// Frame N is known to be complete once its slot has been waited on again by frame N + framesInFlight.
+	void destroyRetiredSwapChains(bool all)
+	{
+		PROFILE_FUNCTION();
+
+		std::erase_if(retiredSwapChains, [&](const RetiredSwapChain& retired)
+			{
+				if (!all && retired.retiredAtFrame + config.framesInFlight > frameNumber + 1)
+					return false;
+
+				for (const auto& framebuffer : retired.framebuffers)
+					vkDestroyFramebuffer(device, framebuffer, nullptr);
+
+				for (const auto& imageView : retired.imageViews)
+					vkDestroyImageView(device, imageView, nullptr);
+
+				for (const auto& semaphore : retired.renderFinishedSemaphores)
+					vkDestroySemaphore(device, semaphore, nullptr);
+
+				vkDestroyImageView(device, retired.depthImageView, nullptr);
+				AllocatedImage retiredDepthImage{ retired.depthImage };
+				allocator.destroyImage(retiredDepthImage);
+
+				vkDestroySwapchainKHR(device, retired.swapChain, nullptr);
+				return true;
+			});
+	}
+
+	void createSwapChain(VkSwapchainKHR oldSwapChain = VK_NULL_HANDLE)
+	{
+		PROFILE_FUNCTION();
+
+		SwapChainSupportDetails swapChainSupport{ querySwapChainSupport() };
+
+		PresentPolicy presentPolicy{ getPresentPolicy(presentProfile) };
+		swapChainPresentMode = choosePresentMode(presentPolicy, swapChainSupport.presentModes);
+		swapChainExtent = chooseSwapExtent(swapChainSupport.capabilities);
+
+		uint32_t imageCount{ chooseImageCount(presentPolicy, swapChainSupport.capabilities) };
+
+		VkSwapchainCreateInfoKHR createInfo{
+			.sType{ VK_STRUCTURE_TYPE_SWAPCHAIN_CREATE_INFO_KHR },
+			.surface{ surface },
+			.minImageCount{ imageCount },
+			.imageFormat{ swapChainSurfaceFormat.format },
+			.imageColorSpace{ swapChainSurfaceFormat.colorSpace },
+			.imageExtent{ swapChainExtent },
+			.imageArrayLayers{ 1 },
+			.imageUsage{ VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT }
+		};
+
+		uint32_t queueFamilyIndices[] = { queueFamilies.graphicsFamily.value(), queueFamilies.presentFamily.value() };
+
+		if (queueFamilies.graphicsFamily != queueFamilies.presentFamily)
+		{
+			createInfo.imageSharingMode = VK_SHARING_MODE_CONCURRENT;
+			createInfo.queueFamilyIndexCount = 2;
 			createInfo.pQueueFamilyIndices = queueFamilyIndices;
 		}
 		else
@@ -544,9 +1523,10 @@ private:
 
 		createInfo.preTransform = swapChainSupport.capabilities.currentTransform;
 		createInfo.compositeAlpha = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR;
-		createInfo.presentMode = presentMode;
+		createInfo.presentMode = swapChainPresentMode;
 		createInfo.clipped = VK_TRUE;
-		createInfo.oldSwapchain = VK_NULL_HANDLE;
+		// Lets the driver hand resources over from the old swap chain and keeps its acquired images presentable.
+		createInfo.oldSwapchain = oldSwapChain;
 
 		if (vkCreateSwapchainKHR(device, &createInfo, nullptr, &swapChain) != VK_SUCCESS)
 			throw std::runtime_error("Failed to create the swap chain!");
@@ -556,8 +1536,128 @@ private:
 		vkGetSwapchainImagesKHR(device, swapChain, &imageCount, swapChainImages.data());
 	}
 
+	void createHeadlessImages()
+	{
+		PROFILE_FUNCTION();
+
+		swapChainExtent = { static_cast<uint32_t>(width), static_cast<uint32_t>(height) };
+
+		VkImageCreateInfo imageInfo{
+			.sType{ VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO },
+			.imageType{ VK_IMAGE_TYPE_2D },
+			.format{ swapChainImageFormat },
+			.extent{ swapChainExtent.width, swapChainExtent.height, 1 },
+			.mipLevels{ 1 },
+			.arrayLayers{ 1 },
+			.samples{ VK_SAMPLE_COUNT_1_BIT },
+			.tiling{ VK_IMAGE_TILING_OPTIMAL },
+			.usage{ VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT },
+			.sharingMode{ VK_SHARING_MODE_EXCLUSIVE },
+			.initialLayout{ VK_IMAGE_LAYOUT_UNDEFINED }
+		};
+
+		for (uint32_t i{ 0 }; i < config.framesInFlight; ++i)
+		{
+			headlessImages.push_back(allocator.createImage(imageInfo, MemoryUsage::GpuOnly));
+			swapChainImages.push_back(headlessImages.back().image);
+		}
+
+		std::cout << "Headless: rendering " << config.frameCount << " frames into " << swapChainImages.size()
+			<< " offscreen " << swapChainExtent.width << 'x' << swapChainExtent.height << " images\n\n";
+	}
+
+	// Copies a rendered target into host memory and writes it as a binary PPM. Only used after the frame loop.
+	void readbackImage(uint32_t imageIndex, const std::string& path)
+	{
+		PROFILE_FUNCTION();
+
+		VkDeviceSize imageSize{ static_cast<VkDeviceSize>(swapChainExtent.width) * swapChainExtent.height * 4 };
+
+		AllocatedBuffer readbackBuffer{ allocator.createBuffer(imageSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT, MemoryUsage::GpuToCpu) };
+
+		VkCommandBufferAllocateInfo commandBufferInfo{
+			.sType{ VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO },
+			.commandPool{ commandPool },
+			.level{ VK_COMMAND_BUFFER_LEVEL_PRIMARY },
+			.commandBufferCount{ 1 }
+		};
+
+		VkCommandBuffer commandBuffer{};
+		vkAllocateCommandBuffers(device, &commandBufferInfo, &commandBuffer);
+
+		VkCommandBufferBeginInfo beginInfo{
+			.sType{ VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO },
+			.flags{ VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT }
+		};
+		vkBeginCommandBuffer(commandBuffer, &beginInfo);
+
+		// The render pass already left the image in TRANSFER_SRC_OPTIMAL.
+		VkBufferImageCopy region{
+			.bufferOffset{ 0 },
+			.bufferRowLength{ 0 },
+			.bufferImageHeight{ 0 },
+			.imageSubresource{
+				.aspectMask{ VK_IMAGE_ASPECT_COLOR_BIT },
+				.mipLevel{ 0 },
+				.baseArrayLayer{ 0 },
+				.layerCount{ 1 }
+			},
+			.imageOffset{ 0, 0, 0 },
+			.imageExtent{ swapChainExtent.width, swapChainExtent.height, 1 }
+		};
+		vkCmdCopyImageToBuffer(commandBuffer, swapChainImages[imageIndex], VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, readbackBuffer.buffer, 1, &region);
+
+		VkBufferMemoryBarrier hostBarrier{
+			.sType{ VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER },
+			.srcAccessMask{ VK_ACCESS_TRANSFER_WRITE_BIT },
+			.dstAccessMask{ VK_ACCESS_HOST_READ_BIT },
+			.srcQueueFamilyIndex{ VK_QUEUE_FAMILY_IGNORED },
+			.dstQueueFamilyIndex{ VK_QUEUE_FAMILY_IGNORED },
+			.buffer{ readbackBuffer.buffer },
+			.offset{ 0 },
+			.size{ VK_WHOLE_SIZE }
+		};
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0, 0, nullptr, 1, &hostBarrier, 0, nullptr);
+
+		vkEndCommandBuffer(commandBuffer);
+
+		graphicsQueue.wait(graphicsQueue.submit({ commandBuffer }));
+
+		allocator.invalidate(readbackBuffer.allocation);
+
+		std::ofstream file(path, std::ios::binary | std::ios::trunc);
+		if (!file.is_open())
+			std::cerr << "Failed to open " << path << " for the readback\n";
+		else
+		{
+			file << "P6\n" << swapChainExtent.width << ' ' << swapChainExtent.height << "\n255\n";
+
+			const auto* pixels{ static_cast<const unsigned char*>(readbackBuffer.allocation.mappedData) };
+			std::vector<char> row(static_cast<size_t>(swapChainExtent.width) * 3);
+			for (uint32_t y{ 0 }; y < swapChainExtent.height; ++y)
+			{
+				for (uint32_t x{ 0 }; x < swapChainExtent.width; ++x)
+				{
+					const unsigned char* pixel{ pixels + (static_cast<size_t>(y) * swapChainExtent.width + x) * 4 };
+					row[x * 3 + 0] = static_cast<char>(pixel[0]);
+					row[x * 3 + 1] = static_cast<char>(pixel[1]);
+					row[x * 3 + 2] = static_cast<char>(pixel[2]);
+				}
+
+				file.write(row.data(), static_cast<std::streamsize>(row.size()));
+			}
+
+			std::cout << "Wrote the last frame to " << path << "\n\n";
+		}
+
+		vkFreeCommandBuffers(device, commandPool, 1, &commandBuffer);
+		allocator.destroyBuffer(readbackBuffer);
+	}
+
 	void createImageViews()
 	{
+		PROFILE_FUNCTION();
+
 		swapChainImageViews.resize(swapChainImages.size());
 
 		for (size_t i{ 0 }; i < swapChainImages.size(); ++i)
@@ -587,67 +1687,481 @@ private:
 		}
 	}
 
-	static std::vector<char> readFile(const std::string& filename)
+	// Sized like the swap chain, so it is replaced whenever the swap chain is.
+	void createDepthImage()
 	{
-		std::ifstream file(filename, std::ios::ate | std::ios::binary);
+		PROFILE_FUNCTION();
+
+		VkImageCreateInfo imageInfo{
+			.sType{ VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO },
+			.imageType{ VK_IMAGE_TYPE_2D },
+			.format{ depthFormat },
+			.extent{ swapChainExtent.width, swapChainExtent.height, 1 },
+			.mipLevels{ 1 },
+			.arrayLayers{ 1 },
+			.samples{ VK_SAMPLE_COUNT_1_BIT },
+			.tiling{ VK_IMAGE_TILING_OPTIMAL },
+			.usage{ VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT },
+			.sharingMode{ VK_SHARING_MODE_EXCLUSIVE },
+			.initialLayout{ VK_IMAGE_LAYOUT_UNDEFINED }
+		};
 
-		if (!file.is_open())
-			throw std::runtime_error("Failed to open the file!");
+		depthImage = allocator.createImage(imageInfo, MemoryUsage::GpuOnly);
+
+		VkImageViewCreateInfo viewInfo{
+			.sType{ VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO },
+			.image{ depthImage.image },
+			.viewType{ VK_IMAGE_VIEW_TYPE_2D },
+			.format{ depthFormat },
+			.subresourceRange{
+				.aspectMask{ VK_IMAGE_ASPECT_DEPTH_BIT },
+				.baseMipLevel{ 0 },
+				.levelCount{ 1 },
+				.baseArrayLayer{ 0 },
+				.layerCount{ 1 }
+			}
+		};
+
+		if (vkCreateImageView(device, &viewInfo, nullptr, &depthImageView) != VK_SUCCESS)
+			throw std::runtime_error("Failed to create the depth image view!");
+	}
+
+	void createRenderPass()
+	{
+		PROFILE_FUNCTION();
+
+		VkAttachmentDescription colorAttachment{
+			.format{ swapChainImageFormat },
+			.samples{ VK_SAMPLE_COUNT_1_BIT },
+			.loadOp{ VK_ATTACHMENT_LOAD_OP_CLEAR },
+			.storeOp{ VK_ATTACHMENT_STORE_OP_STORE },
+			.stencilLoadOp{ VK_ATTACHMENT_LOAD_OP_DONT_CARE },
+			.stencilStoreOp{ VK_ATTACHMENT_STORE_OP_DONT_CARE },
+			.initialLayout{ VK_IMAGE_LAYOUT_UNDEFINED },
+			.finalLayout{ config.headless ? VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL : VK_IMAGE_LAYOUT_PRESENT_SRC_KHR }
+		};
+
+		// Only needed while the pass runs, so it is neither loaded nor stored.
+		VkAttachmentDescription depthAttachment{
+			.format{ depthFormat },
+			.samples{ VK_SAMPLE_COUNT_1_BIT },
+			.loadOp{ VK_ATTACHMENT_LOAD_OP_CLEAR },
+			.storeOp{ VK_ATTACHMENT_STORE_OP_DONT_CARE },
+			.stencilLoadOp{ VK_ATTACHMENT_LOAD_OP_DONT_CARE },
+			.stencilStoreOp{ VK_ATTACHMENT_STORE_OP_DONT_CARE },
+			.initialLayout{ VK_IMAGE_LAYOUT_UNDEFINED },
+			.finalLayout{ VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL }
+		};
+
+		std::array<VkAttachmentDescription, 2> attachments{ colorAttachment, depthAttachment };
+
+		VkAttachmentReference colorAttachmentRef{
+			.attachment{ 0 },
+			.layout{ VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL }
+		};
+
+		VkAttachmentReference depthAttachmentRef{
+			.attachment{ 1 },
+			.layout{ VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL }
+		};
+
+		VkSubpassDescription subpass{
+			.pipelineBindPoint{ VK_PIPELINE_BIND_POINT_GRAPHICS },
+			.colorAttachmentCount{ 1 },
+			.pColorAttachments{ &colorAttachmentRef },
+			.pDepthStencilAttachment{ &depthAttachmentRef }
+		};
+
+		// The depth clear also has to wait for the previous frame's depth writes, since all frames share the image.
+		VkSubpassDependency dependency{
+			.srcSubpass{ VK_SUBPASS_EXTERNAL },
+			.dstSubpass{ 0 },
+			.srcStageMask{ VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT },
+			.dstStageMask{ VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT },
+			.srcAccessMask{ VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT },
+			.dstAccessMask{ VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT }
+		};
+
+		VkRenderPassCreateInfo renderPassInfo{
+			.sType{ VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO },
+			.attachmentCount{ static_cast<uint32_t>(attachments.size()) },
+			.pAttachments{ attachments.data() },
+			.subpassCount{ 1 },
+			.pSubpasses{ &subpass },
+			.dependencyCount{ 1 },
+			.pDependencies{ &dependency }
+		};
 
-		size_t fileSize = static_cast<size_t>(file.tellg());
-		std::vector<char> buffer(fileSize);
+		if (vkCreateRenderPass(device, &renderPassInfo, nullptr, &renderPass) != VK_SUCCESS)
+			throw std::runtime_error("Failed to create the render pass!");
+	}
+
+	void createFramebuffers()
+	{
+		PROFILE_FUNCTION();
+
+		swapChainFramebuffers.resize(swapChainImageViews.size());
+
+		for (size_t i{ 0 }; i < swapChainImageViews.size(); ++i)
+		{
+			std::array<VkImageView, 2> attachments{ swapChainImageViews[i], depthImageView };
+
+			VkFramebufferCreateInfo framebufferInfo{
+				.sType{ VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO },
+				.renderPass{ renderPass },
+				.attachmentCount{ static_cast<uint32_t>(attachments.size()) },
+				.pAttachments{ attachments.data() },
+				.width{ swapChainExtent.width },
+				.height{ swapChainExtent.height },
+				.layers{ 1 }
+			};
+
+			if (vkCreateFramebuffer(device, &framebufferInfo, nullptr, &swapChainFramebuffers[i]) != VK_SUCCESS)
+				throw std::runtime_error("Failed to create a framebuffer!");
+		}
+
+		imagesInFlight.assign(swapChainImages.size(), 0);
+	}
+
+	void createCommandPool()
+	{
+		PROFILE_FUNCTION();
+
+		VkCommandPoolCreateInfo poolInfo{
+			.sType{ VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO },
+			.flags{ VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT },
+			.queueFamilyIndex{ queueFamilies.graphicsFamily.value() }
+		};
+
+		if (vkCreateCommandPool(device, &poolInfo, nullptr, &commandPool) != VK_SUCCESS)
+			throw std::runtime_error("Failed to create the command pool!");
+
+		if (!config.gpuDriven)
+			return;
+
+		poolInfo.queueFamilyIndex = computeQueue.familyIndex();
+		if (vkCreateCommandPool(device, &poolInfo, nullptr, &computeCommandPool) != VK_SUCCESS)
+			throw std::runtime_error("Failed to create the compute command pool!");
+	}
+
+	void createFrameContexts()
+	{
+		PROFILE_FUNCTION();
+
+		frames.resize(config.framesInFlight);
+
+		std::vector<VkCommandBuffer> commandBuffers(frames.size());
+
+		VkCommandBufferAllocateInfo allocInfo{
+			.sType{ VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO },
+			.commandPool{ commandPool },
+			.level{ VK_COMMAND_BUFFER_LEVEL_PRIMARY },
+			.commandBufferCount{ static_cast<uint32_t>(commandBuffers.size()) }
+		};
+
+		if (vkAllocateCommandBuffers(device, &allocInfo, commandBuffers.data()) != VK_SUCCESS)
+			throw std::runtime_error("Failed to allocate the command buffers!");
 
-		file.seekg(0);
-		file.read(buffer.data(), fileSize);
+		VkSemaphoreCreateInfo semaphoreInfo{
+			.sType{ VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO }
+		};
+
+		for (size_t i{ 0 }; i < frames.size(); ++i)
+		{
+			frames[i].commandBuffer = commandBuffers[i];
 
-		file.close();
+			if (vkCreateSemaphore(device, &semaphoreInfo, nullptr, &frames[i].imageAvailableSemaphore) != VK_SUCCESS)
+				throw std::runtime_error("Failed to create the synchronization objects for a frame!");
+		}
 
-		return buffer;
+		if (config.gpuDriven)
+		{
+			allocInfo.commandPool = computeCommandPool;
+			if (vkAllocateCommandBuffers(device, &allocInfo, commandBuffers.data()) != VK_SUCCESS)
+				throw std::runtime_error("Failed to allocate the compute command buffers!");
+
+			for (size_t i{ 0 }; i < frames.size(); ++i)
+				frames[i].computeCommandBuffer = commandBuffers[i];
+		}
+
+		std::cout << "Frames in flight: " << frames.size() << "\n\n";
 	}
 
-	VkShaderModule createShaderModule(const std::vector<char>& code)
+	// Signaled by the frame that renders to the image and waited on by its present. Headless runs do not present.
+	void createRenderFinishedSemaphores()
 	{
-		// TODO: What is this reinterpret_cast?
-		VkShaderModuleCreateInfo createInfo{
-			.sType{ VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO },
-			.codeSize{ code.size() },
-			.pCode{ reinterpret_cast<const uint32_t*>(code.data()) }
+		if (config.headless)
+			return;
+
+		VkSemaphoreCreateInfo semaphoreInfo{
+			.sType{ VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO }
 		};
 
-		VkShaderModule shaderModule{};
-		if (vkCreateShaderModule(device, &createInfo, nullptr, &shaderModule) != VK_SUCCESS)
-			throw std::runtime_error("Failed to create a shader module!");
+		renderFinishedSemaphores.resize(swapChainImages.size());
+
+		for (auto& semaphore : renderFinishedSemaphores)
+		{
+			if (vkCreateSemaphore(device, &semaphoreInfo, nullptr, &semaphore) != VK_SUCCESS)
+				throw std::runtime_error("Failed to create the synchronization objects for a swap chain image!");
+		}
+	}
+
+	void createProfilers()
+	{
+		PROFILE_FUNCTION();
+
+		gpuProfiler.create(instance, physicalDevice, device, queueFamilies.graphicsFamily.value(),
+			config.framesInFlight, calibratedTimestampsSupported);
+		if (config.gpuDriven)
+			computeProfiler.create(instance, physicalDevice, device, computeQueue.familyIndex(),
+				config.framesInFlight, calibratedTimestampsSupported);
 
-		return shaderModule;
+		if (trace.enabled())
+		{
+			gpuTrack = trace.registerTrack("GPU graphics queue");
+			if (config.gpuDriven)
+				computeTrack = trace.registerTrack("GPU compute queue");
+		}
 	}
 
-	void createGraphicsPipeline()
+	void createCommandRecorder()
 	{
-		auto vertShaderCode = readFile("shaders/vert.spv");
-		auto fragShaderCode = readFile("shaders/frag.spv");
+		PROFILE_FUNCTION();
+
+		if (config.recordThreads > 1)
+			commandRecorder.create(device, queueFamilies.graphicsFamily.value(), config.recordThreads, config.framesInFlight, threadPool);
+
+		std::cout << "Recording " << config.drawCount << " draws per frame on " << config.recordThreads << " thread(s), "
+			<< threadPool.threadCount() << " worker threads\n\n";
+	}
+
+	void createPipelineLayout()
+	{
+		PROFILE_FUNCTION();
+
+		drawSetLayout = &descriptorLayouts.get({
+			{
+				.binding{ 0 },
+				.descriptorType{ VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC },
+				.descriptorCount{ 1 },
+				.stageFlags{ VK_SHADER_STAGE_VERTEX_BIT }
+			},
+			{
+				.binding{ 1 },
+				.descriptorType{ VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC },
+				.descriptorCount{ 1 },
+				.stageFlags{ VK_SHADER_STAGE_VERTEX_BIT }
+			}
+		});
+
+		auto createLayout = [this](const std::vector<VkDescriptorSetLayout>& setLayouts)
+		{
+			VkPipelineLayoutCreateInfo pipelineLayoutInfo{
+				.sType{ VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO },
+				.setLayoutCount{ static_cast<uint32_t>(setLayouts.size()) },
+				.pSetLayouts{ setLayouts.data() },
+				.pushConstantRangeCount{ 0 }
+			};
 
-		VkShaderModule vertShaderModule{ createShaderModule(vertShaderCode) };
-		VkShaderModule fragShaderModule{ createShaderModule(fragShaderCode) };
+			VkPipelineLayout layout{};
+			if (vkCreatePipelineLayout(device, &pipelineLayoutInfo, nullptr, &layout) != VK_SUCCESS)
+				throw std::runtime_error("Failed to create the pipeline layout!");
 
-		VkPipelineShaderStageCreateInfo vertShaderStageInfo{
-			.sType{ VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO },
-			.stage{ VK_SHADER_STAGE_VERTEX_BIT },
-			.module{ vertShaderModule },
-			.pName{ "main" }
+			return layout;
 		};
 
-		VkPipelineShaderStageCreateInfo fragShaderStageInfo{
-			.sType{ VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO },
-			.stage{ VK_SHADER_STAGE_FRAGMENT_BIT },
-			.module{ fragShaderModule },
-			.pName{ "main" }
+		pipelineLayout = createLayout({ drawSetLayout->layout });
+
+		if (!config.gpuDriven)
+			return;
+
+		// The constants, the bounds, the draw records and the frame slot's indirect region, see GpuCuller.
+		cullSetLayout = &descriptorLayouts.get({
+			{
+				.binding{ 0 },
+				.descriptorType{ VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC },
+				.descriptorCount{ 1 },
+				.stageFlags{ VK_SHADER_STAGE_COMPUTE_BIT }
+			},
+			{
+				.binding{ 1 },
+				.descriptorType{ VK_DESCRIPTOR_TYPE_STORAGE_BUFFER },
+				.descriptorCount{ 1 },
+				.stageFlags{ VK_SHADER_STAGE_COMPUTE_BIT }
+			},
+			{
+				.binding{ 2 },
+				.descriptorType{ VK_DESCRIPTOR_TYPE_STORAGE_BUFFER },
+				.descriptorCount{ 1 },
+				.stageFlags{ VK_SHADER_STAGE_COMPUTE_BIT }
+			},
+			{
+				.binding{ 3 },
+				.descriptorType{ VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC },
+				.descriptorCount{ 1 },
+				.stageFlags{ VK_SHADER_STAGE_COMPUTE_BIT }
+			}
+		});
+
+		objectSetLayout = &descriptorLayouts.get({
+			{
+				.binding{ 0 },
+				.descriptorType{ VK_DESCRIPTOR_TYPE_STORAGE_BUFFER },
+				.descriptorCount{ 1 },
+				.stageFlags{ VK_SHADER_STAGE_VERTEX_BIT }
+			}
+		});
+
+		cullPipelineLayout = createLayout({ cullSetLayout->layout });
+		gpuDrivenPipelineLayout = createLayout({ drawSetLayout->layout, objectSetLayout->layout });
+	}
+
+	// Sized for the camera, the culling constants and one object per draw. Allocations are padded to the device's
+	// offset alignment, and 256 bytes is the largest alignment the spec allows, so this fits on every device.
+	void createUniformRing()
+	{
+		PROFILE_FUNCTION();
+
+		const VkPhysicalDeviceLimits& limits{ deviceCapabilities->properties.limits };
+		VkDeviceSize bytesPerFrame{ (static_cast<VkDeviceSize>(config.drawCount) + 2) * 256 };
+
+		uniformRing.create(allocator, bytesPerFrame, config.framesInFlight, limits.minUniformBufferOffsetAlignment,
+			limits.minStorageBufferOffsetAlignment);
+
+		// The dynamic offsets select the data, so the set is written once with the ring's start.
+		drawSet = descriptorAllocator.allocatePersistent(*drawSetLayout);
+
+		std::array<DescriptorData, 2> data{};
+		data[0].buffer = { .buffer{ uniformRing.handle() }, .offset{ 0 }, .range{ sizeof(CameraConstants) } };
+		data[1].buffer = { .buffer{ uniformRing.handle() }, .offset{ 0 }, .range{ sizeof(ObjectConstants) } };
+		descriptorAllocator.write(drawSet, *drawSetLayout, data.data());
+	}
+
+	// The GPU-driven objects sit on a grid twice the view's size, all drawing the same LOD of the scene mesh.
+	void createGpuCuller()
+	{
+		PROFILE_FUNCTION();
+
+		const Mesh& mesh{ meshLibrary.get(sceneMesh) };
+		const MeshLod& lod{ mesh.lods[std::min<size_t>(drawLod(), mesh.lods.size() - 1)] };
+		glm::mat4 meshTransform{ fitToUnit(mesh) };
+		glm::mat4 boundsTransform{ unitTransform(mesh.bounds) };
+
+		uint32_t gridSize{ drawGridSize() };
+		float cellSize{ 4.0f / gridSize };
+
+		GpuScene scene{};
+		scene.transforms.reserve(config.instanceCount);
+		scene.bounds.reserve(config.instanceCount);
+		scene.draws.assign(config.instanceCount, { .indexCount{ lod.indexCount }, .firstIndex{ lod.firstIndex }, .vertexOffset{ 0 } });
+
+		for (uint32_t i{ 0 }; i < config.instanceCount; ++i)
+		{
+			glm::vec3 cellCenter{ -2.0f + ((i % gridSize) + 0.5f) * cellSize, -2.0f + ((i / gridSize) + 0.5f) * cellSize, 0.5f };
+			glm::mat4 placement{ glm::scale(glm::translate(glm::mat4{ 1.0f }, cellCenter), glm::vec3{ 2.0f / gridSize, 2.0f / gridSize, 1.0f }) };
+
+			BoundingBox box{ transformBounds(mesh.bounds, placement * boundsTransform) };
+			scene.transforms.push_back(placement * meshTransform);
+			scene.bounds.push_back({ .center{ box.center, 0.0f }, .halfExtent{ box.halfExtent, 0.0f } });
+		}
+
+		const VkPhysicalDeviceLimits& limits{ deviceCapabilities->properties.limits };
+		gpuCuller.create(allocator, uploadQueue, scene, config.framesInFlight, limits.minStorageBufferOffsetAlignment,
+			limits.maxComputeWorkGroupCount[0], drawIndirectCountSupported, computeQueue.familyIndex(), graphicsQueue.familyIndex());
+		gpuCuller.writeDescriptors(descriptorAllocator, *cullSetLayout, *objectSetLayout, uniformRing.handle());
+	}
+
+	// The instance buffer holds one matrix per instance and frame slot.
+	void createInstanceTransforms()
+	{
+		PROFILE_FUNCTION();
+
+		instanceTransforms.create(allocator, threadPool, config.instanceCount, config.framesInFlight);
+	}
+
+	// Only needs the render pass and layout, so it can be called before the swap chain exists.
+	std::vector<std::future<VkPipeline>> queuePipelineBuilds()
+	{
+		PROFILE_FUNCTION();
+
+		std::vector<GraphicsPipelineDescription> descriptions{
+			{
+				.name{ "mesh" },
+				.vertexShaderPath{ "shaders/vert.spv" },
+				.fragmentShaderPath{ "shaders/frag.spv" },
+				.layout{ pipelineLayout },
+				.renderPass{ renderPass },
+				.vertexBindings{ Vertex::bindingDescriptions() },
+				.vertexAttributes{ Vertex::attributeDescriptions() }
+			},
+			{
+				.name{ "quantized mesh" },
+				.vertexShaderPath{ "shaders/quantizedVert.spv" },
+				.fragmentShaderPath{ "shaders/frag.spv" },
+				.layout{ pipelineLayout },
+				.renderPass{ renderPass },
+				.vertexBindings{ QuantizedVertex::bindingDescriptions() },
+				.vertexAttributes{ QuantizedVertex::attributeDescriptions() }
+			},
+			{
+				.name{ "instanced mesh" },
+				.vertexShaderPath{ "shaders/instancedVert.spv" },
+				.fragmentShaderPath{ "shaders/frag.spv" },
+				.layout{ pipelineLayout },
+				.renderPass{ renderPass },
+				.vertexBindings{ withInstanceStream(Vertex::bindingDescriptions(), InstanceTransforms::bindingDescriptions()) },
+				.vertexAttributes{ withInstanceStream(Vertex::attributeDescriptions(), InstanceTransforms::attributeDescriptions()) }
+			},
+			{
+				.name{ "quantized instanced mesh" },
+				.vertexShaderPath{ "shaders/quantizedInstancedVert.spv" },
+				.fragmentShaderPath{ "shaders/frag.spv" },
+				.layout{ pipelineLayout },
+				.renderPass{ renderPass },
+				.vertexBindings{ withInstanceStream(QuantizedVertex::bindingDescriptions(), InstanceTransforms::bindingDescriptions()) },
+				.vertexAttributes{ withInstanceStream(QuantizedVertex::attributeDescriptions(), InstanceTransforms::attributeDescriptions()) }
+			}
 		};
 
-		VkPipelineShaderStageCreateInfo shaderStages[] = { vertShaderStageInfo, fragShaderStageInfo };
+		if (config.gpuDriven)
+		{
+			descriptions.push_back({
+				.name{ "GPU-driven mesh" },
+				.vertexShaderPath{ "shaders/gpuDrivenVert.spv" },
+				.fragmentShaderPath{ "shaders/frag.spv" },
+				.layout{ gpuDrivenPipelineLayout },
+				.renderPass{ renderPass },
+				.vertexBindings{ Vertex::bindingDescriptions() },
+				.vertexAttributes{ Vertex::attributeDescriptions() }
+			});
+			descriptions.push_back({
+				.name{ "quantized GPU-driven mesh" },
+				.vertexShaderPath{ "shaders/quantizedGpuDrivenVert.spv" },
+				.fragmentShaderPath{ "shaders/frag.spv" },
+				.layout{ gpuDrivenPipelineLayout },
+				.renderPass{ renderPass },
+				.vertexBindings{ QuantizedVertex::bindingDescriptions() },
+				.vertexAttributes{ QuantizedVertex::attributeDescriptions() }
+			});
+		}
+
+		std::vector<std::future<VkPipeline>> pipelines{ pipelineBuilder.buildAll(descriptions) };
 
-		// to be continued...
+		if (config.gpuDriven)
+			pipelines.push_back(pipelineBuilder.build(ComputePipelineDescription{
+				.name{ "culling" },
+				.shaderPath{ "shaders/cull.spv" },
+				.layout{ cullPipelineLayout }
+			}));
 
-		vkDestroyShaderModule(device, fragShaderModule, nullptr);
-		vkDestroyShaderModule(device, vertShaderModule, nullptr);
+		return pipelines;
+	}
+
+	// The mesh's vertex stream followed by the per-instance one.
+	template <typename T>
+	static std::vector<T> withInstanceStream(std::vector<T> vertex, const std::vector<T>& instance)
+	{
+		vertex.insert(vertex.end(), instance.begin(), instance.end());
+		return vertex;
 	}
 };
\ No newline at end of file
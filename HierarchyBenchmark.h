@@ -0,0 +1,98 @@
+#pragma once
+#include "ThreadPool.h"
+#include "TransformHierarchy.h"
+
+#include <glm/glm.hpp>
+#include <glm/gtc/constants.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <vector>
+
+
+// Nodes per object; each object is one root with a random tree of parts under it.
+constexpr uint32_t hierarchyBenchmarkObjectSize{ 500 };
+constexpr uint32_t hierarchyBenchmarkIterations{ 20 };
+
+// --hierarchy-benchmark N: builds a hierarchy of N nodes grouped into objects and times update() after moving
+// everything, 1% of the objects, 1000 random nodes, and nothing, to show the cost following what moved. The
+// hierarchy's own statistics then average every update of the run.
+inline void runHierarchyBenchmark(uint32_t nodeCount)
+{
+	std::mt19937 random{ 1 };
+	std::uniform_real_distribution<float> offset{ -1.0f, 1.0f };
+
+	std::vector<uint32_t> parents(nodeCount);
+	std::vector<LocalTransform> locals(nodeCount);
+	for (uint32_t node{ 0 }; node < nodeCount; ++node)
+	{
+		uint32_t objectRoot{ node - node % hierarchyBenchmarkObjectSize };
+		parents[node] = node == objectRoot ? noParent : std::uniform_int_distribution<uint32_t>{ objectRoot, node - 1 }(random);
+		locals[node] = {
+			.translation{ offset(random), offset(random), offset(random) },
+			.rotation{ glm::angleAxis(offset(random) * glm::pi<float>(), glm::normalize(glm::vec3{ offset(random), offset(random), 1.0f })) },
+			.scale{ glm::vec3{ 0.9f + 0.1f * offset(random) } }
+		};
+	}
+
+	ThreadPool threadPool{};
+	threadPool.create(ThreadPool::defaultThreadCount());
+
+	TransformHierarchy hierarchy{};
+	hierarchy.create(threadPool, parents, locals);
+
+	uint32_t objectCount{ (nodeCount + hierarchyBenchmarkObjectSize - 1) / hierarchyBenchmarkObjectSize };
+	std::uniform_int_distribution<uint32_t> anyObject{ 0, objectCount - 1 };
+	std::uniform_int_distribution<uint32_t> anyNode{ 0, nodeCount - 1 };
+
+	std::cout << "Transform hierarchy: " << nodeCount << " nodes in " << objectCount << " objects, " << TransformHierarchy::simdPath()
+		<< ", " << hierarchyBenchmarkIterations << " updates each:\n";
+
+	auto measure = [&](const char* name, auto&& move)
+	{
+		double totalMs{ 0.0 };
+		for (uint32_t iteration{ 0 }; iteration < hierarchyBenchmarkIterations; ++iteration)
+		{
+			move(static_cast<float>(iteration));
+
+			auto start{ std::chrono::steady_clock::now() };
+			hierarchy.update();
+			totalMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+		}
+
+		std::cout << "  " << std::left << std::setw(24) << name << std::right << std::fixed << std::setprecision(3)
+			<< totalMs / hierarchyBenchmarkIterations << " ms, " << hierarchy.lastUpdateNodeCount() << " nodes on "
+			<< hierarchy.lastUpdateTaskCount() << " task(s)" << std::defaultfloat << '\n';
+	};
+
+	measure("everything moved", [&](float time)
+	{
+		for (uint32_t object{ 0 }; object < objectCount; ++object)
+			hierarchy.setTranslation(object * hierarchyBenchmarkObjectSize, glm::vec3{ time, 0.0f, 0.0f });
+	});
+
+	measure("1% of objects moved", [&](float time)
+	{
+		for (uint32_t i{ 0 }; i < std::max(1u, objectCount / 100); ++i)
+			hierarchy.setTranslation(anyObject(random) * hierarchyBenchmarkObjectSize, glm::vec3{ time, 0.0f, 0.0f });
+	});
+
+	measure("1000 random nodes moved", [&](float time)
+	{
+		for (uint32_t i{ 0 }; i < 1000; ++i)
+			hierarchy.setRotation(anyNode(random), glm::angleAxis(time, glm::vec3{ 0.0f, 0.0f, 1.0f }));
+	});
+
+	measure("nothing moved", [](float) {});
+
+	std::cout << '\n';
+	hierarchy.printStatistics();
+
+	hierarchy.destroy();
+	threadPool.destroy();
+}
@@ -0,0 +1,221 @@
+#pragma once
+#include <vulkan/vulkan.h>
+
+#include "CpuProfiler.h"
+#include "DeviceAllocator.h"
+#include "ThreadPool.h"
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#if GLM_ARCH & GLM_ARCH_SSE2_BIT
+#include <glm/simd/matrix.h>
+#endif
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <future>
+#include <iomanip>
+#include <iostream>
+#include <stdexcept>
+#include <vector>
+
+
+// Instances spin at one of a few speeds; a power of two so the group is a mask of the instance index.
+constexpr uint32_t instanceSpinGroups{ 8 };
+
+// Instances below this are updated on the calling thread; splitting them costs more than it saves.
+constexpr uint32_t minInstancesPerTask{ 16384 };
+
+// The non-temporal stores write whole cache lines, so the instance buffer is allocated on one.
+constexpr VkDeviceSize instanceBufferAlignment{ 64 };
+
+// One world matrix per instance, rewritten every frame into the frame slot's region of a persistently mapped vertex
+// buffer that a single instanced draw reads at VK_VERTEX_INPUT_RATE_INSTANCE. An instance's world matrix is its fixed
+// placement times the spin of its group times the mesh transform, so the per-instance work is one 4x4 product
+// (glm_mat4_mul on SSE2) and a 64-byte store.
+class InstanceTransforms
+{
+public:
+	// Instances are tiled over a square grid covering the framebuffer, like the separate draws.
+	void create(DeviceAllocator& deviceAllocator, ThreadPool& pool, uint32_t instanceCount, uint32_t framesInFlight)
+	{
+		allocator = &deviceAllocator;
+		threadPool = &pool;
+
+		uint32_t gridSize{ static_cast<uint32_t>(std::ceil(std::sqrt(static_cast<double>(instanceCount)))) };
+		float cellSize{ 2.0f / gridSize };
+		// A spinning mesh sweeps the circle around its bounds, so it is shrunk to stay inside its cell.
+		float scale{ 0.7f / gridSize };
+
+		placements.resize(instanceCount);
+		for (uint32_t i{ 0 }; i < instanceCount; ++i)
+		{
+			// Pushed to z = 0.5 so meshes up to one unit deep stay inside the [0, 1] depth range.
+			glm::vec3 cellCenter{ -1.0f + ((i % gridSize) + 0.5f) * cellSize, -1.0f + ((i / gridSize) + 0.5f) * cellSize, 0.5f };
+			placements[i] = glm::scale(glm::translate(glm::mat4{ 1.0f }, cellCenter), glm::vec3{ scale, scale, 1.0f });
+		}
+
+		frameSize = static_cast<VkDeviceSize>(instanceCount) * sizeof(glm::mat4);
+		buffer = allocator->createBuffer(frameSize * framesInFlight, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, MemoryUsage::CpuToGpu,
+			instanceBufferAlignment);
+
+		mapped = static_cast<char*>(buffer.allocation.mappedData);
+		if (mapped == nullptr)
+			throw std::runtime_error("The instance buffer is not host-visible!");
+
+		// frameSize is a whole number of matrices, so every slot starts on a line if the mapping does.
+		if (reinterpret_cast<uintptr_t>(mapped) % instanceBufferAlignment != 0)
+			throw std::runtime_error("The instance buffer mapping is not 64-byte aligned!");
+	}
+
+	void destroy()
+	{
+		allocator->destroyBuffer(buffer);
+		mapped = nullptr;
+		placements.clear();
+	}
+
+	uint32_t count() const { return static_cast<uint32_t>(placements.size()); }
+
+	// Binds the slot's transforms to the per-instance binding.
+	void bind(VkCommandBuffer commandBuffer, uint32_t frameSlot) const
+	{
+		VkDeviceSize offset{ frameSlot * frameSize };
+		vkCmdBindVertexBuffers(commandBuffer, instanceBinding, 1, &buffer.buffer, &offset);
+	}
+
+	// Call once the slot's previous frame has completed. Large counts are split over the thread pool.
+	void update(uint32_t frameSlot, float seconds, const glm::mat4& meshTransform)
+	{
+		PROFILE_FUNCTION();
+
+		auto start{ std::chrono::steady_clock::now() };
+
+		std::array<glm::mat4, instanceSpinGroups> spins{};
+		for (uint32_t group{ 0 }; group < instanceSpinGroups; ++group)
+			spins[group] = glm::rotate(glm::mat4{ 1.0f }, seconds * (0.5f + 0.25f * group), glm::vec3{ 0.0f, 0.0f, 1.0f }) * meshTransform;
+
+		auto* out{ reinterpret_cast<glm::mat4*>(mapped + frameSlot * frameSize) };
+		uint32_t instanceCount{ count() };
+		uint32_t taskCount{ std::clamp(instanceCount / minInstancesPerTask, 1u, threadPool->threadCount() + 1) };
+		uint32_t perTask{ (instanceCount + taskCount - 1) / taskCount };
+
+		// The caller takes the first range instead of idling until the workers are done.
+		std::vector<std::future<void>> tasks{};
+		for (uint32_t begin{ perTask }; begin < instanceCount; begin += perTask)
+		{
+			uint32_t end{ std::min(begin + perTask, instanceCount) };
+			tasks.push_back(threadPool->submit([this, &spins, out, begin, end] { transform(spins, out, begin, end); }));
+		}
+
+		transform(spins, out, 0, std::min(perTask, instanceCount));
+
+		for (auto& task : tasks)
+			task.get();
+
+		updateMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+		++updates;
+		lastTaskCount = taskCount;
+	}
+
+	// Binding 0 is the mesh's vertices; the matrix takes locations 3 to 6, one column each.
+	static std::vector<VkVertexInputBindingDescription> bindingDescriptions()
+	{
+		return {
+			{
+				.binding{ instanceBinding },
+				.stride{ sizeof(glm::mat4) },
+				.inputRate{ VK_VERTEX_INPUT_RATE_INSTANCE }
+			}
+		};
+	}
+
+	static std::vector<VkVertexInputAttributeDescription> attributeDescriptions()
+	{
+		std::vector<VkVertexInputAttributeDescription> attributes{};
+		for (uint32_t column{ 0 }; column < 4; ++column)
+		{
+			attributes.push_back({
+				.location{ 3 + column },
+				.binding{ instanceBinding },
+				.format{ VK_FORMAT_R32G32B32A32_SFLOAT },
+				.offset{ column * static_cast<uint32_t>(sizeof(glm::vec4)) }
+			});
+		}
+
+		return attributes;
+	}
+
+	static const char* simdPath()
+	{
+#if GLM_ARCH & GLM_ARCH_SSE2_BIT
+		return "SSE2";
+#else
+		return "scalar";
+#endif
+	}
+
+	void printStatistics() const
+	{
+		if (updates == 0)
+			return;
+
+		double averageMs{ updateMs / updates };
+		std::cout << "Instance transforms: " << count() << " instances, " << frameSize / (1024.0 * 1024.0) << " MiB per frame, "
+			<< simdPath() << " on " << lastTaskCount << " thread(s): " << std::fixed << std::setprecision(3) << averageMs
+			<< " ms per update, " << count() / averageMs / 1e3 << " M instances/s" << std::defaultfloat << "\n\n";
+	}
+
+private:
+	static constexpr uint32_t instanceBinding{ 1 };
+
+	DeviceAllocator* allocator{ nullptr };
+	ThreadPool* threadPool{ nullptr };
+	AllocatedBuffer buffer{};
+	char* mapped{ nullptr };
+	VkDeviceSize frameSize{ 0 };
+	std::vector<glm::mat4> placements{};
+	double updateMs{ 0.0 };
+	uint64_t updates{ 0 };
+	uint32_t lastTaskCount{ 0 };
+
+	// The output is mapped memory that is usually write-combined, so it is written with non-temporal stores in
+	// whole 64-byte lines and never read back. glm::mat4 is only 4-byte aligned, so the placements are loaded
+	// unaligned; create() allocates the buffer with instanceBufferAlignment and checks the mapping, so every
+	// slot's region starts on a 64-byte line.
+	void transform(const std::array<glm::mat4, instanceSpinGroups>& spins, glm::mat4* out, uint32_t begin, uint32_t end) const
+	{
+		PROFILE_ZONE("transform instances");
+
+#if GLM_ARCH & GLM_ARCH_SSE2_BIT
+		glm_vec4 spin[instanceSpinGroups][4]{};
+		for (uint32_t group{ 0 }; group < instanceSpinGroups; ++group)
+			for (uint32_t column{ 0 }; column < 4; ++column)
+				spin[group][column] = _mm_loadu_ps(&spins[group][column][0]);
+
+		for (uint32_t i{ begin }; i < end; ++i)
+		{
+			const float* placement{ &placements[i][0][0] };
+			glm_vec4 local[4]{ _mm_loadu_ps(placement), _mm_loadu_ps(placement + 4), _mm_loadu_ps(placement + 8), _mm_loadu_ps(placement + 12) };
+
+			glm_vec4 world[4];
+			glm_mat4_mul(local, spin[i & (instanceSpinGroups - 1)], world);
+
+			float* destination{ &out[i][0][0] };
+			_mm_stream_ps(destination, world[0]);
+			_mm_stream_ps(destination + 4, world[1]);
+			_mm_stream_ps(destination + 8, world[2]);
+			_mm_stream_ps(destination + 12, world[3]);
+		}
+
+		// Streaming stores are weakly ordered; this makes them visible before the frame is submitted.
+		_mm_sfence();
+#else
+		for (uint32_t i{ begin }; i < end; ++i)
+			out[i] = placements[i] * spins[i & (instanceSpinGroups - 1)];
+#endif
+	}
+};
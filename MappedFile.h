@@ -0,0 +1,145 @@
+#pragma once
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include <cstddef>
+#include <stdexcept>
+#include <string>
+#include <utility>
+
+
+// Read-only view of a whole file mapped into the address space. The view is page aligned and stays valid
+// until close(), so the bytes can be handed to the driver without copying them into a buffer first.
+class MappedFile
+{
+public:
+	MappedFile() = default;
+
+	explicit MappedFile(const std::string& path)
+	{
+		open(path);
+	}
+
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+
+	MappedFile(MappedFile&& other) noexcept
+	{
+		*this = std::move(other);
+	}
+
+	MappedFile& operator=(MappedFile&& other) noexcept
+	{
+		if (this != &other)
+		{
+			close();
+			view = std::exchange(other.view, nullptr);
+			viewSize = std::exchange(other.viewSize, 0);
+		}
+
+		return *this;
+	}
+
+	~MappedFile()
+	{
+		close();
+	}
+
+	void open(const std::string& path)
+	{
+		close();
+
+#ifdef _WIN32
+		HANDLE file{ CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+			FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr) };
+		if (file == INVALID_HANDLE_VALUE)
+			throw std::runtime_error("Failed to open " + path);
+
+		LARGE_INTEGER fileSize{};
+		if (!GetFileSizeEx(file, &fileSize))
+		{
+			CloseHandle(file);
+			throw std::runtime_error("Failed to query the size of " + path);
+		}
+
+		viewSize = static_cast<size_t>(fileSize.QuadPart);
+
+		// Mapping an empty file fails, and there is nothing to map anyway.
+		if (viewSize > 0)
+		{
+			HANDLE mapping{ CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr) };
+			if (mapping != nullptr)
+			{
+				view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+				// The view keeps the mapping alive on its own.
+				CloseHandle(mapping);
+			}
+		}
+
+		CloseHandle(file);
+#else
+		int file{ ::open(path.c_str(), O_RDONLY) };
+		if (file < 0)
+			throw std::runtime_error("Failed to open " + path);
+
+		struct stat status {};
+		if (fstat(file, &status) != 0)
+		{
+			::close(file);
+			throw std::runtime_error("Failed to query the size of " + path);
+		}
+
+		viewSize = static_cast<size_t>(status.st_size);
+
+		if (viewSize > 0)
+		{
+			void* mapped{ mmap(nullptr, viewSize, PROT_READ, MAP_PRIVATE, file, 0) };
+			if (mapped != MAP_FAILED)
+				view = mapped;
+		}
+
+		::close(file);
+#endif
+
+		if (viewSize > 0 && view == nullptr)
+		{
+			viewSize = 0;
+			throw std::runtime_error("Failed to map " + path);
+		}
+	}
+
+	void close()
+	{
+		if (view != nullptr)
+		{
+#ifdef _WIN32
+			UnmapViewOfFile(view);
+#else
+			munmap(view, viewSize);
+#endif
+		}
+
+		view = nullptr;
+		viewSize = 0;
+	}
+
+	const std::byte* data() const { return static_cast<const std::byte*>(view); }
+	size_t size() const { return viewSize; }
+	bool empty() const { return viewSize == 0; }
+
+private:
+	void* view{ nullptr };
+	size_t viewSize{ 0 };
+};
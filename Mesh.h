@@ -0,0 +1,233 @@
+#pragma once
+#include <vulkan/vulkan.h>
+
+#include "CpuProfiler.h"
+#include "DeviceAllocator.h"
+#include "MappedFile.h"
+#include "MeshData.h"
+#include "MeshFile.h"
+#include "UploadQueue.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+
+// Device-local geometry. Indices are 16-bit whenever the vertex count allows, which halves index fetch.
+struct Mesh
+{
+	std::string name{};
+	AllocatedBuffer vertexBuffer{};
+	AllocatedBuffer indexBuffer{};
+	uint32_t vertexCount{ 0 };
+	uint32_t indexCount{ 0 };
+	VkIndexType indexType{ VK_INDEX_TYPE_UINT32 };
+	MeshVertexFormat vertexFormat{ MeshVertexFormat::Float };
+	MeshBounds bounds{};
+	// Applied before the model matrix; undoes the position quantization of quantized meshes, identity otherwise.
+	glm::mat4 positionTransform{ 1.0f };
+	// Finest first; never empty.
+	std::vector<MeshLod> lods{};
+	// The later of the vertex and index uploads.
+	UploadTicket ticket{ 0 };
+	// Only known for meshes quantized at runtime; converted files do not store it.
+	std::optional<QuantizationError> quantizationError{};
+
+	void bind(VkCommandBuffer commandBuffer) const
+	{
+		VkDeviceSize offset{ 0 };
+		vkCmdBindVertexBuffers(commandBuffer, 0, 1, &vertexBuffer.buffer, &offset);
+		vkCmdBindIndexBuffer(commandBuffer, indexBuffer.buffer, 0, indexType);
+	}
+
+	// Needs bind() first; consecutive draws of the same mesh only need it once. `lod` is clamped to the coarsest LOD.
+	void draw(VkCommandBuffer commandBuffer, uint32_t lod = 0, uint32_t instanceCount = 1, uint32_t firstInstance = 0) const
+	{
+		const MeshLod& range{ lods[std::min<size_t>(lod, lods.size() - 1)] };
+		vkCmdDrawIndexed(commandBuffer, range.indexCount, instanceCount, range.firstIndex, 0, firstInstance);
+	}
+};
+
+using MeshId = uint32_t;
+
+// Owns every mesh's buffers and streams their contents through the UploadQueue. Meshes are added between frames
+// on the main thread; get() may be called from the record threads.
+class MeshLibrary
+{
+public:
+	void create(DeviceAllocator& deviceAllocator, UploadQueue& queue)
+	{
+		allocator = &deviceAllocator;
+		uploadQueue = &queue;
+	}
+
+	void destroy()
+	{
+		for (auto& mesh : meshes)
+		{
+			allocator->destroyBuffer(mesh.vertexBuffer);
+			allocator->destroyBuffer(mesh.indexBuffer);
+		}
+
+		meshes.clear();
+	}
+
+	// `data` must have been finalized (see finalizeMesh), which the generators in MeshData.h do.
+	MeshId add(const std::string& name, const MeshData& data, MeshVertexFormat vertexFormat)
+	{
+		if (data.lods.empty())
+			throw std::runtime_error("Mesh " + name + " has no LODs!");
+
+		QuantizationError error{};
+		std::vector<QuantizedVertex> quantized{};
+		if (vertexFormat == MeshVertexFormat::Quantized)
+			quantized = quantizeVertices(data.vertices, data.bounds, &error);
+
+		MeshUpload upload{
+			.vertexFormat{ vertexFormat },
+			.vertices{ quantized.empty() ? static_cast<const void*>(data.vertices.data()) : quantized.data() },
+			.vertexCount{ static_cast<uint32_t>(data.vertices.size()) },
+			.indices{ data.indices.data() },
+			.indexCount{ static_cast<uint32_t>(data.indices.size()) },
+			.indexType{ VK_INDEX_TYPE_UINT32 },
+			.bounds{ data.bounds },
+			.lods{ data.lods }
+		};
+
+		std::vector<uint16_t> narrowIndices{};
+		if (data.vertices.size() <= std::numeric_limits<uint16_t>::max() + size_t{ 1 })
+		{
+			narrowIndices.assign(data.indices.begin(), data.indices.end());
+			upload.indices = narrowIndices.data();
+			upload.indexType = VK_INDEX_TYPE_UINT16;
+		}
+
+		MeshId id{ addMesh(name, upload) };
+		meshes[id].quantizationError = error;
+		return id;
+	}
+
+	// Maps a file written by MeshConverter and streams its sections from the mapping into the staging ring.
+	MeshId load(const std::string& path)
+	{
+		PROFILE_FUNCTION();
+
+		auto start{ std::chrono::steady_clock::now() };
+
+		MappedFile file{ path };
+		MeshFileView view{ readMeshFile(path, file) };
+
+		MeshId id{ addMesh(path, {
+			.vertexFormat{ view.header->vertexFormat },
+			.vertices{ view.vertices },
+			.vertexCount{ view.header->vertexCount },
+			.indices{ view.indices },
+			.indexCount{ view.header->indexCount },
+			.indexType{ view.header->indexSize == sizeof(uint16_t) ? VK_INDEX_TYPE_UINT16 : VK_INDEX_TYPE_UINT32 },
+			.bounds{ view.bounds },
+			.lods{ std::move(view.lods) }
+		}) };
+
+		++filesLoaded;
+		bytesLoaded += file.size();
+		loadMilliseconds += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+		return id;
+	}
+
+	const Mesh& get(MeshId id) const { return meshes[id]; }
+
+	// True once the mesh's data is visible to graphics work submitted from now on.
+	bool isResident(MeshId id) const { return uploadQueue->isUploaded(meshes[id].ticket); }
+
+	// One line per mesh with what quantization saved; float meshes report what quantizing them would save.
+	void printStatistics() const
+	{
+		constexpr double mib{ 1024.0 * 1024.0 };
+
+		for (const auto& mesh : meshes)
+		{
+			double floatBytes{ static_cast<double>(mesh.vertexCount) * sizeof(Vertex) };
+			double quantizedBytes{ static_cast<double>(mesh.vertexCount) * sizeof(QuantizedVertex) };
+
+			std::cout << "  " << mesh.name << ": " << toString(mesh.vertexFormat) << ", " << mesh.vertexCount << " vertices, "
+				<< std::fixed << std::setprecision(3) << floatBytes / mib << " MiB float vs " << quantizedBytes / mib
+				<< " MiB quantized (-" << std::setprecision(1) << 100.0 * (1.0 - quantizedBytes / floatBytes) << "%)";
+
+			if (mesh.vertexFormat == MeshVertexFormat::Quantized && mesh.quantizationError.has_value())
+				std::cout << std::setprecision(6) << ", max error " << mesh.quantizationError->position << " units, "
+					<< std::setprecision(3) << glm::degrees(mesh.quantizationError->normalAngle) << " deg";
+
+			std::cout << std::defaultfloat << '\n';
+		}
+
+		std::cout << "Meshes: " << meshes.size() << " with " << totalTriangles << " triangles, " << std::fixed << std::setprecision(3)
+			<< totalVertexBytes / mib << " MiB of vertices, " << totalIndexBytes / mib << " MiB of indices; " << filesLoaded
+			<< " loaded from " << bytesLoaded / mib << " MiB of files in " << loadMilliseconds << " ms" << std::defaultfloat << "\n\n";
+	}
+
+private:
+	// Geometry ready for upload; the pointers are only read during addMesh.
+	struct MeshUpload
+	{
+		MeshVertexFormat vertexFormat{};
+		const void* vertices{};
+		uint32_t vertexCount{};
+		const void* indices{};
+		uint32_t indexCount{};
+		VkIndexType indexType{};
+		MeshBounds bounds{};
+		std::vector<MeshLod> lods{};
+	};
+
+	DeviceAllocator* allocator{ nullptr };
+	UploadQueue* uploadQueue{ nullptr };
+	std::vector<Mesh> meshes{};
+	VkDeviceSize totalVertexBytes{ 0 };
+	VkDeviceSize totalIndexBytes{ 0 };
+	uint64_t totalTriangles{ 0 };
+	uint32_t filesLoaded{ 0 };
+	size_t bytesLoaded{ 0 };
+	double loadMilliseconds{ 0.0 };
+
+	MeshId addMesh(const std::string& name, MeshUpload upload)
+	{
+		Mesh mesh{
+			.name{ name },
+			.vertexCount{ upload.vertexCount },
+			.indexCount{ upload.indexCount },
+			.indexType{ upload.indexType },
+			.vertexFormat{ upload.vertexFormat },
+			.bounds{ upload.bounds },
+			.positionTransform{ upload.vertexFormat == MeshVertexFormat::Quantized ? positionDecode(upload.bounds) : glm::mat4{ 1.0f } },
+			.lods{ std::move(upload.lods) }
+		};
+
+		VkDeviceSize vertexBytes{ static_cast<VkDeviceSize>(upload.vertexCount) * vertexStride(upload.vertexFormat) };
+		mesh.vertexBuffer = allocator->createBuffer(vertexBytes, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+			MemoryUsage::GpuOnly);
+		uploadQueue->uploadBuffer(mesh.vertexBuffer.buffer, 0, upload.vertices, vertexBytes,
+			VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT);
+
+		VkDeviceSize indexBytes{ static_cast<VkDeviceSize>(upload.indexCount)
+			* (upload.indexType == VK_INDEX_TYPE_UINT16 ? sizeof(uint16_t) : sizeof(uint32_t)) };
+		mesh.indexBuffer = allocator->createBuffer(indexBytes, VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+			MemoryUsage::GpuOnly);
+		mesh.ticket = uploadQueue->uploadBuffer(mesh.indexBuffer.buffer, 0, upload.indices, indexBytes,
+			VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, VK_ACCESS_INDEX_READ_BIT);
+
+		totalVertexBytes += vertexBytes;
+		totalIndexBytes += indexBytes;
+		totalTriangles += mesh.lods.front().indexCount / 3;
+
+		meshes.push_back(std::move(mesh));
+		return static_cast<MeshId>(meshes.size() - 1);
+	}
+};
@@ -0,0 +1,220 @@
+// Offline tool that turns Wavefront OBJ files into the .mesh files HelloVulkan maps at startup.
+// Usage: MeshConverter <input.obj> <output.mesh> [--lods N] [--quantize]
+#include "MeshData.h"
+#include "MeshFile.h"
+
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+
+constexpr uint32_t defaultLodCount{ 4 };
+
+struct ObjCorner
+{
+	uint32_t position{};
+	uint32_t uv{};
+	uint32_t normal{};
+
+	bool operator==(const ObjCorner&) const = default;
+};
+
+struct ObjCornerHash
+{
+	size_t operator()(const ObjCorner& corner) const
+	{
+		return std::hash<uint64_t>{}((static_cast<uint64_t>(corner.position) << 32) ^ (static_cast<uint64_t>(corner.uv) << 16) ^ corner.normal);
+	}
+};
+
+// OBJ indices are 1-based, negative ones count back from the end, and 0 means "not given".
+static uint32_t resolveObjIndex(long index, size_t count, const std::string& path, uint32_t lineNumber)
+{
+	long resolved{ index < 0 ? static_cast<long>(count) + index + 1 : index };
+	if (resolved < 1 || static_cast<size_t>(resolved) > count)
+		throw std::runtime_error(path + ":" + std::to_string(lineNumber) + ": index out of range");
+
+	return static_cast<uint32_t>(resolved);
+}
+
+// Area-weighted vertex normals for files that have none. In the renderer's y-down space the outward normal is the
+// negated cross product of the clockwise edges.
+static void computeNormals(MeshData& mesh)
+{
+	for (auto& vertex : mesh.vertices)
+		vertex.normal = glm::vec3{ 0.0f };
+
+	for (size_t i{ 0 }; i < mesh.indices.size(); i += 3)
+	{
+		Vertex& a{ mesh.vertices[mesh.indices[i]] };
+		Vertex& b{ mesh.vertices[mesh.indices[i + 1]] };
+		Vertex& c{ mesh.vertices[mesh.indices[i + 2]] };
+
+		glm::vec3 faceNormal{ -glm::cross(b.position - a.position, c.position - a.position) };
+		a.normal += faceNormal;
+		b.normal += faceNormal;
+		c.normal += faceNormal;
+	}
+
+	for (auto& vertex : mesh.vertices)
+	{
+		float length{ glm::length(vertex.normal) };
+		vertex.normal = length > 0.0f ? vertex.normal / length : glm::vec3{ 0.0f, 0.0f, -1.0f };
+	}
+}
+
+// Reads positions, texture coordinates, normals and faces; everything else (materials, groups, lines) is ignored.
+// OBJ is y-up with counter-clockwise front faces. Flipping y gives the renderer's y-down space, in which the same
+// index order is clockwise on screen, so triangles keep their order.
+static MeshData loadObj(const std::string& path)
+{
+	std::ifstream file(path);
+	if (!file.is_open())
+		throw std::runtime_error("Failed to open " + path);
+
+	std::vector<glm::vec3> positions{};
+	std::vector<glm::vec2> uvs{};
+	std::vector<glm::vec3> normals{};
+
+	MeshData mesh{};
+	std::unordered_map<ObjCorner, uint32_t, ObjCornerHash> corners{};
+	std::vector<uint32_t> face{};
+	bool hasNormals{ true };
+
+	std::string line{};
+	uint32_t lineNumber{ 0 };
+	while (std::getline(file, line))
+	{
+		++lineNumber;
+
+		std::istringstream tokens{ line };
+		std::string keyword{};
+		tokens >> keyword;
+
+		if (keyword == "v")
+		{
+			glm::vec3 position{};
+			tokens >> position.x >> position.y >> position.z;
+			positions.push_back({ position.x, -position.y, position.z });
+		}
+		else if (keyword == "vt")
+		{
+			glm::vec2 uv{};
+			tokens >> uv.x >> uv.y;
+			uvs.push_back({ uv.x, 1.0f - uv.y });
+		}
+		else if (keyword == "vn")
+		{
+			glm::vec3 normal{};
+			tokens >> normal.x >> normal.y >> normal.z;
+			normals.push_back({ normal.x, -normal.y, normal.z });
+		}
+		else if (keyword == "f")
+		{
+			face.clear();
+
+			std::string vertex{};
+			while (tokens >> vertex)
+			{
+				// "p", "p/t", "p//n" or "p/t/n".
+				long indices[3]{ 0, 0, 0 };
+				size_t start{ 0 };
+				for (uint32_t part{ 0 }; part < 3 && start <= vertex.size(); ++part)
+				{
+					size_t slash{ vertex.find('/', start) };
+					std::string field{ vertex.substr(start, slash == std::string::npos ? std::string::npos : slash - start) };
+					if (!field.empty())
+						indices[part] = std::strtol(field.c_str(), nullptr, 10);
+
+					if (slash == std::string::npos)
+						break;
+					start = slash + 1;
+				}
+
+				ObjCorner corner{
+					.position{ resolveObjIndex(indices[0], positions.size(), path, lineNumber) },
+					.uv{ indices[1] != 0 ? resolveObjIndex(indices[1], uvs.size(), path, lineNumber) : 0 },
+					.normal{ indices[2] != 0 ? resolveObjIndex(indices[2], normals.size(), path, lineNumber) : 0 }
+				};
+				hasNormals = hasNormals && corner.normal != 0;
+
+				auto [it, inserted]{ corners.try_emplace(corner, static_cast<uint32_t>(mesh.vertices.size())) };
+				if (inserted)
+				{
+					mesh.vertices.push_back({
+						.position{ positions[corner.position - 1] },
+						.normal{ corner.normal != 0 ? normals[corner.normal - 1] : glm::vec3{ 0.0f } },
+						.uv{ corner.uv != 0 ? uvs[corner.uv - 1] : glm::vec2{ 0.0f } }
+					});
+				}
+
+				face.push_back(it->second);
+			}
+
+			if (face.size() < 3)
+				throw std::runtime_error(path + ":" + std::to_string(lineNumber) + ": face with fewer than 3 vertices");
+
+			// Polygons are assumed convex and fanned.
+			for (size_t i{ 1 }; i + 1 < face.size(); ++i)
+				mesh.indices.insert(mesh.indices.end(), { face[0], face[i], face[i + 1] });
+		}
+	}
+
+	if (!hasNormals)
+		computeNormals(mesh);
+
+	finalizeMesh(mesh);
+	return mesh;
+}
+
+int main(int argc, char* argv[])
+{
+	try {
+		if (argc < 3)
+			throw std::runtime_error("Usage: MeshConverter <input.obj> <output.mesh> [--lods N] [--quantize]");
+
+		const std::string inputPath{ argv[1] };
+		const std::string outputPath{ argv[2] };
+		uint32_t lodCount{ defaultLodCount };
+		MeshVertexFormat vertexFormat{ MeshVertexFormat::Float };
+
+		for (int i{ 3 }; i < argc; ++i)
+		{
+			const std::string arg{ argv[i] };
+
+			if (arg == "--lods" && i + 1 < argc)
+				lodCount = static_cast<uint32_t>(std::strtoul(argv[++i], nullptr, 10));
+			else if (arg == "--quantize")
+				vertexFormat = MeshVertexFormat::Quantized;
+			else
+				throw std::runtime_error("Unknown argument: " + arg);
+		}
+
+		auto start{ std::chrono::steady_clock::now() };
+
+		MeshData mesh{ loadObj(inputPath) };
+		appendClusteredLods(mesh, lodCount);
+		writeMeshFile(outputPath, mesh, vertexFormat);
+
+		double milliseconds{ std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() };
+
+		std::cout << inputPath << " -> " << outputPath << ": " << mesh.vertices.size() << ' ' << toString(vertexFormat)
+			<< " vertices (" << mesh.vertices.size() * vertexStride(vertexFormat) << " bytes), LOD triangles";
+		for (const auto& lod : mesh.lods)
+			std::cout << ' ' << lod.indexCount / 3;
+		std::cout << ", " << milliseconds << " ms\n";
+	}
+	catch (const std::exception& e) {
+		std::cerr << e.what() << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	return EXIT_SUCCESS;
+}
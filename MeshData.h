@@ -0,0 +1,349 @@
+#pragma once
+#include <vulkan/vulkan.h>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/constants.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/packing.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <stdexcept>
+#include <unordered_map>
+#include <vector>
+
+
+struct Vertex
+{
+	glm::vec3 position{};
+	glm::vec3 normal{};
+	glm::vec2 uv{};
+
+	static std::vector<VkVertexInputBindingDescription> bindingDescriptions()
+	{
+		return { {
+			.binding{ 0 },
+			.stride{ sizeof(Vertex) },
+			.inputRate{ VK_VERTEX_INPUT_RATE_VERTEX }
+		} };
+	}
+
+	// Locations match the inputs of shaders/shader.vert.
+	static std::vector<VkVertexInputAttributeDescription> attributeDescriptions()
+	{
+		return {
+			{ .location{ 0 }, .binding{ 0 }, .format{ VK_FORMAT_R32G32B32_SFLOAT }, .offset{ offsetof(Vertex, position) } },
+			{ .location{ 1 }, .binding{ 0 }, .format{ VK_FORMAT_R32G32B32_SFLOAT }, .offset{ offsetof(Vertex, normal) } },
+			{ .location{ 2 }, .binding{ 0 }, .format{ VK_FORMAT_R32G32_SFLOAT }, .offset{ offsetof(Vertex, uv) } }
+		};
+	}
+};
+
+// 16 bytes against Vertex's 32. Positions are unorm16 within the mesh bounds, normals are octahedral snorm16 and UVs
+// are half floats. The attribute formats let the vertex fetch hardware expand positions and UVs, so only the
+// normal needs decoding in shaders/quantized.vert; the bounds are folded into the model matrix (see positionDecode).
+struct QuantizedVertex
+{
+	// packUnorm4x16, w unused.
+	uint64_t position{};
+	// packSnorm2x16 of encodeOctahedral.
+	uint32_t normal{};
+	// packHalf2x16.
+	uint32_t uv{};
+
+	static std::vector<VkVertexInputBindingDescription> bindingDescriptions()
+	{
+		return { {
+			.binding{ 0 },
+			.stride{ sizeof(QuantizedVertex) },
+			.inputRate{ VK_VERTEX_INPUT_RATE_VERTEX }
+		} };
+	}
+
+	// Locations match the inputs of shaders/quantized.vert.
+	static std::vector<VkVertexInputAttributeDescription> attributeDescriptions()
+	{
+		return {
+			{ .location{ 0 }, .binding{ 0 }, .format{ VK_FORMAT_R16G16B16A16_UNORM }, .offset{ offsetof(QuantizedVertex, position) } },
+			{ .location{ 1 }, .binding{ 0 }, .format{ VK_FORMAT_R16G16_SNORM }, .offset{ offsetof(QuantizedVertex, normal) } },
+			{ .location{ 2 }, .binding{ 0 }, .format{ VK_FORMAT_R16G16_SFLOAT }, .offset{ offsetof(QuantizedVertex, uv) } }
+		};
+	}
+};
+
+enum class MeshVertexFormat : uint32_t
+{
+	Float = 0,		// Vertex
+	Quantized = 1	// QuantizedVertex
+};
+
+inline uint32_t vertexStride(MeshVertexFormat format)
+{
+	return format == MeshVertexFormat::Quantized ? sizeof(QuantizedVertex) : sizeof(Vertex);
+}
+
+inline const char* toString(MeshVertexFormat format)
+{
+	return format == MeshVertexFormat::Quantized ? "quantized" : "float";
+}
+
+struct MeshBounds
+{
+	glm::vec3 min{ 0.0f };
+	glm::vec3 max{ 0.0f };
+
+	glm::vec3 center() const { return (min + max) * 0.5f; }
+	glm::vec3 extent() const { return max - min; }
+};
+
+// Maps a unit normal onto the [-1, 1] square: the upper half of the octahedron unfolds in place and the lower half
+// folds over the diagonals. Spreads precision far more evenly than storing x and y and reconstructing z.
+inline glm::vec2 encodeOctahedral(glm::vec3 normal)
+{
+	normal /= std::abs(normal.x) + std::abs(normal.y) + std::abs(normal.z);
+	glm::vec2 encoded{ normal.x, normal.y };
+
+	if (normal.z < 0.0f)
+	{
+		glm::vec2 signs{ encoded.x >= 0.0f ? 1.0f : -1.0f, encoded.y >= 0.0f ? 1.0f : -1.0f };
+		encoded = (1.0f - glm::abs(glm::vec2{ encoded.y, encoded.x })) * signs;
+	}
+
+	return encoded;
+}
+
+// The inverse of encodeOctahedral; mirrors decodeOctahedral in shaders/quantized.vert.
+inline glm::vec3 decodeOctahedral(glm::vec2 encoded)
+{
+	glm::vec3 normal{ encoded.x, encoded.y, 1.0f - std::abs(encoded.x) - std::abs(encoded.y) };
+
+	if (normal.z < 0.0f)
+	{
+		glm::vec2 signs{ normal.x >= 0.0f ? 1.0f : -1.0f, normal.y >= 0.0f ? 1.0f : -1.0f };
+		glm::vec2 folded{ (1.0f - glm::abs(glm::vec2{ normal.y, normal.x })) * signs };
+		normal.x = folded.x;
+		normal.y = folded.y;
+	}
+
+	return glm::normalize(normal);
+}
+
+// A contiguous range of the index buffer. All LODs share the vertex buffer; LOD 0 is the full-detail mesh.
+struct MeshLod
+{
+	uint32_t firstIndex{ 0 };
+	uint32_t indexCount{ 0 };
+};
+
+// CPU-side geometry, only kept until it has been uploaded or written to a mesh file.
+struct MeshData
+{
+	std::vector<Vertex> vertices{};
+	std::vector<uint32_t> indices{};
+	// Empty until finalizeMesh() adds LOD 0.
+	std::vector<MeshLod> lods{};
+	MeshBounds bounds{};
+
+	uint32_t triangleCount() const { return static_cast<uint32_t>(indices.size() / 3); }
+};
+
+inline MeshBounds computeBounds(const std::vector<Vertex>& vertices)
+{
+	if (vertices.empty())
+		return {};
+
+	MeshBounds bounds{ .min{ vertices.front().position }, .max{ vertices.front().position } };
+	for (const auto& vertex : vertices)
+	{
+		bounds.min = glm::min(bounds.min, vertex.position);
+		bounds.max = glm::max(bounds.max, vertex.position);
+	}
+
+	return bounds;
+}
+
+// Turns unorm16 positions back into mesh space. Flat axes get a unit extent so nothing divides by zero.
+inline glm::mat4 positionDecode(const MeshBounds& bounds)
+{
+	glm::vec3 extent{ bounds.extent() };
+	extent = { extent.x > 0.0f ? extent.x : 1.0f, extent.y > 0.0f ? extent.y : 1.0f, extent.z > 0.0f ? extent.z : 1.0f };
+
+	return glm::scale(glm::translate(glm::mat4{ 1.0f }, bounds.min), extent);
+}
+
+// Largest error quantization introduced, to tell whether 16 bits are enough for a mesh.
+struct QuantizationError
+{
+	float position{ 0.0f };
+	// Radians.
+	float normalAngle{ 0.0f };
+};
+
+inline std::vector<QuantizedVertex> quantizeVertices(const std::vector<Vertex>& vertices, const MeshBounds& bounds,
+	QuantizationError* error = nullptr)
+{
+	glm::mat4 decode{ positionDecode(bounds) };
+	glm::mat4 encode{ glm::inverse(decode) };
+
+	std::vector<QuantizedVertex> quantized{};
+	quantized.reserve(vertices.size());
+
+	for (const auto& vertex : vertices)
+	{
+		QuantizedVertex packed{
+			.position{ glm::packUnorm4x16(glm::vec4{ glm::vec3{ encode * glm::vec4{ vertex.position, 1.0f } }, 0.0f }) },
+			.normal{ glm::packSnorm2x16(encodeOctahedral(vertex.normal)) },
+			.uv{ glm::packHalf2x16(vertex.uv) }
+		};
+		quantized.push_back(packed);
+
+		if (error != nullptr)
+		{
+			glm::vec3 position{ decode * glm::vec4{ glm::vec3{ glm::unpackUnorm4x16(packed.position) }, 1.0f } };
+			glm::vec3 normal{ decodeOctahedral(glm::unpackSnorm2x16(packed.normal)) };
+
+			error->position = std::max(error->position, glm::length(position - vertex.position));
+			error->normalAngle = std::max(error->normalAngle,
+				std::acos(std::clamp(glm::dot(normal, glm::normalize(vertex.normal)), -1.0f, 1.0f)));
+		}
+	}
+
+	return quantized;
+}
+
+// Computes the bounds and makes the whole index buffer LOD 0 when the mesh has no LODs yet.
+inline void finalizeMesh(MeshData& mesh)
+{
+	if (mesh.vertices.empty() || mesh.indices.empty() || mesh.indices.size() % 3 != 0)
+		throw std::runtime_error("A mesh must be a non-empty triangle list!");
+
+	mesh.bounds = computeBounds(mesh.vertices);
+
+	if (mesh.lods.empty())
+		mesh.lods.push_back({ .firstIndex{ 0 }, .indexCount{ static_cast<uint32_t>(mesh.indices.size()) } });
+}
+
+// Appends up to `maxLods` coarser LODs made by vertex clustering: every vertex snaps to the first vertex of its grid
+// cell and triangles that collapse are dropped. The grid halves per LOD, so each LOD has roughly a quarter of the
+// previous one's triangles. Crude next to edge collapse, but fast, and it needs no new vertices.
+inline void appendClusteredLods(MeshData& mesh, uint32_t maxLods)
+{
+	finalizeMesh(mesh);
+
+	glm::vec3 extent{ glm::max(mesh.bounds.extent(), glm::vec3{ std::numeric_limits<float>::epsilon() }) };
+	// A closed surface with n vertices covers about sqrt(n) cells per axis of a grid that resolves all of them.
+	uint32_t gridSize{ static_cast<uint32_t>(std::sqrt(static_cast<double>(mesh.vertices.size()))) / 2 };
+
+	std::vector<uint32_t> representative(mesh.vertices.size());
+	std::unordered_map<uint64_t, uint32_t> cells{};
+
+	for (uint32_t lod{ 0 }; lod < maxLods && gridSize >= 2; ++lod, gridSize /= 2)
+	{
+		cells.clear();
+		for (uint32_t i{ 0 }; i < mesh.vertices.size(); ++i)
+		{
+			glm::uvec3 cell{ glm::min(glm::uvec3{ (mesh.vertices[i].position - mesh.bounds.min) / extent * static_cast<float>(gridSize) },
+				glm::uvec3{ gridSize - 1 }) };
+			uint64_t key{ (static_cast<uint64_t>(cell.x) * gridSize + cell.y) * gridSize + cell.z };
+
+			representative[i] = cells.try_emplace(key, i).first->second;
+		}
+
+		const MeshLod& finest{ mesh.lods.front() };
+		MeshLod coarse{ .firstIndex{ static_cast<uint32_t>(mesh.indices.size()) } };
+
+		for (uint32_t i{ finest.firstIndex }; i < finest.firstIndex + finest.indexCount; i += 3)
+		{
+			uint32_t a{ representative[mesh.indices[i]] };
+			uint32_t b{ representative[mesh.indices[i + 1]] };
+			uint32_t c{ representative[mesh.indices[i + 2]] };
+
+			if (a == b || b == c || a == c)
+				continue;
+
+			mesh.indices.insert(mesh.indices.end(), { a, b, c });
+			coarse.indexCount += 3;
+		}
+
+		// Not worth a LOD when clustering barely removed anything, and nothing is left to draw below a few triangles.
+		const MeshLod& previous{ mesh.lods.back() };
+		if (coarse.indexCount < 3 * 4 || coarse.indexCount * 10 > previous.indexCount * 9)
+		{
+			mesh.indices.resize(coarse.firstIndex);
+			break;
+		}
+
+		mesh.lods.push_back(coarse);
+	}
+}
+
+// Triangles are clockwise in framebuffer space when seen from the front, which is what the pipelines cull against.
+inline MeshData makeTriangle()
+{
+	const glm::vec3 normal{ 0.0f, 0.0f, -1.0f };
+
+	MeshData mesh{
+		.vertices{
+			{ .position{ 0.0f, -0.5f, 0.0f }, .normal{ normal }, .uv{ 0.5f, 0.0f } },
+			{ .position{ 0.5f, 0.5f, 0.0f }, .normal{ normal }, .uv{ 1.0f, 1.0f } },
+			{ .position{ -0.5f, 0.5f, 0.0f }, .normal{ normal }, .uv{ 0.0f, 1.0f } }
+		},
+		.indices{ 0, 1, 2 }
+	};
+
+	finalizeMesh(mesh);
+	return mesh;
+}
+
+// A UV sphere of radius 0.5 around the origin with about segments * segments triangles; the pole rows are fans.
+inline MeshData makeSphere(uint32_t segments)
+{
+	if (segments < 3)
+		throw std::runtime_error("A sphere needs at least 3 segments!");
+
+	uint32_t rings{ std::max(segments / 2, 2u) };
+
+	MeshData mesh{};
+	mesh.vertices.reserve(static_cast<size_t>(rings + 1) * (segments + 1));
+	mesh.indices.reserve(static_cast<size_t>(rings - 1) * segments * 6);
+
+	// The seam column is duplicated so the UVs wrap cleanly.
+	for (uint32_t ring{ 0 }; ring <= rings; ++ring)
+	{
+		float theta{ glm::pi<float>() * ring / rings };
+
+		for (uint32_t segment{ 0 }; segment <= segments; ++segment)
+		{
+			float phi{ glm::two_pi<float>() * segment / segments };
+			glm::vec3 normal{ std::sin(theta) * std::cos(phi), -std::cos(theta), std::sin(theta) * std::sin(phi) };
+
+			mesh.vertices.push_back({
+				.position{ normal * 0.5f },
+				.normal{ normal },
+				.uv{ static_cast<float>(segment) / segments, static_cast<float>(ring) / rings }
+			});
+		}
+	}
+
+	uint32_t rowLength{ segments + 1 };
+	for (uint32_t ring{ 0 }; ring < rings; ++ring)
+	{
+		for (uint32_t segment{ 0 }; segment < segments; ++segment)
+		{
+			uint32_t topLeft{ ring * rowLength + segment };
+			uint32_t bottomLeft{ topLeft + rowLength };
+
+			if (ring != 0)
+				mesh.indices.insert(mesh.indices.end(), { topLeft, topLeft + 1, bottomLeft });
+
+			if (ring != rings - 1)
+				mesh.indices.insert(mesh.indices.end(), { topLeft + 1, bottomLeft + 1, bottomLeft });
+		}
+	}
+
+	finalizeMesh(mesh);
+	return mesh;
+}
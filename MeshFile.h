@@ -0,0 +1,238 @@
+#pragma once
+#include "MappedFile.h"
+#include "MeshData.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+
+// Layout of a .mesh file, all little-endian:
+//   MeshFileHeader
+//   MeshFileSection[sectionCount]
+//   section data, each section starting at a multiple of meshSectionAlignment
+// The vertex and index sections are exactly what the GPU buffers hold, so loading is a validation of the header and
+// the index range followed by copies straight out of the mapping.
+constexpr uint32_t meshFileMagic{ 0x534D5648 }; // "HVMS"
+constexpr uint32_t meshFileVersion{ 1 };
+// Enough for any copy offset alignment and for aligned SIMD loads of the blobs.
+constexpr uint64_t meshSectionAlignment{ 256 };
+
+enum class MeshSectionType : uint32_t
+{
+	Vertices = 1,
+	Indices = 2,
+	Lods = 3
+};
+
+struct MeshFileHeader
+{
+	uint32_t magic{};
+	uint32_t version{};
+	uint32_t sectionCount{};
+	MeshVertexFormat vertexFormat{};
+	uint32_t vertexStride{};
+	uint32_t vertexCount{};
+	// 2 or 4.
+	uint32_t indexSize{};
+	uint32_t indexCount{};
+	uint32_t lodCount{};
+	uint32_t reserved{};
+	float boundsMin[3]{};
+	float boundsMax[3]{};
+};
+
+struct MeshFileSection
+{
+	MeshSectionType type{};
+	uint32_t reserved{};
+	uint64_t offset{};
+	uint64_t size{};
+};
+
+// Points into a MappedFile, so it is only valid while the file stays open.
+struct MeshFileView
+{
+	const MeshFileHeader* header{};
+	const void* vertices{};
+	uint64_t vertexBytes{};
+	const void* indices{};
+	uint64_t indexBytes{};
+	std::vector<MeshLod> lods{};
+	MeshBounds bounds{};
+};
+
+template <typename Index>
+uint32_t maxIndex(const void* indices, uint32_t indexCount)
+{
+	const auto* begin{ static_cast<const Index*>(indices) };
+	const Index* largest{ std::max_element(begin, begin + indexCount) };
+	return largest != begin + indexCount ? *largest : 0;
+}
+
+inline MeshFileView readMeshFile(const std::string& path, const MappedFile& file)
+{
+	const char* bytes{ reinterpret_cast<const char*>(file.data()) };
+
+	if (file.size() < sizeof(MeshFileHeader))
+		throw std::runtime_error(path + " is too small to be a mesh file");
+
+	MeshFileView view{ .header{ reinterpret_cast<const MeshFileHeader*>(bytes) } };
+	const MeshFileHeader& header{ *view.header };
+
+	if (header.magic != meshFileMagic)
+		throw std::runtime_error(path + " is not a mesh file (bad magic number)");
+
+	if (header.version != meshFileVersion)
+		throw std::runtime_error(path + " has mesh file version " + std::to_string(header.version) + ", expected "
+			+ std::to_string(meshFileVersion));
+
+	if ((header.vertexFormat != MeshVertexFormat::Float && header.vertexFormat != MeshVertexFormat::Quantized)
+		|| header.vertexStride != vertexStride(header.vertexFormat))
+		throw std::runtime_error(path + " has an unsupported vertex format");
+
+	if (header.indexSize != sizeof(uint16_t) && header.indexSize != sizeof(uint32_t))
+		throw std::runtime_error(path + " has an unsupported index size");
+
+	if (file.size() - sizeof(MeshFileHeader) < static_cast<uint64_t>(header.sectionCount) * sizeof(MeshFileSection))
+		throw std::runtime_error(path + " has a truncated section table");
+
+	const auto* sections{ reinterpret_cast<const MeshFileSection*>(bytes + sizeof(MeshFileHeader)) };
+	const MeshLod* lods{ nullptr };
+
+	for (uint32_t i{ 0 }; i < header.sectionCount; ++i)
+	{
+		const MeshFileSection& section{ sections[i] };
+
+		if (section.offset % meshSectionAlignment != 0 || section.offset > file.size() || section.size > file.size() - section.offset)
+			throw std::runtime_error(path + " has a section outside the file");
+
+		switch (section.type)
+		{
+		case MeshSectionType::Vertices:
+			view.vertices = bytes + section.offset;
+			view.vertexBytes = section.size;
+			break;
+		case MeshSectionType::Indices:
+			view.indices = bytes + section.offset;
+			view.indexBytes = section.size;
+			break;
+		case MeshSectionType::Lods:
+			if (section.size != static_cast<uint64_t>(header.lodCount) * sizeof(MeshLod))
+				throw std::runtime_error(path + " has a LOD section of the wrong size");
+			lods = reinterpret_cast<const MeshLod*>(bytes + section.offset);
+			break;
+		default:
+			// Unknown sections are skipped so newer converters can add data without breaking older readers.
+			break;
+		}
+	}
+
+	if (view.vertices == nullptr || view.vertexBytes != static_cast<uint64_t>(header.vertexCount) * header.vertexStride)
+		throw std::runtime_error(path + " has a missing or mis-sized vertex section");
+
+	if (view.indices == nullptr || view.indexBytes != static_cast<uint64_t>(header.indexCount) * header.indexSize)
+		throw std::runtime_error(path + " has a missing or mis-sized index section");
+
+	// The draws read vertices through the indices unchecked, so one out-of-range index would read past the vertex buffer.
+	uint32_t largestIndex{ header.indexSize == sizeof(uint16_t) ? maxIndex<uint16_t>(view.indices, header.indexCount)
+		: maxIndex<uint32_t>(view.indices, header.indexCount) };
+	if (header.indexCount > 0 && largestIndex >= header.vertexCount)
+		throw std::runtime_error(path + " has an index past the last vertex");
+
+	if (lods == nullptr || header.lodCount == 0)
+		throw std::runtime_error(path + " has no LODs");
+
+	view.lods.assign(lods, lods + header.lodCount);
+	for (const auto& lod : view.lods)
+		if (lod.indexCount % 3 != 0 || lod.firstIndex > header.indexCount || lod.indexCount > header.indexCount - lod.firstIndex)
+			throw std::runtime_error(path + " has a LOD outside the index buffer");
+
+	view.bounds = {
+		.min{ header.boundsMin[0], header.boundsMin[1], header.boundsMin[2] },
+		.max{ header.boundsMax[0], header.boundsMax[1], header.boundsMax[2] }
+	};
+
+	return view;
+}
+
+// Indices are stored as 16-bit when the vertex count allows, exactly as MeshLibrary would upload them.
+// Quantized files decode relative to the stored bounds, see positionDecode.
+inline void writeMeshFile(const std::string& path, const MeshData& mesh, MeshVertexFormat vertexFormat)
+{
+	std::vector<QuantizedVertex> quantized{};
+	if (vertexFormat == MeshVertexFormat::Quantized)
+		quantized = quantizeVertices(mesh.vertices, mesh.bounds);
+
+	bool narrowIndices{ mesh.vertices.size() <= std::numeric_limits<uint16_t>::max() + size_t{ 1 } };
+
+	std::vector<uint16_t> narrow{};
+	if (narrowIndices)
+		narrow.assign(mesh.indices.begin(), mesh.indices.end());
+
+	struct Blob
+	{
+		MeshSectionType type{};
+		const void* data{};
+		uint64_t size{};
+	};
+
+	constexpr uint32_t sectionCount{ 3 };
+	const Blob blobs[sectionCount]{
+		{ MeshSectionType::Vertices, quantized.empty() ? static_cast<const void*>(mesh.vertices.data()) : quantized.data(),
+			mesh.vertices.size() * vertexStride(vertexFormat) },
+		{ MeshSectionType::Indices, narrowIndices ? static_cast<const void*>(narrow.data()) : mesh.indices.data(),
+			mesh.indices.size() * (narrowIndices ? sizeof(uint16_t) : sizeof(uint32_t)) },
+		{ MeshSectionType::Lods, mesh.lods.data(), mesh.lods.size() * sizeof(MeshLod) }
+	};
+
+	MeshFileHeader header{
+		.magic{ meshFileMagic },
+		.version{ meshFileVersion },
+		.sectionCount{ sectionCount },
+		.vertexFormat{ vertexFormat },
+		.vertexStride{ vertexStride(vertexFormat) },
+		.vertexCount{ static_cast<uint32_t>(mesh.vertices.size()) },
+		.indexSize{ narrowIndices ? 2u : 4u },
+		.indexCount{ static_cast<uint32_t>(mesh.indices.size()) },
+		.lodCount{ static_cast<uint32_t>(mesh.lods.size()) },
+		.boundsMin{ mesh.bounds.min.x, mesh.bounds.min.y, mesh.bounds.min.z },
+		.boundsMax{ mesh.bounds.max.x, mesh.bounds.max.y, mesh.bounds.max.z }
+	};
+
+	MeshFileSection sections[sectionCount]{};
+	uint64_t offset{ sizeof(MeshFileHeader) + sizeof(sections) };
+	for (uint32_t i{ 0 }; i < sectionCount; ++i)
+	{
+		offset = (offset + meshSectionAlignment - 1) / meshSectionAlignment * meshSectionAlignment;
+		sections[i] = { .type{ blobs[i].type }, .offset{ offset }, .size{ blobs[i].size } };
+		offset += blobs[i].size;
+	}
+
+	const std::string tempPath{ path + ".tmp" };
+	{
+		std::ofstream file(tempPath, std::ios::binary | std::ios::trunc);
+		if (!file.is_open())
+			throw std::runtime_error("Failed to open " + tempPath + " for writing!");
+
+		file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+		file.write(reinterpret_cast<const char*>(sections), sizeof(sections));
+
+		const char padding[meshSectionAlignment]{};
+		for (uint32_t i{ 0 }; i < sectionCount; ++i)
+		{
+			file.write(padding, static_cast<std::streamsize>(sections[i].offset - static_cast<uint64_t>(file.tellp())));
+			file.write(static_cast<const char*>(blobs[i].data), static_cast<std::streamsize>(blobs[i].size));
+		}
+
+		if (!file.good())
+			throw std::runtime_error("Failed to write " + tempPath + "!");
+	}
+
+	std::filesystem::rename(tempPath, path);
+}
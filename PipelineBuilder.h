@@ -0,0 +1,210 @@
+#pragma once
+#include <vulkan/vulkan.h>
+
+#include "CpuProfiler.h"
+#include "PipelineCache.h"
+#include "ShaderLibrary.h"
+#include "ThreadPool.h"
+
+#include <cstdint>
+#include <future>
+#include <string>
+#include <vector>
+
+
+// Everything that differs between the graphics pipelines of this renderer. The rest of the fixed-function
+// state (dynamic viewport and scissor, no blending, single sample, less-than depth compare) is shared.
+struct GraphicsPipelineDescription
+{
+	std::string name{};
+	std::string vertexShaderPath{};
+	std::string fragmentShaderPath{};
+	VkPipelineLayout layout{};
+	VkRenderPass renderPass{};
+	uint32_t subpass{ 0 };
+	std::vector<VkVertexInputBindingDescription> vertexBindings{};
+	std::vector<VkVertexInputAttributeDescription> vertexAttributes{};
+	VkPrimitiveTopology topology{ VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST };
+	VkCullModeFlags cullMode{ VK_CULL_MODE_BACK_BIT };
+	VkFrontFace frontFace{ VK_FRONT_FACE_CLOCKWISE };
+	// The render pass always has a depth attachment; these only decide whether the pipeline uses it.
+	bool depthTest{ true };
+	bool depthWrite{ true };
+};
+
+struct ComputePipelineDescription
+{
+	std::string name{};
+	std::string shaderPath{};
+	VkPipelineLayout layout{};
+};
+
+// Compiles pipelines on the thread pool against the shared VkPipelineCache. Drivers synchronize the cache
+// internally, so startup takes as long as the slowest pipeline instead of the sum of all of them, and the
+// caller can keep creating the swap chain and loading assets while the builds run.
+class PipelineBuilder
+{
+public:
+	void create(PipelineCache& pipelineCache, ShaderLibrary& shaderLibrary, ThreadPool& threadPool)
+	{
+		cache = &pipelineCache;
+		shaders = &shaderLibrary;
+		pool = &threadPool;
+	}
+
+	std::future<VkPipeline> build(const GraphicsPipelineDescription& description)
+	{
+		return pool->submit([this, description] { return buildGraphicsPipeline(description); });
+	}
+
+	std::future<VkPipeline> build(const ComputePipelineDescription& description)
+	{
+		return pool->submit([this, description] { return buildComputePipeline(description); });
+	}
+
+	std::vector<std::future<VkPipeline>> buildAll(const std::vector<GraphicsPipelineDescription>& descriptions)
+	{
+		std::vector<std::future<VkPipeline>> pipelines{};
+		pipelines.reserve(descriptions.size());
+
+		for (const auto& description : descriptions)
+			pipelines.push_back(build(description));
+
+		return pipelines;
+	}
+
+private:
+	PipelineCache* cache{ nullptr };
+	ShaderLibrary* shaders{ nullptr };
+	ThreadPool* pool{ nullptr };
+
+	VkPipeline buildGraphicsPipeline(const GraphicsPipelineDescription& description)
+	{
+		PROFILE_FUNCTION();
+
+		VkPipelineShaderStageCreateInfo shaderStages[]{
+			{
+				.sType{ VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO },
+				.stage{ VK_SHADER_STAGE_VERTEX_BIT },
+				.module{ shaders->load(description.vertexShaderPath) },
+				.pName{ "main" }
+			},
+			{
+				.sType{ VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO },
+				.stage{ VK_SHADER_STAGE_FRAGMENT_BIT },
+				.module{ shaders->load(description.fragmentShaderPath) },
+				.pName{ "main" }
+			}
+		};
+
+		std::vector<VkDynamicState> dynamicStates = {
+			VK_DYNAMIC_STATE_VIEWPORT,
+			VK_DYNAMIC_STATE_SCISSOR
+		};
+
+		VkPipelineDynamicStateCreateInfo dynamicState{
+			.sType{ VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO },
+			.dynamicStateCount{ static_cast<uint32_t>(dynamicStates.size()) },
+			.pDynamicStates{ dynamicStates.data() }
+		};
+
+		VkPipelineVertexInputStateCreateInfo vertexInputInfo{
+			.sType{ VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO },
+			.vertexBindingDescriptionCount{ static_cast<uint32_t>(description.vertexBindings.size()) },
+			.pVertexBindingDescriptions{ description.vertexBindings.data() },
+			.vertexAttributeDescriptionCount{ static_cast<uint32_t>(description.vertexAttributes.size()) },
+			.pVertexAttributeDescriptions{ description.vertexAttributes.data() }
+		};
+
+		VkPipelineInputAssemblyStateCreateInfo inputAssembly{
+			.sType{ VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO },
+			.topology{ description.topology },
+			.primitiveRestartEnable{ VK_FALSE }
+		};
+
+		VkPipelineViewportStateCreateInfo viewportState{
+			.sType{ VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO },
+			.viewportCount{ 1 },
+			.scissorCount{ 1 }
+		};
+
+		VkPipelineRasterizationStateCreateInfo rasterizer{
+			.sType{ VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO },
+			.depthClampEnable{ VK_FALSE },
+			.rasterizerDiscardEnable{ VK_FALSE },
+			.polygonMode{ VK_POLYGON_MODE_FILL },
+			.cullMode{ description.cullMode },
+			.frontFace{ description.frontFace },
+			.depthBiasEnable{ VK_FALSE },
+			.lineWidth{ 1.0f }
+		};
+
+		VkPipelineMultisampleStateCreateInfo multisampling{
+			.sType{ VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO },
+			.rasterizationSamples{ VK_SAMPLE_COUNT_1_BIT },
+			.sampleShadingEnable{ VK_FALSE }
+		};
+
+		VkPipelineDepthStencilStateCreateInfo depthStencil{
+			.sType{ VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO },
+			.depthTestEnable{ description.depthTest ? VK_TRUE : VK_FALSE },
+			.depthWriteEnable{ description.depthWrite ? VK_TRUE : VK_FALSE },
+			.depthCompareOp{ VK_COMPARE_OP_LESS },
+			.depthBoundsTestEnable{ VK_FALSE },
+			.stencilTestEnable{ VK_FALSE }
+		};
+
+		VkPipelineColorBlendAttachmentState colorBlendAttachment{
+			.blendEnable{ VK_FALSE },
+			.colorWriteMask{ VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT }
+		};
+
+		VkPipelineColorBlendStateCreateInfo colorBlending{
+			.sType{ VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO },
+			.logicOpEnable{ VK_FALSE },
+			.attachmentCount{ 1 },
+			.pAttachments{ &colorBlendAttachment }
+		};
+
+		VkGraphicsPipelineCreateInfo pipelineInfo{
+			.sType{ VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO },
+			.stageCount{ 2 },
+			.pStages{ shaderStages },
+			.pVertexInputState{ &vertexInputInfo },
+			.pInputAssemblyState{ &inputAssembly },
+			.pViewportState{ &viewportState },
+			.pRasterizationState{ &rasterizer },
+			.pMultisampleState{ &multisampling },
+			.pDepthStencilState{ &depthStencil },
+			.pColorBlendState{ &colorBlending },
+			.pDynamicState{ &dynamicState },
+			.layout{ description.layout },
+			.renderPass{ description.renderPass },
+			.subpass{ description.subpass },
+			.basePipelineHandle{ VK_NULL_HANDLE },
+			.basePipelineIndex{ -1 }
+		};
+
+		return cache->createGraphicsPipeline(description.name, pipelineInfo);
+	}
+
+	VkPipeline buildComputePipeline(const ComputePipelineDescription& description)
+	{
+		PROFILE_FUNCTION();
+
+		VkComputePipelineCreateInfo pipelineInfo{
+			.sType{ VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO },
+			.stage{
+				.sType{ VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO },
+				.stage{ VK_SHADER_STAGE_COMPUTE_BIT },
+				.module{ shaders->load(description.shaderPath) },
+				.pName{ "main" }
+			},
+			.layout{ description.layout },
+			.basePipelineHandle{ VK_NULL_HANDLE },
+			.basePipelineIndex{ -1 }
+		};
+
+		return cache->createComputePipeline(description.name, pipelineInfo);
+	}
+};
@@ -0,0 +1,306 @@
+#pragma once
+#include <vulkan/vulkan.h>
+
+#include "Hash.h"
+
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+
+// On-disk layout: PipelineCacheFileHeader followed by the blob returned by vkGetPipelineCacheData.
+// The driver blob carries vendor/device/UUID but not the driver version, so we store it ourselves.
+struct PipelineCacheFileHeader
+{
+	uint32_t magic{};
+	uint32_t fileVersion{};
+	uint32_t vendorID{};
+	uint32_t deviceID{};
+	uint32_t driverVersion{};
+	uint8_t pipelineCacheUUID[VK_UUID_SIZE]{};
+	uint64_t dataSize{};
+	uint64_t dataHash{};
+};
+
+struct PipelineCreationStats
+{
+	std::string name{};
+	double cpuMilliseconds{};
+	double driverMilliseconds{};
+	bool feedbackValid{ false };
+	bool cacheHit{ false };
+};
+
+class PipelineCache
+{
+public:
+	static constexpr uint32_t fileMagic{ 0x43505648 }; // "HVPC"
+	static constexpr uint32_t fileVersion{ 1 };
+
+	void create(VkPhysicalDevice physicalDevice, VkDevice dev, const std::string& filePath, bool creationFeedbackSupported)
+	{
+		device = dev;
+		path = filePath;
+		feedbackSupported = creationFeedbackSupported;
+		vkGetPhysicalDeviceProperties(physicalDevice, &deviceProperties);
+
+		std::vector<char> initialData{ loadValidatedData() };
+
+		VkPipelineCacheCreateInfo createInfo{
+			.sType{ VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO },
+			.initialDataSize{ initialData.size() },
+			.pInitialData{ initialData.empty() ? nullptr : initialData.data() }
+		};
+
+		if (vkCreatePipelineCache(device, &createInfo, nullptr, &cache) != VK_SUCCESS)
+			throw std::runtime_error("Failed to create the pipeline cache!");
+
+		loadedDataHash = initialData.empty() ? 0 : hashBytes(initialData.data(), initialData.size());
+	}
+
+	void destroy()
+	{
+		vkDestroyPipelineCache(device, cache, nullptr);
+		cache = VK_NULL_HANDLE;
+	}
+
+	VkPipelineCache handle() const { return cache; }
+
+	// Every pipeline goes through one of these so it always uses the cache and gets timed.
+	VkPipeline createGraphicsPipeline(const std::string& name, VkGraphicsPipelineCreateInfo createInfo)
+	{
+		return createPipeline(name, "graphics", createInfo, createInfo.stageCount,
+			[this](const VkGraphicsPipelineCreateInfo& info, VkPipeline& pipeline)
+			{
+				return vkCreateGraphicsPipelines(device, cache, 1, &info, nullptr, &pipeline);
+			});
+	}
+
+	VkPipeline createComputePipeline(const std::string& name, VkComputePipelineCreateInfo createInfo)
+	{
+		return createPipeline(name, "compute", createInfo, 1,
+			[this](const VkComputePipelineCreateInfo& info, VkPipeline& pipeline)
+			{
+				return vkCreateComputePipelines(device, cache, 1, &info, nullptr, &pipeline);
+			});
+	}
+
+	// Writes to a temporary file first and renames it over the old one, so a crash never leaves a torn cache.
+	void save()
+	{
+		size_t dataSize{ 0 };
+		if (vkGetPipelineCacheData(device, cache, &dataSize, nullptr) != VK_SUCCESS || dataSize == 0)
+			return;
+
+		std::vector<char> data(dataSize);
+		if (vkGetPipelineCacheData(device, cache, &dataSize, data.data()) != VK_SUCCESS)
+			return;
+
+		data.resize(dataSize);
+		uint64_t dataHash{ hashBytes(data.data(), data.size()) };
+
+		if (dataHash == loadedDataHash)
+		{
+			std::cout << "Pipeline cache unchanged, not rewriting " << path << "\n\n";
+			return;
+		}
+
+		PipelineCacheFileHeader header{
+			.magic{ fileMagic },
+			.fileVersion{ fileVersion },
+			.vendorID{ deviceProperties.vendorID },
+			.deviceID{ deviceProperties.deviceID },
+			.driverVersion{ deviceProperties.driverVersion },
+			.dataSize{ data.size() },
+			.dataHash{ dataHash }
+		};
+		std::memcpy(header.pipelineCacheUUID, deviceProperties.pipelineCacheUUID, VK_UUID_SIZE);
+
+		const std::string tempPath{ path + ".tmp" };
+		{
+			std::ofstream file(tempPath, std::ios::binary | std::ios::trunc);
+			if (!file.is_open())
+			{
+				std::cerr << "Failed to open " << tempPath << " for writing the pipeline cache\n";
+				return;
+			}
+
+			file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+			file.write(data.data(), static_cast<std::streamsize>(data.size()));
+
+			if (!file.good())
+			{
+				std::cerr << "Failed to write the pipeline cache to " << tempPath << '\n';
+				return;
+			}
+		}
+
+		std::error_code error{};
+		std::filesystem::rename(tempPath, path, error);
+		if (error)
+		{
+			std::cerr << "Failed to replace " << path << ": " << error.message() << '\n';
+			std::filesystem::remove(tempPath, error);
+			return;
+		}
+
+		loadedDataHash = dataHash;
+		std::cout << "Pipeline cache saved to " << path << " (" << data.size() << " bytes)\n\n";
+	}
+
+	void printStatistics() const
+	{
+		uint32_t hits{ 0 };
+		uint32_t misses{ 0 };
+		double totalMilliseconds{ 0.0 };
+
+		std::cout << "Pipeline creation (" << (feedbackSupported ? "VK_EXT_pipeline_creation_feedback" : "CPU timing only") << "):\n";
+		for (const auto& s : stats)
+		{
+			std::cout << '\t' << s.name << ": " << std::fixed << std::setprecision(3) << s.cpuMilliseconds << " ms";
+
+			if (s.feedbackValid)
+			{
+				std::cout << " (driver " << s.driverMilliseconds << " ms, " << (s.cacheHit ? "cache hit" : "cache miss") << ')';
+
+				if (s.cacheHit)
+					++hits;
+				else
+					++misses;
+			}
+
+			std::cout << '\n';
+			totalMilliseconds += s.cpuMilliseconds;
+		}
+
+		std::cout << "\ttotal: " << totalMilliseconds << " ms";
+		if (feedbackSupported)
+			std::cout << ", " << hits << " hits, " << misses << " misses";
+		std::cout << std::defaultfloat << "\n\n";
+	}
+
+private:
+	VkDevice device{};
+	VkPipelineCache cache{};
+	VkPhysicalDeviceProperties deviceProperties{};
+	std::string path{};
+	bool feedbackSupported{ false };
+	uint64_t loadedDataHash{ 0 };
+	// Pipelines may be created from several threads; the VkPipelineCache synchronizes itself, the stats do not.
+	std::vector<PipelineCreationStats> stats{};
+	std::mutex statsMutex{};
+
+	template <typename CreateInfo, typename Create>
+	VkPipeline createPipeline(const std::string& name, const char* kind, CreateInfo createInfo, uint32_t stageCount, Create create)
+	{
+		VkPipelineCreationFeedbackEXT pipelineFeedback{};
+		std::vector<VkPipelineCreationFeedbackEXT> stageFeedbacks(stageCount);
+
+		VkPipelineCreationFeedbackCreateInfoEXT feedbackInfo{
+			.sType{ VK_STRUCTURE_TYPE_PIPELINE_CREATION_FEEDBACK_CREATE_INFO_EXT },
+			.pNext{ createInfo.pNext },
+			.pPipelineCreationFeedback{ &pipelineFeedback },
+			.pipelineStageCreationFeedbackCount{ stageCount },
+			.pPipelineStageCreationFeedbacks{ stageFeedbacks.data() }
+		};
+
+		if (feedbackSupported)
+			createInfo.pNext = &feedbackInfo;
+
+		auto start{ std::chrono::steady_clock::now() };
+
+		VkPipeline pipeline{};
+		if (create(createInfo, pipeline) != VK_SUCCESS)
+			throw std::runtime_error("Failed to create the " + std::string{ kind } + " pipeline \"" + name + "\"!");
+
+		auto end{ std::chrono::steady_clock::now() };
+
+		PipelineCreationStats pipelineStats{
+			.name{ name },
+			.cpuMilliseconds{ std::chrono::duration<double, std::milli>(end - start).count() }
+		};
+
+		if (feedbackSupported && (pipelineFeedback.flags & VK_PIPELINE_CREATION_FEEDBACK_VALID_BIT_EXT))
+		{
+			pipelineStats.feedbackValid = true;
+			pipelineStats.driverMilliseconds = static_cast<double>(pipelineFeedback.duration) / 1'000'000.0;
+			pipelineStats.cacheHit = (pipelineFeedback.flags & VK_PIPELINE_CREATION_FEEDBACK_APPLICATION_PIPELINE_CACHE_HIT_BIT_EXT) != 0;
+		}
+
+		std::lock_guard lock{ statsMutex };
+		stats.push_back(pipelineStats);
+
+		return pipeline;
+	}
+
+	std::vector<char> loadValidatedData()
+	{
+		std::ifstream file(path, std::ios::ate | std::ios::binary);
+		if (!file.is_open())
+		{
+			std::cout << "No pipeline cache at " << path << ", starting cold\n\n";
+			return {};
+		}
+
+		size_t fileSize{ static_cast<size_t>(file.tellg()) };
+		file.seekg(0);
+
+		PipelineCacheFileHeader header{};
+		if (fileSize < sizeof(header) || !file.read(reinterpret_cast<char*>(&header), sizeof(header)))
+			return reject("file is truncated");
+
+		if (header.magic != fileMagic || header.fileVersion != fileVersion)
+			return reject("unknown file format");
+
+		if (header.vendorID != deviceProperties.vendorID || header.deviceID != deviceProperties.deviceID)
+			return reject("written by a different device");
+
+		if (header.driverVersion != deviceProperties.driverVersion)
+			return reject("written by a different driver version");
+
+		if (std::memcmp(header.pipelineCacheUUID, deviceProperties.pipelineCacheUUID, VK_UUID_SIZE) != 0)
+			return reject("pipelineCacheUUID mismatch");
+
+		if (header.dataSize != fileSize - sizeof(header))
+			return reject("size mismatch");
+
+		std::vector<char> data(static_cast<size_t>(header.dataSize));
+		if (!file.read(data.data(), static_cast<std::streamsize>(data.size())))
+			return reject("failed to read data");
+
+		if (hashBytes(data.data(), data.size()) != header.dataHash)
+			return reject("checksum mismatch");
+
+		// The driver validates its own header too, but a rejected blob would silently give us a cold cache.
+		VkPipelineCacheHeaderVersionOne driverHeader{};
+		if (data.size() < sizeof(driverHeader))
+			return reject("driver header is truncated");
+
+		std::memcpy(&driverHeader, data.data(), sizeof(driverHeader));
+		if (driverHeader.headerVersion != VK_PIPELINE_CACHE_HEADER_VERSION_ONE
+			|| driverHeader.vendorID != deviceProperties.vendorID
+			|| driverHeader.deviceID != deviceProperties.deviceID
+			|| std::memcmp(driverHeader.pipelineCacheUUID, deviceProperties.pipelineCacheUUID, VK_UUID_SIZE) != 0)
+		{
+			return reject("driver header mismatch");
+		}
+
+		std::cout << "Loaded pipeline cache from " << path << " (" << data.size() << " bytes)\n\n";
+
+		return data;
+	}
+
+	std::vector<char> reject(const char* reason) const
+	{
+		std::cout << "Ignoring pipeline cache " << path << ": " << reason << "\n\n";
+		return {};
+	}
+};
@@ -0,0 +1,188 @@
+#pragma once
+#include <vulkan/vulkan.h>
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <iomanip>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+
+enum class PresentProfile
+{
+	LowLatency,
+	Smooth,
+	Throughput
+};
+
+constexpr std::array<PresentProfile, 3> presentProfiles{ PresentProfile::LowLatency, PresentProfile::Smooth, PresentProfile::Throughput };
+
+inline const char* toString(PresentProfile profile)
+{
+	switch (profile)
+	{
+	case PresentProfile::LowLatency: return "low-latency";
+	case PresentProfile::Smooth: return "smooth";
+	case PresentProfile::Throughput: return "throughput";
+	}
+
+	return "unknown";
+}
+
+inline PresentProfile parsePresentProfile(const std::string& name)
+{
+	for (PresentProfile profile : presentProfiles)
+		if (name == toString(profile))
+			return profile;
+
+	throw std::runtime_error("Unknown present profile: " + name + " (expected low-latency, smooth or throughput)");
+}
+
+inline const char* toString(VkPresentModeKHR presentMode)
+{
+	switch (presentMode)
+	{
+	case VK_PRESENT_MODE_IMMEDIATE_KHR: return "IMMEDIATE";
+	case VK_PRESENT_MODE_MAILBOX_KHR: return "MAILBOX";
+	case VK_PRESENT_MODE_FIFO_KHR: return "FIFO";
+	case VK_PRESENT_MODE_FIFO_RELAXED_KHR: return "FIFO_RELAXED";
+	default: return "other";
+	}
+}
+
+// How a profile trades latency against smoothness and GPU utilization.
+struct PresentPolicy
+{
+	// In order of preference; FIFO is always supported and is the final fallback.
+	std::vector<VkPresentModeKHR> presentModes{};
+	// 0 asks for the surface minimum.
+	uint32_t imageCount{ 0 };
+	// Unsynchronized modes render as fast as possible; capping at the refresh rate keeps the CPU from queueing
+	// frames nobody sees and starts each frame as late as possible, which is what cuts the latency.
+	bool limitToRefreshRate{ false };
+};
+
+inline PresentPolicy getPresentPolicy(PresentProfile profile)
+{
+	switch (profile)
+	{
+	case PresentProfile::LowLatency:
+		return { .presentModes{ VK_PRESENT_MODE_IMMEDIATE_KHR, VK_PRESENT_MODE_MAILBOX_KHR }, .imageCount{ 0 }, .limitToRefreshRate{ true } };
+	case PresentProfile::Smooth:
+		return { .presentModes{ VK_PRESENT_MODE_FIFO_KHR }, .imageCount{ 3 } };
+	case PresentProfile::Throughput:
+		return { .presentModes{ VK_PRESENT_MODE_FIFO_RELAXED_KHR }, .imageCount{ 4 } };
+	}
+
+	return {};
+}
+
+inline VkPresentModeKHR choosePresentMode(const PresentPolicy& policy, const std::vector<VkPresentModeKHR>& availablePresentModes)
+{
+	for (VkPresentModeKHR preferred : policy.presentModes)
+		if (std::find(availablePresentModes.begin(), availablePresentModes.end(), preferred) != availablePresentModes.end())
+			return preferred;
+
+	return VK_PRESENT_MODE_FIFO_KHR;
+}
+
+inline uint32_t chooseImageCount(const PresentPolicy& policy, const VkSurfaceCapabilitiesKHR& capabilities)
+{
+	uint32_t imageCount{ std::max(policy.imageCount, capabilities.minImageCount) };
+
+	// A maxImageCount of 0 means there is no upper limit.
+	if (capabilities.maxImageCount > 0)
+		imageCount = std::min(imageCount, capabilities.maxImageCount);
+
+	return imageCount;
+}
+
+// Paces the loop to a target rate. Sleeps for most of the remaining time and spins the rest, since OS sleeps
+// routinely overshoot by a millisecond or more.
+class FrameLimiter
+{
+public:
+	// 0 disables the limiter.
+	void setTargetFps(double fps)
+	{
+		targetFrameTime = fps > 0.0
+			? std::chrono::duration_cast<clock::duration>(std::chrono::duration<double>(1.0 / fps))
+			: clock::duration::zero();
+		nextFrame = clock::now();
+	}
+
+	bool enabled() const { return targetFrameTime > clock::duration::zero(); }
+
+	void wait()
+	{
+		if (!enabled())
+			return;
+
+		auto now{ clock::now() };
+
+		if (nextFrame - now > spinThreshold)
+			std::this_thread::sleep_for(nextFrame - now - spinThreshold);
+
+		while (clock::now() < nextFrame)
+			std::this_thread::yield();
+
+		// After a long hitch, start over instead of rushing a burst of frames to catch up.
+		now = clock::now();
+		nextFrame = std::max(nextFrame + targetFrameTime, now);
+	}
+
+private:
+	using clock = std::chrono::steady_clock;
+
+	static constexpr std::chrono::microseconds spinThreshold{ 1500 };
+
+	clock::duration targetFrameTime{ clock::duration::zero() };
+	clock::time_point nextFrame{};
+};
+
+// Achieved frame rate and the distribution of CPU time from starting vkAcquireNextImageKHR to vkQueuePresentKHR returning.
+class PresentStats
+{
+public:
+	void begin()
+	{
+		latenciesMs.clear();
+		start = std::chrono::steady_clock::now();
+	}
+
+	void add(double acquireToPresentMs)
+	{
+		latenciesMs.push_back(acquireToPresentMs);
+	}
+
+	void report(PresentProfile profile, VkPresentModeKHR presentMode, uint32_t imageCount, double targetFps)
+	{
+		double seconds{ std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() };
+		if (latenciesMs.empty() || seconds <= 0.0)
+			return;
+
+		std::sort(latenciesMs.begin(), latenciesMs.end());
+
+		auto percentile = [&](double p)
+		{
+			return latenciesMs[std::min(latenciesMs.size() - 1, static_cast<size_t>(p * latenciesMs.size()))];
+		};
+
+		std::cout << std::fixed << std::setprecision(2)
+			<< "Present profile " << toString(profile) << " (" << toString(presentMode) << ", " << imageCount << " images, "
+			<< (targetFps > 0.0 ? "limited to " + std::to_string(static_cast<int>(targetFps)) + " fps" : std::string{ "unlimited" }) << "): "
+			<< latenciesMs.size() / seconds << " fps over " << latenciesMs.size() << " frames"
+			<< " | acquire-to-present p50 " << percentile(0.50) << " ms, p90 " << percentile(0.90)
+			<< " ms, p99 " << percentile(0.99) << " ms, max " << latenciesMs.back() << " ms"
+			<< std::defaultfloat << "\n\n";
+	}
+
+private:
+	std::vector<double> latenciesMs{};
+	std::chrono::steady_clock::time_point start{};
+};
@@ -0,0 +1,147 @@
+#pragma once
+#include <vulkan/vulkan.h>
+
+#include "CpuProfiler.h"
+#include "Hash.h"
+#include "MappedFile.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+
+constexpr uint32_t spirvMagic{ 0x07230203 };
+constexpr uint32_t spirvMagicByteSwapped{ 0x03022307 };
+// Magic, version, generator, bound and schema words.
+constexpr size_t spirvHeaderWords{ 5 };
+
+// Turns SPIR-V files into VkShaderModules. Files are memory mapped and handed to the driver straight from the
+// mapping, and modules are cached by a hash of their bytecode, so identical code used by several pipelines
+// (or loaded from several paths) becomes a module only once. A hit is checked against the cached bytecode, so a
+// hash collision throws instead of handing out the wrong module. Modules live until destroy().
+class ShaderLibrary
+{
+public:
+	void create(VkDevice dev)
+	{
+		device = dev;
+	}
+
+	void destroy()
+	{
+		for (const auto& [key, cached] : modules)
+			vkDestroyShaderModule(device, cached.module, nullptr);
+
+		modules.clear();
+	}
+
+	// Safe to call from several threads at once. The driver compiles the module outside the lock, so parallel
+	// pipeline builds only serialize on the cache lookups.
+	VkShaderModule load(const std::string& path)
+	{
+		PROFILE_FUNCTION();
+
+		MappedFile file{ path };
+		validate(path, file);
+
+		uint64_t key{ hashBytes(file.data(), file.size()) };
+
+		{
+			std::lock_guard lock{ mutex };
+
+			if (const CachedModule* cached{ findCached(key, file) })
+			{
+				++hits;
+				return cached->module;
+			}
+		}
+
+		VkShaderModuleCreateInfo createInfo{
+			.sType{ VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO },
+			.codeSize{ file.size() },
+			.pCode{ reinterpret_cast<const uint32_t*>(file.data()) }
+		};
+
+		VkShaderModule shaderModule{};
+		if (vkCreateShaderModule(device, &createInfo, nullptr, &shaderModule) != VK_SUCCESS)
+			throw std::runtime_error("Failed to create a shader module from " + path);
+
+		std::lock_guard lock{ mutex };
+
+		// Another thread may have loaded the same code while the lock was released; the first module wins.
+		if (const CachedModule* cached{ findCached(key, file) })
+		{
+			vkDestroyShaderModule(device, shaderModule, nullptr);
+			++hits;
+			return cached->module;
+		}
+
+		modules.emplace(key, CachedModule{ .code{ file.data(), file.data() + file.size() }, .module{ shaderModule } });
+		++misses;
+		bytesLoaded += file.size();
+
+		return shaderModule;
+	}
+
+	void printStatistics() const
+	{
+		std::cout << "Shader modules: " << misses << " created from " << bytesLoaded << " bytes of SPIR-V, "
+			<< hits << " reused\n\n";
+	}
+
+private:
+	struct CachedModule
+	{
+		std::vector<std::byte> code{};
+		VkShaderModule module{};
+	};
+
+	VkDevice device{};
+	std::unordered_map<uint64_t, CachedModule> modules{};
+	uint32_t hits{ 0 };
+	uint32_t misses{ 0 };
+	size_t bytesLoaded{ 0 };
+	std::mutex mutex{};
+
+	// The module created from this exact bytecode, or null. Must be called with the mutex held.
+	const CachedModule* findCached(uint64_t key, const MappedFile& file) const
+	{
+		auto it{ modules.find(key) };
+		if (it == modules.end())
+			return nullptr;
+
+		const std::vector<std::byte>& code{ it->second.code };
+		if (code.size() != file.size() || std::memcmp(code.data(), file.data(), file.size()) != 0)
+			throw std::runtime_error("Shader module hash collision!");
+
+		return &it->second;
+	}
+
+	// Catches truncated, misnamed and wrong-endian files before they reach the driver, which is not required to check.
+	static void validate(const std::string& path, const MappedFile& file)
+	{
+		if (file.size() < spirvHeaderWords * sizeof(uint32_t))
+			throw std::runtime_error(path + " is too small to be SPIR-V");
+
+		if (file.size() % sizeof(uint32_t) != 0)
+			throw std::runtime_error(path + " is not a whole number of SPIR-V words");
+
+		// Mappings are page aligned, so this only fires if MappedFile ever stops returning whole views.
+		if (reinterpret_cast<uintptr_t>(file.data()) % alignof(uint32_t) != 0)
+			throw std::runtime_error(path + " is not mapped at a 4 byte boundary");
+
+		const auto* words{ reinterpret_cast<const uint32_t*>(file.data()) };
+
+		if (words[0] == spirvMagicByteSwapped)
+			throw std::runtime_error(path + " is SPIR-V with the wrong endianness");
+
+		if (words[0] != spirvMagic)
+			throw std::runtime_error(path + " is not SPIR-V (bad magic number)");
+	}
+};
@@ -0,0 +1,87 @@
+#pragma once
+#include <vulkan/vulkan.h>
+
+#include "DeviceAllocator.h"
+
+#include <cstdint>
+#include <optional>
+#include <vector>
+
+
+struct StagingRegion
+{
+	VkDeviceSize offset{};
+	void* data{ nullptr };
+};
+
+// A persistently mapped upload buffer used as a ring. Space is handed out in submission order and given
+// back a whole batch at a time once the GPU has finished with it, so no per-upload allocation happens.
+class StagingRing
+{
+public:
+	void create(DeviceAllocator& deviceAllocator, VkDeviceSize size)
+	{
+		allocator = &deviceAllocator;
+		buffer = allocator->createBuffer(size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, MemoryUsage::Upload);
+		capacity = size;
+	}
+
+	void destroy()
+	{
+		allocator->destroyBuffer(buffer);
+	}
+
+	VkBuffer handle() const { return buffer.buffer; }
+	VkDeviceSize size() const { return capacity; }
+	VkDeviceSize freeSpace() const { return capacity - used; }
+
+	// Returns nothing when the ring is full; the caller retries after older batches are reclaimed.
+	std::optional<StagingRegion> allocate(VkDeviceSize size, VkDeviceSize alignment)
+	{
+		VkDeviceSize offset{ TlsfBlock::alignUp(head, alignment) };
+		VkDeviceSize consumed{};
+
+		if (offset + size > capacity)
+		{
+			// The tail end of the buffer is too small, skip it and start again at 0.
+			offset = 0;
+			consumed = capacity - head + size;
+		}
+		else
+			consumed = offset - head + size;
+
+		if (used + consumed > capacity)
+			return std::nullopt;
+
+		used += consumed;
+		openBatchBytes += consumed;
+		head = offset + size;
+
+		return StagingRegion{
+			.offset{ offset },
+			.data{ static_cast<char*>(buffer.allocation.mappedData) + offset }
+		};
+	}
+
+	// Closes the current batch; the returned token is handed back to release() once the GPU is done with it.
+	VkDeviceSize closeBatch()
+	{
+		VkDeviceSize bytes{ openBatchBytes };
+		openBatchBytes = 0;
+		return bytes;
+	}
+
+	// Batches complete in the order they were closed, so giving back their size is enough.
+	void release(VkDeviceSize batchBytes)
+	{
+		used -= batchBytes;
+	}
+
+private:
+	DeviceAllocator* allocator{ nullptr };
+	AllocatedBuffer buffer{};
+	VkDeviceSize capacity{ 0 };
+	VkDeviceSize head{ 0 };
+	VkDeviceSize used{ 0 };
+	VkDeviceSize openBatchBytes{ 0 };
+};
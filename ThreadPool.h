@@ -0,0 +1,108 @@
+#pragma once
+#include "CpuProfiler.h"
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+
+// Fixed set of worker threads pulling tasks from one FIFO queue. Results and exceptions come back through futures.
+class ThreadPool
+{
+public:
+	// Leaves one hardware thread for the caller, which usually keeps working while tasks run. hardware_concurrency()
+	// is 0 when the count is unknown, so it is checked before subtracting.
+	static uint32_t defaultThreadCount()
+	{
+		uint32_t hardwareThreads{ std::thread::hardware_concurrency() };
+		return hardwareThreads > 1 ? hardwareThreads - 1 : 1;
+	}
+
+	void create(uint32_t threadCount)
+	{
+		stopping = false;
+
+		for (uint32_t i{ 0 }; i < threadCount; ++i)
+			workers.emplace_back([this, i] { workerLoop(i); });
+	}
+
+	// Joins the workers if destroy() was never reached, e.g. when setup threw; std::thread would terminate otherwise.
+	~ThreadPool()
+	{
+		if (!workers.empty())
+			destroy();
+	}
+
+	void destroy()
+	{
+		{
+			std::lock_guard lock{ mutex };
+			stopping = true;
+		}
+		wakeUp.notify_all();
+
+		for (auto& worker : workers)
+			worker.join();
+
+		workers.clear();
+	}
+
+	uint32_t threadCount() const { return static_cast<uint32_t>(workers.size()); }
+
+	template <typename F>
+	std::future<std::invoke_result_t<F>> submit(F&& function)
+	{
+		// std::function needs a copyable target, so the move-only packaged_task goes behind a shared_ptr.
+		auto task{ std::make_shared<std::packaged_task<std::invoke_result_t<F>()>>(std::forward<F>(function)) };
+		std::future<std::invoke_result_t<F>> result{ task->get_future() };
+
+		{
+			std::lock_guard lock{ mutex };
+			tasks.emplace_back([task] { (*task)(); });
+		}
+		wakeUp.notify_one();
+
+		return result;
+	}
+
+private:
+	std::vector<std::thread> workers{};
+	std::deque<std::function<void()>> tasks{};
+	std::mutex mutex{};
+	std::condition_variable wakeUp{};
+	bool stopping{ false };
+
+	void workerLoop(uint32_t index)
+	{
+		CpuProfiler::setThreadName("Worker " + std::to_string(index));
+
+		while (true)
+		{
+			std::function<void()> task{};
+
+			{
+				std::unique_lock lock{ mutex };
+				wakeUp.wait(lock, [this] { return stopping || !tasks.empty(); });
+
+				// Pending tasks still run on shutdown so no future is left without a result.
+				if (tasks.empty())
+					return;
+
+				task = std::move(tasks.front());
+				tasks.pop_front();
+			}
+
+			task();
+		}
+	}
+};
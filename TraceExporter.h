@@ -0,0 +1,134 @@
+#pragma once
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+
+// Collects complete ("ph":"X") events on named tracks and writes them as Chrome trace JSON, which
+// chrome://tracing, Perfetto and Speedscope all open. CPU and GPU work land on separate tracks of one
+// process so they line up on a shared timeline.
+class TraceExporter
+{
+public:
+	using clock = std::chrono::steady_clock;
+
+	void enable(const std::string& outputPath)
+	{
+		path = outputPath;
+		origin = clock::now();
+		events.reserve(64 * 1024);
+	}
+
+	bool enabled() const { return !path.empty(); }
+
+	// Tracks show up in the viewer in registration order.
+	uint32_t registerTrack(const std::string& name)
+	{
+		std::lock_guard lock{ mutex };
+		trackNames.push_back(name);
+		return static_cast<uint32_t>(trackNames.size() - 1);
+	}
+
+	// `name` must outlive the exporter; string literals are what every caller passes.
+	void add(uint32_t track, const char* name, clock::time_point start, clock::time_point end)
+	{
+		if (!enabled())
+			return;
+
+		std::lock_guard lock{ mutex };
+
+		if (events.size() >= maxEvents)
+		{
+			droppedEvents++;
+			return;
+		}
+
+		events.push_back({
+			.name{ name },
+			.track{ track },
+			.startNs{ std::chrono::duration_cast<std::chrono::nanoseconds>(start - origin).count() },
+			.durationNs{ std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count() }
+		});
+	}
+
+	void write()
+	{
+		if (!enabled())
+			return;
+
+		std::lock_guard lock{ mutex };
+
+		std::ofstream file(path, std::ios::trunc);
+		if (!file.is_open())
+			throw std::runtime_error("Failed to open the trace file " + path);
+
+		file << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+
+		for (size_t track{ 0 }; track < trackNames.size(); ++track)
+		{
+			file << "{\"ph\":\"M\",\"pid\":1,\"tid\":" << track << ",\"name\":\"thread_name\",\"args\":{\"name\":\""
+				<< escape(trackNames[track]) << "\"}},\n";
+			file << "{\"ph\":\"M\",\"pid\":1,\"tid\":" << track << ",\"name\":\"thread_sort_index\",\"args\":{\"sort_index\":"
+				<< track << "}},\n";
+		}
+
+		// Chrome trace timestamps are in microseconds; the fraction keeps the nanoseconds.
+		file.precision(3);
+		file << std::fixed;
+
+		for (size_t i{ 0 }; i < events.size(); ++i)
+		{
+			const TraceEvent& event{ events[i] };
+
+			file << "{\"ph\":\"X\",\"pid\":1,\"tid\":" << event.track << ",\"name\":\"" << escape(event.name)
+				<< "\",\"ts\":" << event.startNs / 1000.0 << ",\"dur\":" << event.durationNs / 1000.0 << '}'
+				<< (i + 1 < events.size() ? ",\n" : "\n");
+		}
+
+		file << "]}\n";
+
+		std::cout << "Trace with " << events.size() << " events written to " << path;
+		if (droppedEvents > 0)
+			std::cout << " (" << droppedEvents << " dropped after reaching the limit)";
+		std::cout << "\n\n";
+	}
+
+private:
+	struct TraceEvent
+	{
+		const char* name{};
+		uint32_t track{};
+		int64_t startNs{};
+		int64_t durationNs{};
+	};
+
+	// Keeps a forgotten --trace from eating all memory; at ~32 bytes per event this is about 128 MiB.
+	static constexpr size_t maxEvents{ 4 * 1024 * 1024 };
+
+	std::string path{};
+	clock::time_point origin{};
+	std::vector<std::string> trackNames{};
+	std::vector<TraceEvent> events{};
+	size_t droppedEvents{ 0 };
+	std::mutex mutex{};
+
+	static std::string escape(const std::string& text)
+	{
+		std::string escaped{};
+		escaped.reserve(text.size());
+
+		for (char c : text)
+		{
+			if (c == '"' || c == '\\')
+				escaped.push_back('\\');
+			escaped.push_back(c);
+		}
+
+		return escaped;
+	}
+};
@@ -0,0 +1,365 @@
+#pragma once
+#include "CpuProfiler.h"
+#include "ThreadPool.h"
+
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+#if GLM_ARCH & GLM_ARCH_SSE2_BIT
+#include <glm/simd/matrix.h>
+#endif
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <future>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+
+// Parent of a root node.
+constexpr uint32_t noParent{ std::numeric_limits<uint32_t>::max() };
+
+// Subtrees below this are updated on the calling thread; splitting them costs more than it saves.
+constexpr uint32_t minNodesPerTask{ 8192 };
+
+struct LocalTransform
+{
+	glm::vec3 translation{ 0.0f };
+	glm::quat rotation{ 1.0f, 0.0f, 0.0f, 0.0f };
+	glm::vec3 scale{ 1.0f };
+};
+
+// Node transforms as parallel arrays in depth-first order, so every parent comes before its children and every
+// subtree is one contiguous range. Changing a node's local transform sets its dirty bit and queues it; update()
+// recomputes the world matrices of the queued nodes' subtrees and nothing else, so its cost follows what moved
+// rather than the size of the hierarchy. Moved subtrees are disjoint ranges, which are spread over the thread pool.
+// Callers keep the node indices they created the hierarchy with; the depth-first slots are internal.
+class TransformHierarchy
+{
+public:
+	// parents[i] is node i's parent, which must come before it, or noParent for a root. Every node starts dirty.
+	void create(ThreadPool& pool, const std::vector<uint32_t>& parents, const std::vector<LocalTransform>& locals)
+	{
+		PROFILE_FUNCTION();
+
+		if (parents.size() != locals.size())
+			throw std::runtime_error("Transform hierarchy parents and local transforms differ in count!");
+
+		threadPool = &pool;
+
+		uint32_t count{ static_cast<uint32_t>(parents.size()) };
+
+		// Children grouped per parent, in node order, so the depth-first walk keeps siblings in the order they were given.
+		std::vector<uint32_t> childStart(static_cast<size_t>(count) + 1, 0);
+		for (uint32_t node{ 0 }; node < count; ++node)
+		{
+			if (parents[node] != noParent && parents[node] >= node)
+				throw std::runtime_error("Transform hierarchy parents must come before their children!");
+
+			if (parents[node] != noParent)
+				++childStart[parents[node] + 1];
+		}
+
+		for (uint32_t node{ 0 }; node < count; ++node)
+			childStart[node + 1] += childStart[node];
+
+		std::vector<uint32_t> children(childStart.back());
+		std::vector<uint32_t> childFill(childStart.begin(), childStart.end() - 1);
+		for (uint32_t node{ 0 }; node < count; ++node)
+			if (parents[node] != noParent)
+				children[childFill[parents[node]]++] = node;
+
+		slotOfNode.assign(count, 0);
+		nodeOfSlot.clear();
+		nodeOfSlot.reserve(count);
+
+		std::vector<uint32_t> stack{};
+		for (uint32_t root{ 0 }; root < count; ++root)
+		{
+			if (parents[root] != noParent)
+				continue;
+
+			stack.push_back(root);
+			while (!stack.empty())
+			{
+				uint32_t node{ stack.back() };
+				stack.pop_back();
+
+				slotOfNode[node] = static_cast<uint32_t>(nodeOfSlot.size());
+				nodeOfSlot.push_back(node);
+
+				// Reversed, so the first child is popped first.
+				for (uint32_t child{ childStart[node + 1] }; child > childStart[node]; --child)
+					stack.push_back(children[child - 1]);
+			}
+		}
+
+		parentSlots.resize(count);
+		translations.resize(count);
+		rotations.resize(count);
+		scales.resize(count);
+		for (uint32_t slot{ 0 }; slot < count; ++slot)
+		{
+			uint32_t node{ nodeOfSlot[slot] };
+			parentSlots[slot] = parents[node] == noParent ? noParent : slotOfNode[parents[node]];
+			translations[slot] = locals[node].translation;
+			rotations[slot] = locals[node].rotation;
+			scales[slot] = locals[node].scale;
+		}
+
+		// A subtree ends where the last of its descendants does; children come after their parents, so one
+		// backward pass carries each end up to the parent.
+		subtreeEnds.resize(count);
+		for (uint32_t slot{ 0 }; slot < count; ++slot)
+			subtreeEnds[slot] = slot + 1;
+		for (uint32_t slot{ count }; slot-- > 0;)
+			if (parentSlots[slot] != noParent)
+				subtreeEnds[parentSlots[slot]] = std::max(subtreeEnds[parentSlots[slot]], subtreeEnds[slot]);
+
+		worlds.assign(count, glm::mat4{ 1.0f });
+		dirty.assign(count, 0);
+		dirtySlots.clear();
+		for (uint32_t slot{ 0 }; slot < count; slot = subtreeEnds[slot])
+			markDirty(slot);
+	}
+
+	void destroy()
+	{
+		for (auto* array : { &slotOfNode, &nodeOfSlot, &parentSlots, &subtreeEnds, &dirtySlots })
+			array->clear();
+
+		translations.clear();
+		rotations.clear();
+		scales.clear();
+		worlds.clear();
+		dirty.clear();
+		threadPool = nullptr;
+	}
+
+	uint32_t count() const { return static_cast<uint32_t>(worlds.size()); }
+
+	LocalTransform local(uint32_t node) const
+	{
+		uint32_t slot{ slotOfNode[node] };
+		return { .translation{ translations[slot] }, .rotation{ rotations[slot] }, .scale{ scales[slot] } };
+	}
+
+	void setLocal(uint32_t node, const LocalTransform& transform)
+	{
+		uint32_t slot{ slotOfNode[node] };
+		translations[slot] = transform.translation;
+		rotations[slot] = transform.rotation;
+		scales[slot] = transform.scale;
+		markDirty(slot);
+	}
+
+	void setTranslation(uint32_t node, const glm::vec3& translation)
+	{
+		uint32_t slot{ slotOfNode[node] };
+		translations[slot] = translation;
+		markDirty(slot);
+	}
+
+	void setRotation(uint32_t node, const glm::quat& rotation)
+	{
+		uint32_t slot{ slotOfNode[node] };
+		rotations[slot] = rotation;
+		markDirty(slot);
+	}
+
+	// Only current after update().
+	const glm::mat4& world(uint32_t node) const { return worlds[slotOfNode[node]]; }
+
+	// The dirty nodes are sorted into depth-first order, and any that lie inside an earlier one's subtree are
+	// dropped, leaving disjoint subtree ranges. Ranges bigger than a task are opened up on this thread: the root is
+	// updated here and its child subtrees become ranges of their own, so one moved root still spreads over every core.
+	void update()
+	{
+		PROFILE_FUNCTION();
+
+		auto start{ std::chrono::steady_clock::now() };
+
+		std::sort(dirtySlots.begin(), dirtySlots.end());
+
+		std::vector<std::pair<uint32_t, uint32_t>> ranges{};
+		uint32_t coveredEnd{ 0 };
+		uint32_t movedNodes{ 0 };
+		for (uint32_t slot : dirtySlots)
+		{
+			dirty[slot] = 0;
+			if (slot < coveredEnd)
+				continue;
+
+			ranges.push_back({ slot, subtreeEnds[slot] });
+			coveredEnd = subtreeEnds[slot];
+			movedNodes += coveredEnd - slot;
+		}
+		dirtySlots.clear();
+
+		uint32_t taskSize{ std::max(minNodesPerTask, movedNodes / (4 * (threadPool->threadCount() + 1))) };
+
+		std::vector<std::pair<uint32_t, uint32_t>> taskRanges{};
+		while (!ranges.empty())
+		{
+			auto [begin, end]{ ranges.back() };
+			ranges.pop_back();
+
+			if (end - begin <= taskSize)
+			{
+				taskRanges.push_back({ begin, end });
+				continue;
+			}
+
+			updateRange(begin, begin + 1);
+			for (uint32_t child{ begin + 1 }; child < end; child = subtreeEnds[child])
+				ranges.push_back({ child, subtreeEnds[child] });
+		}
+
+		// Ranges are packed into tasks of about taskSize nodes; the caller takes the first instead of idling.
+		std::vector<std::future<void>> tasks{};
+		size_t callerEnd{ 0 };
+		for (size_t first{ 0 }; first < taskRanges.size();)
+		{
+			size_t last{ first };
+			uint32_t nodes{ 0 };
+			while (last < taskRanges.size() && (nodes == 0 || nodes + (taskRanges[last].second - taskRanges[last].first) <= taskSize))
+			{
+				nodes += taskRanges[last].second - taskRanges[last].first;
+				++last;
+			}
+
+			if (first == 0)
+				callerEnd = last;
+			else
+			{
+				tasks.push_back(threadPool->submit([this, &taskRanges, first, last] {
+					for (size_t i{ first }; i < last; ++i)
+						updateRange(taskRanges[i].first, taskRanges[i].second);
+				}));
+			}
+
+			first = last;
+		}
+
+		for (size_t i{ 0 }; i < callerEnd; ++i)
+			updateRange(taskRanges[i].first, taskRanges[i].second);
+
+		for (auto& task : tasks)
+			task.get();
+
+		lastUpdatedNodes = movedNodes;
+		lastTaskCount = static_cast<uint32_t>(tasks.size()) + (callerEnd > 0 ? 1 : 0);
+		updateMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+		updatedNodes += movedNodes;
+		++updates;
+	}
+
+	uint32_t lastUpdateNodeCount() const { return lastUpdatedNodes; }
+	uint32_t lastUpdateTaskCount() const { return lastTaskCount; }
+
+	static const char* simdPath()
+	{
+#if GLM_ARCH & GLM_ARCH_SSE2_BIT
+		return "SSE2";
+#else
+		return "scalar";
+#endif
+	}
+
+	void printStatistics() const
+	{
+		if (updates == 0)
+			return;
+
+		std::cout << "Transform hierarchy: " << count() << " nodes, " << simdPath() << ": " << std::fixed << std::setprecision(3)
+			<< updateMs / static_cast<double>(updates) << " ms and " << static_cast<double>(updatedNodes) / static_cast<double>(updates) << " nodes per update"
+			<< std::defaultfloat << "\n\n";
+	}
+
+private:
+	ThreadPool* threadPool{ nullptr };
+
+	// Indexed by the caller's node index.
+	std::vector<uint32_t> slotOfNode{};
+
+	// Indexed by depth-first slot.
+	std::vector<uint32_t> nodeOfSlot{};
+	std::vector<uint32_t> parentSlots{};
+	// One past the last slot of the node's subtree.
+	std::vector<uint32_t> subtreeEnds{};
+	std::vector<glm::vec3> translations{};
+	std::vector<glm::quat> rotations{};
+	std::vector<glm::vec3> scales{};
+	std::vector<glm::mat4> worlds{};
+	std::vector<uint8_t> dirty{};
+
+	// Slots whose dirty bit was set since the last update, each once.
+	std::vector<uint32_t> dirtySlots{};
+
+	double updateMs{ 0.0 };
+	uint64_t updatedNodes{ 0 };
+	uint64_t updates{ 0 };
+	uint32_t lastUpdatedNodes{ 0 };
+	uint32_t lastTaskCount{ 0 };
+
+	void markDirty(uint32_t slot)
+	{
+		if (dirty[slot] != 0)
+			return;
+
+		dirty[slot] = 1;
+		dirtySlots.push_back(slot);
+	}
+
+	// Translation * rotation * scale, built directly rather than as three matrix products.
+	glm::mat4 localMatrix(uint32_t slot) const
+	{
+		glm::mat3 rotation{ glm::mat3_cast(rotations[slot]) };
+		const glm::vec3& scale{ scales[slot] };
+
+		return {
+			glm::vec4{ rotation[0] * scale.x, 0.0f },
+			glm::vec4{ rotation[1] * scale.y, 0.0f },
+			glm::vec4{ rotation[2] * scale.z, 0.0f },
+			glm::vec4{ translations[slot], 1.0f }
+		};
+	}
+
+	// Every parent inside the range comes before its children, and the root's parent is outside it and current.
+	void updateRange(uint32_t begin, uint32_t end)
+	{
+		PROFILE_ZONE("update transforms");
+
+		for (uint32_t slot{ begin }; slot < end; ++slot)
+		{
+			glm::mat4 local{ localMatrix(slot) };
+			uint32_t parent{ parentSlots[slot] };
+
+			if (parent == noParent)
+			{
+				worlds[slot] = local;
+				continue;
+			}
+
+#if GLM_ARCH & GLM_ARCH_SSE2_BIT
+			// glm::mat4 is only 4-byte aligned, hence the unaligned loads and stores.
+			const float* parentWorld{ &worlds[parent][0][0] };
+			glm_vec4 parentColumns[4]{ _mm_loadu_ps(parentWorld), _mm_loadu_ps(parentWorld + 4), _mm_loadu_ps(parentWorld + 8), _mm_loadu_ps(parentWorld + 12) };
+			glm_vec4 localColumns[4]{ _mm_loadu_ps(&local[0][0]), _mm_loadu_ps(&local[1][0]), _mm_loadu_ps(&local[2][0]), _mm_loadu_ps(&local[3][0]) };
+
+			glm_vec4 worldColumns[4];
+			glm_mat4_mul(parentColumns, localColumns, worldColumns);
+
+			float* world{ &worlds[slot][0][0] };
+			for (int column{ 0 }; column < 4; ++column)
+				_mm_storeu_ps(world + column * 4, worldColumns[column]);
+#else
+			worlds[slot] = worlds[parent] * local;
+#endif
+		}
+	}
+};
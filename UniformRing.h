@@ -0,0 +1,105 @@
+#pragma once
+#include <vulkan/vulkan.h>
+
+#include "DeviceAllocator.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <limits>
+#include <stdexcept>
+#include <string>
+
+
+// `offset` is the dynamic offset for a descriptor that binds the ring's buffer at offset 0.
+struct RingAllocation
+{
+	uint32_t offset{};
+	void* data{};
+};
+
+// Persistently mapped buffer with one region per frame slot, usable as uniform and storage buffer. Per-draw
+// constants are a bump allocation in the current slot's region plus a dynamic offset when binding, so drawing
+// needs neither a buffer update nor a descriptor write. Allocation is a single atomic add, so the record
+// threads can push their draws' data concurrently.
+class UniformRing
+{
+public:
+	void create(DeviceAllocator& deviceAllocator, VkDeviceSize bytesPerFrame, uint32_t framesInFlight,
+		VkDeviceSize minUniformBufferOffsetAlignment, VkDeviceSize minStorageBufferOffsetAlignment)
+	{
+		allocator = &deviceAllocator;
+		alignment = std::max({ minUniformBufferOffsetAlignment, minStorageBufferOffsetAlignment, VkDeviceSize{ 16 } });
+		frameSize = alignUp(bytesPerFrame, alignment);
+
+		// Dynamic offsets are 32-bit.
+		if (frameSize * framesInFlight > std::numeric_limits<uint32_t>::max())
+			throw std::runtime_error("The uniform ring does not fit in 4 GiB!");
+
+		buffer = allocator->createBuffer(frameSize * framesInFlight, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+			MemoryUsage::CpuToGpu);
+
+		mapped = static_cast<char*>(buffer.allocation.mappedData);
+		if (mapped == nullptr)
+			throw std::runtime_error("The uniform ring is not host-visible!");
+	}
+
+	void destroy()
+	{
+		allocator->destroyBuffer(buffer);
+		mapped = nullptr;
+	}
+
+	VkBuffer handle() const { return buffer.buffer; }
+
+	// Call once the slot's previous frame has completed; its data is overwritten from here on.
+	void beginFrame(uint32_t frameSlot)
+	{
+		peakBytes = std::max(peakBytes, head.load(std::memory_order_relaxed));
+		frameBase = frameSlot * frameSize;
+		head.store(0, std::memory_order_relaxed);
+	}
+
+	RingAllocation allocate(VkDeviceSize size)
+	{
+		VkDeviceSize alignedSize{ alignUp(size, alignment) };
+		VkDeviceSize offset{ head.fetch_add(alignedSize, std::memory_order_relaxed) };
+
+		if (offset + alignedSize > frameSize)
+			throw std::runtime_error("The uniform ring ran out of space (" + std::to_string(frameSize) + " bytes per frame)!");
+
+		return { .offset{ static_cast<uint32_t>(frameBase + offset) }, .data{ mapped + frameBase + offset } };
+	}
+
+	// Copies `value` into the ring and returns its dynamic offset.
+	template <typename T>
+	uint32_t push(const T& value)
+	{
+		RingAllocation allocation{ allocate(sizeof(T)) };
+		std::memcpy(allocation.data, &value, sizeof(T));
+		return allocation.offset;
+	}
+
+	void printStatistics() const
+	{
+		std::cout << "Uniform ring: peak " << std::max(peakBytes, head.load(std::memory_order_relaxed)) << " of " << frameSize
+			<< " bytes per frame, " << alignment << "-byte alignment\n\n";
+	}
+
+private:
+	DeviceAllocator* allocator{ nullptr };
+	AllocatedBuffer buffer{};
+	char* mapped{ nullptr };
+	VkDeviceSize alignment{ 16 };
+	VkDeviceSize frameSize{ 0 };
+	VkDeviceSize frameBase{ 0 };
+	std::atomic<VkDeviceSize> head{ 0 };
+	VkDeviceSize peakBytes{ 0 };
+
+	static VkDeviceSize alignUp(VkDeviceSize value, VkDeviceSize alignment)
+	{
+		return (value + alignment - 1) / alignment * alignment;
+	}
+};
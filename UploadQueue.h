@@ -0,0 +1,327 @@
+#pragma once
+#include <vulkan/vulkan.h>
+
+#include "CpuProfiler.h"
+#include "DeviceAllocator.h"
+#include "GpuQueue.h"
+#include "StagingRing.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <iostream>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
+#include <vector>
+
+
+constexpr VkDeviceSize stagingRingSize{ 64ull * 1024 * 1024 };
+
+// Identifies one uploadBuffer call; uploads complete in the order they were queued.
+using UploadTicket = uint64_t;
+
+// The queue that first reads an upload, which is the one that acquires it after a queue family transfer.
+enum class UploadConsumer
+{
+	Graphics,
+	Compute
+};
+
+// What the graphics and compute submissions of a frame have to do to consume that frame's uploads.
+struct UploadBatch
+{
+	// No semaphore when nothing was uploaded for that queue.
+	SemaphoreWait wait{};
+	std::vector<VkBufferMemoryBarrier> acquireBarriers{};
+	SemaphoreWait computeWait{};
+	std::vector<VkBufferMemoryBarrier> computeAcquireBarriers{};
+};
+
+// Streams buffer data through a StagingRing and a (preferably dedicated) transfer queue.
+// All uploads queued during a frame go out in a single transfer submit from flush(), and the graphics and
+// compute queues wait on its timeline point instead of the CPU waiting for the copy.
+class UploadQueue
+{
+public:
+	void create(VkDevice dev, DeviceAllocator& allocator, GpuQueue& queue, uint32_t graphicsQueueFamily, uint32_t computeQueueFamily,
+		uint32_t framesInFlight)
+	{
+		device = dev;
+		transferQueue = &queue;
+		transferFamily = queue.familyIndex();
+		graphicsFamily = graphicsQueueFamily;
+		computeFamily = computeQueueFamily;
+
+		ring.create(allocator, stagingRingSize);
+
+		VkCommandPoolCreateInfo poolInfo{
+			.sType{ VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO },
+			.flags{ VK_COMMAND_POOL_CREATE_TRANSIENT_BIT | VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT },
+			.queueFamilyIndex{ transferFamily }
+		};
+
+		if (vkCreateCommandPool(device, &poolInfo, nullptr, &commandPool) != VK_SUCCESS)
+			throw std::runtime_error("Failed to create the transfer command pool!");
+
+		slots.resize(framesInFlight);
+
+		std::vector<VkCommandBuffer> commandBuffers(framesInFlight);
+		VkCommandBufferAllocateInfo allocInfo{
+			.sType{ VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO },
+			.commandPool{ commandPool },
+			.level{ VK_COMMAND_BUFFER_LEVEL_PRIMARY },
+			.commandBufferCount{ framesInFlight }
+		};
+
+		if (vkAllocateCommandBuffers(device, &allocInfo, commandBuffers.data()) != VK_SUCCESS)
+			throw std::runtime_error("Failed to allocate the transfer command buffers!");
+
+		for (size_t i{ 0 }; i < slots.size(); ++i)
+			slots[i].commandBuffer = commandBuffers[i];
+
+		std::cout << "Uploads: " << stagingRingSize / (1024 * 1024) << " MiB staging ring on queue family " << transferFamily
+			<< (transferFamily != graphicsFamily ? " (dedicated transfer)" : " (shared with graphics)") << "\n\n";
+	}
+
+	void destroy()
+	{
+		vkDestroyCommandPool(device, commandPool, nullptr);
+		ring.destroy();
+	}
+
+	// Queues `size` bytes for `dst` at `dstOffset`. The data is copied into the staging ring right away when
+	// there is room, otherwise it waits in a backlog and is streamed over the next frames.
+	// `dstStages`/`dstAccess` describe how the `consumer` queue will first use the data.
+	UploadTicket uploadBuffer(VkBuffer dst, VkDeviceSize dstOffset, const void* data, VkDeviceSize size,
+		VkPipelineStageFlags dstStages, VkAccessFlags dstAccess, UploadConsumer consumer = UploadConsumer::Graphics)
+	{
+		std::lock_guard lock{ mutex };
+
+		const auto* bytes{ static_cast<const char*>(data) };
+
+		PendingUpload upload{
+			.ticket{ ++lastTicket },
+			.dst{ dst },
+			.dstOffset{ dstOffset },
+			.size{ size },
+			.dstStages{ dstStages },
+			.dstAccess{ dstAccess },
+			.consumer{ consumer }
+		};
+
+		if (backlog.empty())
+			stage(upload, bytes, 0);
+
+		if (upload.staged < upload.size)
+		{
+			upload.dataStart = upload.staged;
+			upload.data.assign(bytes + upload.staged, bytes + upload.size);
+			backlog.push_back(std::move(upload));
+		}
+		else
+			completedTicket = upload.ticket;
+
+		return upload.ticket;
+	}
+
+	// True once the upload has been submitted; work its consumer submits with the same or a later frame sees the data.
+	bool isUploaded(UploadTicket ticket)
+	{
+		std::lock_guard lock{ mutex };
+		return ticket <= submittedTicket;
+	}
+
+	// Must be called once per frame after the frame slot's previous graphics submit has completed.
+	// Submits everything queued since the last call and returns what the graphics and compute submits have to wait for.
+	UploadBatch flush(uint32_t frameSlot)
+	{
+		PROFILE_FUNCTION();
+
+		std::lock_guard lock{ mutex };
+
+		TransferSlot& slot{ slots[frameSlot] };
+
+		// This slot's previous transfer finished before the graphics work that waited on it, so this never blocks in practice.
+		transferQueue->wait(slot.submittedValue);
+		ring.release(slot.ringBytes);
+		slot.ringBytes = 0;
+
+		while (!backlog.empty())
+		{
+			PendingUpload& upload{ backlog.front() };
+			stage(upload, upload.data.data(), upload.dataStart);
+
+			if (upload.staged < upload.size)
+				break;
+
+			completedTicket = upload.ticket;
+			backlog.pop_front();
+		}
+
+		if (copies.empty())
+			return {};
+
+		vkResetCommandBuffer(slot.commandBuffer, 0);
+
+		VkCommandBufferBeginInfo beginInfo{
+			.sType{ VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO },
+			.flags{ VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT }
+		};
+		vkBeginCommandBuffer(slot.commandBuffer, &beginInfo);
+
+		UploadBatch batch{};
+		std::vector<VkBufferMemoryBarrier> releaseBarriers{};
+		VkPipelineStageFlags graphicsStages{ 0 };
+		VkPipelineStageFlags computeStages{ 0 };
+
+		for (const auto& copy : copies)
+		{
+			VkBufferCopy region{
+				.srcOffset{ copy.srcOffset },
+				.dstOffset{ copy.dstOffset },
+				.size{ copy.size }
+			};
+			vkCmdCopyBuffer(slot.commandBuffer, ring.handle(), copy.dst, 1, &region);
+
+			bool forCompute{ copy.consumer == UploadConsumer::Compute };
+			(forCompute ? computeStages : graphicsStages) |= copy.dstStages;
+
+			// Exclusive buffers written on another family must be released here and acquired on the consuming queue.
+			uint32_t consumerFamily{ forCompute ? computeFamily : graphicsFamily };
+			if (transferFamily != consumerFamily)
+			{
+				VkBufferMemoryBarrier barrier{
+					.sType{ VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER },
+					.srcAccessMask{ VK_ACCESS_TRANSFER_WRITE_BIT },
+					.dstAccessMask{ 0 },
+					.srcQueueFamilyIndex{ transferFamily },
+					.dstQueueFamilyIndex{ consumerFamily },
+					.buffer{ copy.dst },
+					.offset{ copy.dstOffset },
+					.size{ copy.size }
+				};
+				releaseBarriers.push_back(barrier);
+
+				barrier.srcAccessMask = 0;
+				barrier.dstAccessMask = copy.dstAccess;
+				(forCompute ? batch.computeAcquireBarriers : batch.acquireBarriers).push_back(barrier);
+			}
+		}
+
+		if (!releaseBarriers.empty())
+		{
+			vkCmdPipelineBarrier(slot.commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0,
+				0, nullptr, static_cast<uint32_t>(releaseBarriers.size()), releaseBarriers.data(), 0, nullptr);
+		}
+
+		vkEndCommandBuffer(slot.commandBuffer);
+
+		slot.submittedValue = transferQueue->submit({ slot.commandBuffer });
+		if (graphicsStages != 0)
+			batch.wait = transferQueue->waitFor(slot.submittedValue, graphicsStages);
+		if (computeStages != 0)
+			batch.computeWait = transferQueue->waitFor(slot.submittedValue, computeStages);
+
+		slot.ringBytes = ring.closeBatch();
+		submittedTicket = completedTicket;
+		copies.clear();
+
+		return batch;
+	}
+
+	// Records the queue family acquire half of the ownership transfers into a command buffer of the `consumer`
+	// queue; must precede any use of the data.
+	static void recordAcquireBarriers(VkCommandBuffer commandBuffer, const UploadBatch& batch,
+		UploadConsumer consumer = UploadConsumer::Graphics)
+	{
+		bool forCompute{ consumer == UploadConsumer::Compute };
+		const std::vector<VkBufferMemoryBarrier>& barriers{ forCompute ? batch.computeAcquireBarriers : batch.acquireBarriers };
+		if (barriers.empty())
+			return;
+
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, (forCompute ? batch.computeWait : batch.wait).stages, 0,
+			0, nullptr, static_cast<uint32_t>(barriers.size()), barriers.data(), 0, nullptr);
+	}
+
+private:
+	struct TransferSlot
+	{
+		VkCommandBuffer commandBuffer{};
+		uint64_t submittedValue{ 0 };
+		VkDeviceSize ringBytes{ 0 };
+	};
+
+	struct PendingUpload
+	{
+		UploadTicket ticket{};
+		VkBuffer dst{};
+		VkDeviceSize dstOffset{};
+		VkDeviceSize size{};
+		VkPipelineStageFlags dstStages{};
+		VkAccessFlags dstAccess{};
+		UploadConsumer consumer{};
+		// Bytes already copied into the ring; `data` holds the bytes from `dataStart` on.
+		VkDeviceSize staged{ 0 };
+		VkDeviceSize dataStart{ 0 };
+		std::vector<char> data{};
+	};
+
+	struct StagedCopy
+	{
+		VkBuffer dst{};
+		VkDeviceSize srcOffset{};
+		VkDeviceSize dstOffset{};
+		VkDeviceSize size{};
+		VkPipelineStageFlags dstStages{};
+		VkAccessFlags dstAccess{};
+		UploadConsumer consumer{};
+	};
+
+	// Large uploads are split so they can stream through a ring smaller than themselves.
+	static constexpr VkDeviceSize maxCopySize{ stagingRingSize / 4 };
+	static constexpr VkDeviceSize copyAlignment{ 16 };
+
+	VkDevice device{};
+	GpuQueue* transferQueue{};
+	uint32_t transferFamily{};
+	uint32_t graphicsFamily{};
+	uint32_t computeFamily{};
+	VkCommandPool commandPool{};
+	StagingRing ring{};
+	std::vector<TransferSlot> slots{};
+	std::vector<StagedCopy> copies{};
+	std::deque<PendingUpload> backlog{};
+	UploadTicket lastTicket{ 0 };
+	UploadTicket completedTicket{ 0 };
+	UploadTicket submittedTicket{ 0 };
+	std::mutex mutex{};
+
+	// Copies as much of `upload` as fits into the ring. `source` points at byte `sourceStart` of the upload.
+	void stage(PendingUpload& upload, const char* source, VkDeviceSize sourceStart)
+	{
+		while (upload.staged < upload.size)
+		{
+			VkDeviceSize pieceSize{ std::min(upload.size - upload.staged, maxCopySize) };
+
+			std::optional<StagingRegion> region{ ring.allocate(pieceSize, copyAlignment) };
+			if (!region.has_value())
+				return;
+
+			std::memcpy(region->data, source + (upload.staged - sourceStart), static_cast<size_t>(pieceSize));
+
+			copies.push_back({
+				.dst{ upload.dst },
+				.srcOffset{ region->offset },
+				.dstOffset{ upload.dstOffset + upload.staged },
+				.size{ pieceSize },
+				.dstStages{ upload.dstStages },
+				.dstAccess{ upload.dstAccess },
+				.consumer{ upload.consumer }
+			});
+
+			upload.staged += pieceSize;
+		}
+	}
+};
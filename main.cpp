@@ -1,15 +1,37 @@
+#include "BvhBenchmark.h"
+#include "CullingBenchmark.h"
 #include "HelloTriangleApp.h"
+#include "HierarchyBenchmark.h"
 
 #include <iostream>
 #include <stdexcept>
 #include <cstdlib>
 
 
-int main()
+int main(int argc, char* argv[])
 {
-	HelloTriangleApp app{};
-
 	try {
+		AppConfig config{ parseCommandLine(argc, argv) };
+
+		if (config.cullBenchmarkBoxes > 0)
+		{
+			runCullingBenchmark(config.cullBenchmarkBoxes);
+			return EXIT_SUCCESS;
+		}
+
+		if (config.bvhBenchmarkTriangles > 0)
+		{
+			runBvhBenchmark(config.bvhBenchmarkTriangles);
+			return EXIT_SUCCESS;
+		}
+
+		if (config.hierarchyBenchmarkNodes > 0)
+		{
+			runHierarchyBenchmark(config.hierarchyBenchmarkNodes);
+			return EXIT_SUCCESS;
+		}
+
+		HelloTriangleApp app{ config };
 		app.run();
 	}
 	catch (const std::exception& e) {
@@ -1,3 +1,9 @@
 C:\VulkanSDK\1.3.290.0\Bin\glslc.exe shader.vert -o vert.spv
 C:\VulkanSDK\1.3.290.0\Bin\glslc.exe shader.frag -o frag.spv
+C:\VulkanSDK\1.3.290.0\Bin\glslc.exe quantized.vert -o quantizedVert.spv
+C:\VulkanSDK\1.3.290.0\Bin\glslc.exe instanced.vert -o instancedVert.spv
+C:\VulkanSDK\1.3.290.0\Bin\glslc.exe quantizedInstanced.vert -o quantizedInstancedVert.spv
+C:\VulkanSDK\1.3.290.0\Bin\glslc.exe gpuDriven.vert -o gpuDrivenVert.spv
+C:\VulkanSDK\1.3.290.0\Bin\glslc.exe quantizedGpuDriven.vert -o quantizedGpuDrivenVert.spv
+C:\VulkanSDK\1.3.290.0\Bin\glslc.exe cull.comp -o cull.spv
 PAUSE
\ No newline at end of file
@@ -0,0 +1,29 @@
+#version 450
+
+layout(set = 0, binding = 0) uniform CameraConstants {
+	mat4 viewProjection;
+} camera;
+
+// The model matrix comes from the transforms; only the tint is used.
+layout(set = 0, binding = 1) uniform ObjectConstants {
+	mat4 model;
+	vec4 tint;
+} object;
+
+layout(location = 0) in vec3 inPosition;
+layout(location = 1) in vec3 inNormal;
+layout(location = 2) in vec2 inUV;
+
+// Indexed by the object index the culling pass put in firstInstance.
+layout(std430, set = 1, binding = 0) readonly buffer Transforms {
+	mat4 models[];
+};
+
+layout(location = 0) out vec3 fragColor;
+
+void main()
+{
+	gl_Position = camera.viewProjection * models[gl_InstanceIndex] * vec4(inPosition, 1.0);
+	// No lighting yet; the normal and UV make the shape and its parametrization visible.
+	fragColor = mix(inNormal * 0.5 + 0.5, vec3(inUV, 1.0), 0.25) * object.tint.rgb;
+}
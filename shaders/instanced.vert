@@ -0,0 +1,26 @@
+#version 450
+
+layout(set = 0, binding = 0) uniform CameraConstants {
+	mat4 viewProjection;
+} camera;
+
+// The model matrix comes from the instance stream; only the tint is used.
+layout(set = 0, binding = 1) uniform ObjectConstants {
+	mat4 model;
+	vec4 tint;
+} object;
+
+layout(location = 0) in vec3 inPosition;
+layout(location = 1) in vec3 inNormal;
+layout(location = 2) in vec2 inUV;
+// Per instance, written by InstanceTransforms::update; takes locations 3 to 6.
+layout(location = 3) in mat4 inModel;
+
+layout(location = 0) out vec3 fragColor;
+
+void main()
+{
+	gl_Position = camera.viewProjection * inModel * vec4(inPosition, 1.0);
+	// No lighting yet; the normal and UV make the shape and its parametrization visible.
+	fragColor = mix(inNormal * 0.5 + 0.5, vec3(inUV, 1.0), 0.25) * object.tint.rgb;
+}
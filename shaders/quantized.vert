@@ -0,0 +1,36 @@
+#version 450
+
+layout(set = 0, binding = 0) uniform CameraConstants {
+	mat4 viewProjection;
+} camera;
+
+layout(set = 0, binding = 1) uniform ObjectConstants {
+	mat4 model;
+	vec4 tint;
+} object;
+
+// QuantizedVertex: the vertex fetch turns the unorm16 position into [0, 1] (the model matrix maps that onto the
+// mesh bounds) and the half UVs into floats. Only the octahedral normal is decoded here.
+layout(location = 0) in vec4 inPosition;
+layout(location = 1) in vec2 inNormal;
+layout(location = 2) in vec2 inUV;
+
+layout(location = 0) out vec3 fragColor;
+
+// Mirrors decodeOctahedral in MeshData.h.
+vec3 decodeOctahedral(vec2 encoded)
+{
+	vec3 normal = vec3(encoded, 1.0 - abs(encoded.x) - abs(encoded.y));
+
+	if (normal.z < 0.0)
+		normal.xy = (1.0 - abs(normal.yx)) * vec2(normal.x >= 0.0 ? 1.0 : -1.0, normal.y >= 0.0 ? 1.0 : -1.0);
+
+	return normalize(normal);
+}
+
+void main()
+{
+	gl_Position = camera.viewProjection * object.model * vec4(inPosition.xyz, 1.0);
+	// No lighting yet; the normal and UV make the shape and its parametrization visible.
+	fragColor = mix(decodeOctahedral(inNormal) * 0.5 + 0.5, vec3(inUV, 1.0), 0.25) * object.tint.rgb;
+}